@@ -0,0 +1,322 @@
+// Author: npolosky
+#include <stdafx.h>
+
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <sys/resource.h>
+
+using namespace std;
+
+/*		Benchmarks of the HCOPI pipeline on synthetic data, written as JSON so that builds can be compared
+		and regressions found offline. Built by "make bench" into ./benchmark.
+
+	Usage:
+		./benchmark [--sizes 1000,10000,100000] [--horizon 10] [--order 1] [--output results.json]
+											run every benchmark on generated data sets of the given numbers
+											of episodes; the JSON goes to stdout unless --output is given
+		./benchmark --generate <csvFile> [--episodes 10000] [--horizon 10] [--order 1] [--seed 0]
+											only write a synthetic data set and exit
+*/
+
+/*		Writes a synthetic data set in the data.csv format: one dimensional states in [0, 1], two actions
+		chosen by a Fourier softmax behavior policy of the given order, and horizon steps per episode.
+		The state drifts up or down with the action, and the reward favors the upper half of [0, 1].
+
+	:param csvFile: name of the file to write
+	:param numEpisodes: number of episodes
+	:param horizon: number of steps of every episode
+	:param order: order of the behavior policy's FourierBasis
+	:param generator: a RNG
+*/
+void writeSyntheticDataFile(string csvFile, int numEpisodes, int horizon, int order, Philox &generator)
+{
+	const int m = 1, a = 2;
+	std::normal_distribution<double> nd(0.0, 0.5);
+	std::uniform_real_distribution<double> ud(0.0, 1.0);
+	FourierBasis fb;
+	fb.init(m, 1, order);
+	std::vector<double> params(a * fb.getNumOutputs());
+	for(auto &p : params)
+		p = nd(generator);
+	FnApproxSoftmax B(m, a, 1, order, params);
+
+	ofstream out(csvFile);
+	out.precision(17);
+	out << m << '\n' << a << '\n' << order << '\n';
+	for(size_t i = 0; i < params.size(); i++)
+		out << params[i] << (i + 1 < params.size() ? ',' : '\n');
+	out << numEpisodes << '\n';
+	std::vector<double> p_test;
+	for(int i = 0; i < numEpisodes; i++)
+	{
+		std::vector<double> state(1, ud(generator));
+		for(int t = 0; t < horizon; t++)
+		{
+			int action = B.getAction(state, generator);
+			if(i == 0)
+				p_test.push_back(B.getProb(state, action));
+			double reward = (state[0] > 0.5 ? 1.0 : -1.0) + 0.1 * nd(generator);
+			out << state[0] << ',' << action << ',' << reward << (t + 1 < horizon ? ',' : '\n');
+			state[0] = std::min(1.0, std::max(0.0, state[0] + (action == 1 ? 0.1 : -0.1) + 0.05 * nd(generator)));
+		}
+	}
+	for(size_t i = 0; i < p_test.size(); i++)
+		out << p_test[i] << (i + 1 < p_test.size() ? ',' : '\n');
+}
+
+// Peak resident set size of the process so far, in KB
+static long peakRSS()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/*		One benchmark result
+
+	:param name: benchmark name
+	:param episodes: number of episodes of the data set used, or 0
+	:param opsPerRun: operations (basified states, policy calls, episodes, ...) done by one call of the body
+	:param nsPerOp: average time per operation
+	:param episodesPerSec: episodes processed per second, or 0 if the benchmark does not process episodes
+	:param peakRSS: peak resident set size of the process after the benchmark, in KB
+*/
+struct BenchResult
+{
+	string name;
+	size_t episodes;
+	double opsPerRun;
+	int runs;
+	double nsPerOp;
+	double episodesPerSec;
+	long peakRSS;
+};
+
+/*		Times body, calling it once to warm up and then until minSeconds have passed (at least once)
+
+	:param episodesPerRun: episodes processed by one call, to report episodes per second
+*/
+static BenchResult timeBody(string name, size_t episodes, double opsPerRun, double episodesPerRun,
+							const std::function<void()> &body, double minSeconds = 0.5)
+{
+	body();
+	int runs = 0;
+	double elapsed = 0.0;
+	auto start = chrono::steady_clock::now();
+	while(runs == 0 || elapsed < minSeconds)
+	{
+		body();
+		runs++;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+	BenchResult result;
+	result.name = name;
+	result.episodes = episodes;
+	result.opsPerRun = opsPerRun;
+	result.runs = runs;
+	result.nsPerOp = elapsed * 1e9 / (runs * opsPerRun);
+	result.episodesPerSec = (episodesPerRun > 0 ? episodesPerRun * runs / elapsed : 0.0);
+	result.peakRSS = peakRSS();
+	cerr << name << " (" << episodes << " episodes): " << result.nsPerOp << " ns/op" << endl;
+	return result;
+}
+
+static void writeJSON(ostream &out, const std::vector<BenchResult> &results, int horizon, int order)
+{
+	out.precision(6);
+	out << "{\n  \"threads\": " << TaskScheduler::getInstance().getNumThreads()
+		<< ",\n  \"horizon\": " << horizon << ",\n  \"order\": " << order << ",\n  \"results\": [\n";
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &r = results[i];
+		out << "    {\"name\": \"" << r.name << "\", \"episodes\": " << r.episodes << ", \"ops_per_run\": " << r.opsPerRun
+			<< ", \"runs\": " << r.runs << ", \"ns_per_op\": " << r.nsPerOp << ", \"episodes_per_sec\": " << r.episodesPerSec
+			<< ", \"peak_rss_kb\": " << r.peakRSS << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+/*		Parses the arguments and runs the benchmarks, see Usage above
+
+	Returns the exit status of the program; errors of the pipeline are thrown
+*/
+static int runBenchmarks(int argc, char * argv[])
+{
+	std::vector<size_t> sizes = {1000, 10000, 100000};
+	int horizon = 10, order = 1, episodes = 10000;
+	uint64_t seed = 0;
+	string output, generateFile;
+	for(int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if(arg == "--sizes" && i + 1 < argc)
+		{
+			sizes.clear();
+			stringstream list(argv[++i]);
+			string size;
+			while(getline(list, size, ','))
+				sizes.push_back(stoul(size));
+		}
+		else if(arg == "--horizon" && i + 1 < argc)
+			horizon = stoi(argv[++i]);
+		else if(arg == "--order" && i + 1 < argc)
+			order = stoi(argv[++i]);
+		else if(arg == "--episodes" && i + 1 < argc)
+			episodes = stoi(argv[++i]);
+		else if(arg == "--seed" && i + 1 < argc)
+			seed = stoull(argv[++i]);
+		else if(arg == "--output" && i + 1 < argc)
+			output = argv[++i];
+		else if(arg == "--generate" && i + 1 < argc)
+			generateFile = argv[++i];
+		else
+		{
+			cerr << "unknown argument " << arg << endl;
+			return 1;
+		}
+	}
+	// every benchmark and synthetic data set depends on the generator, so a wrong block function stops here
+	if(!Philox::checkKnownAnswers())
+	{
+		cerr << "Philox4x64-10 does not match its known-answer vectors" << endl;
+		return 1;
+	}
+	// and so does every result on the exp and cos kernels of each instruction set the CPU supports
+	for(int level = SIMD_SSE2; level <= getSupportedSimdLevel(); level++)
+	{
+		double expError, cosError;
+		if(!checkSimdAccuracy((SimdLevel)level, expError, cosError))
+		{
+			cerr << simdLevelName((SimdLevel)level) << " vector kernels exceed the error bounds (exp " << expError
+				 << ", cos " << cosError << ")" << endl;
+			return 1;
+		}
+	}
+	if(!generateFile.empty())
+	{
+		Philox generator(seed);
+		writeSyntheticDataFile(generateFile, episodes, horizon, order, generator);
+		return 0;
+	}
+
+	// open the output before the benchmarks run, so that a bad path does not cost a full run
+	ofstream out;
+	if(!output.empty())
+	{
+		out.open(output);
+		if(!out)
+			throw runtime_error("cannot open " + output + " for writing");
+	}
+
+	std::vector<BenchResult> results;
+	const int m = 1, a = 2;
+	FnApproxSoftmax policy(m, a, 1, order, std::vector<double>());
+	const FourierBasis &fb = policy.getBasis();
+
+	// Kernels on a block of random states
+	{
+		const size_t count = 4096;
+		Philox generator(seed, 1);
+		std::uniform_real_distribution<double> ud(0.0, 1.0);
+		std::vector<double> states(count * m), features(count * fb.getNumOutputs()), probs(count);
+		std::vector<int> actions(count);
+		for(auto &s : states)
+			s = ud(generator);
+		for(auto &act : actions)
+			act = (int)(generator() % a);
+		results.push_back(timeBody("basify_block", 0, count, 0, [&]
+		{
+			fb.basify(states.data(), count, features.data());
+		}));
+		std::vector<double> state(1, 0.3);
+		results.push_back(timeBody("basify_state", 0, 1, 0, [&]
+		{
+			state[0] = fb.basify(state)[0] * 1e-3 + 0.3;
+		}));
+		results.push_back(timeBody("getProb", 0, 1, 0, [&]
+		{
+			state[0] = policy.getProb(state, 1) * 1e-3 + 0.3;
+		}));
+		results.push_back(timeBody("getProbs_block", 0, count, 0, [&]
+		{
+			policy.getProbs(states.data(), actions.data(), count, probs.data(), true);
+		}));
+	}
+
+	for(size_t size : sizes)
+	{
+		string csvFile = "benchmark_data_" + to_string(size) + ".csv";
+		Philox generator(seed, 2, size);
+		writeSyntheticDataFile(csvFile, (int)size, horizon, order, generator);
+
+		int fm, fa, fk, n;
+		std::vector<double> params, p_test;
+		TrajectoryStore D;
+		results.push_back(timeBody("readDataFile", size, (double)size, (double)size, [&]
+		{
+			params.clear();
+			p_test.clear();
+			D = readDataFile(csvFile, fm, fa, fk, params, n, p_test);
+		}));
+		const FnApproxSoftmax B(fm, fa, 1, fk, params);
+		augmentData(D, params, B);
+		FeatureCache F(D, B.getBasis());
+
+		results.push_back(timeBody("PDIS", size, (double)size, (double)size, [&]
+		{
+			PDIS(D, params, B);
+		}));
+		results.push_back(timeBody("PDIS_cached", size, (double)size, (double)size, [&]
+		{
+			PDIS(D, F, params, B);
+		}));
+
+		// One CMA-ES generation (lambda evaluations) of the candidate search on 70% of the data
+		size_t numCandidate = (size_t)(size * 0.7);
+		TrajectoryStore Dc = D.subset(0, numCandidate), Ds = D.subset(numCandidate, size);
+		int sSize = (int)Ds.getNumEpisodes();
+		double delta = 0.05, c = averageReturn(D);
+		HCOPEParams hcopeParams = {&Dc, sSize, delta, c, &B, &F, NULL};
+		const void* searchParams[1];
+		searchParams[0] = &hcopeParams;
+		VectorXd initialSolution = Map<const VectorXd>(params.data(), params.size());
+		unsigned int lambda = 4 + (unsigned int)floor(3.0 * log((double)params.size()));
+		results.push_back(timeBody("CMAES_generation", numCandidate, 1, (double)numCandidate * lambda, [&]
+		{
+			Philox searchGenerator(seed, 3);
+			CMAES(initialSolution, 1.0, lambda, HCOPEBatch, searchParams, false, searchGenerator);
+		}));
+
+		results.push_back(timeBody("HCOPI", size, 1, 0, [&]
+		{
+			Philox searchGenerator(seed, 4);
+			HCOPI(Dc, Ds, delta, c, params, B, searchGenerator, &F);
+		}, 0.0));
+		remove(csvFile.c_str());
+	}
+
+	if(output.empty())
+		writeJSON(cout, results, horizon, order);
+	else
+	{
+		writeJSON(out, results, horizon, order);
+		out.close();
+		if(!out)
+			throw runtime_error("cannot write " + output);
+	}
+	return 0;
+}
+
+int main(int argc, char * argv[])
+{
+	try
+	{
+		return runBenchmarks(argc, argv);
+	}
+	catch(const exception &e)
+	{
+		cerr << "benchmark failed: " << e.what() << endl;
+		return 1;
+	}
+}
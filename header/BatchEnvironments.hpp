@@ -0,0 +1,115 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for batched versions of the CartPole and MountainCar environments, which hold N copies
+		(lanes) of the environment in structure-of-arrays form and step all of them with one call.
+
+		The dynamics are those of CartPole and MountainCar, written as loops over the lanes, with the sines
+		and cosines of all lanes computed by vecSinCos / vecCos. With HCOPI_SIMD=scalar the lanes follow
+		the scalar environments exactly; otherwise they differ by the vector kernels' rounding (below 1e-15
+		per call). Every lane has a terminal flag: update leaves lanes in a terminal state unchanged (with
+		a reward of 0) until newEpisode(lane) starts a new episode in them. Both environments are
+		deterministic, so unlike the scalar classes the batched ones take no RNG.
+
+	:memberFn getNumEnvironments: the number of lanes N
+	:memberFn getStateDim: dimension of the state of one lane
+	:memberFn getNumActions: number of actions of one lane
+	:memberFn update: applies actions[i] in lane i for every lane not in a terminal state and writes the rewards
+	:memberFn getStates: writes the normalized states of all lanes, N x stateDim row-major, as getState returns them
+	:memberFn inTerminalState: whether lane i is in a terminal state
+	:memberFn getTerminalMask: the terminal flags of all lanes (1 = terminal)
+	:memberFn getNumActive: number of lanes not in a terminal state
+	:memberFn newEpisode: starts a new episode in one lane
+	:memberFn newEpisodes: starts a new episode in every lane
+	:memberFn resetTerminal: starts a new episode in every lane in a terminal state and returns how many there were
+*/
+
+class CartPoleBatch
+{
+public:
+	CartPoleBatch(size_t numEnvironments);
+	size_t getNumEnvironments() const;
+	int getStateDim() const;
+	int getNumActions() const;
+	void update(const int * actions, double * rewards);
+	void getStates(double * out) const;
+	bool inTerminalState(size_t lane) const;
+	const std::vector<unsigned char> & getTerminalMask() const;
+	size_t getNumActive() const;
+	void newEpisode(size_t lane);
+	void newEpisodes();
+	size_t resetTerminal();
+
+private:
+	void updateTerminal();
+
+	// Standard parameters for the CartPole domain, as in CartPole.hpp
+	const int simSteps = 10;
+	const double dt = 0.02;
+	const double uMax = 10.0;
+	const double l = 0.5;
+	const double g = 9.8;
+	const double m = 0.1;
+	const double mc = 1;
+	const double muc = 0.0005;
+	const double mup = 0.000002;
+
+	// State variables ranges
+	const double xMin = -2.4;
+	const double xMax = 2.4;
+	const double vMin = -10;
+	const double vMax = 10;
+	const double thetaMin = -M_PI / 12.0;
+	const double thetaMax = M_PI / 12.0;
+	const double omegaMin = -M_PI;
+	const double omegaMax = M_PI;
+
+	// State variables of all lanes
+	std::vector<double> x;
+	std::vector<double> v;
+	std::vector<double> theta;
+	std::vector<double> omega;
+	std::vector<double> t;
+
+	// sin(theta) and cos(theta) of all lanes in the current substep
+	std::vector<double> sinTheta;
+	std::vector<double> cosTheta;
+
+	std::vector<unsigned char> terminal;
+};
+
+class MountainCarBatch
+{
+public:
+	MountainCarBatch(size_t numEnvironments);
+	size_t getNumEnvironments() const;
+	int getStateDim() const;
+	int getNumActions() const;
+	void update(const int * actions, double * rewards);
+	void getStates(double * out) const;
+	bool inTerminalState(size_t lane) const;
+	const std::vector<unsigned char> & getTerminalMask() const;
+	size_t getNumActive() const;
+	void newEpisode(size_t lane);
+	void newEpisodes();
+	size_t resetTerminal();
+
+private:
+	void updateTerminal();
+
+	const double minX = -1.2;
+	const double maxX = 0.5;
+	const double minXDot = -0.07;
+	const double maxXDot = 0.07;
+
+	// Position and velocity of all lanes
+	std::vector<double> x;
+	std::vector<double> xDot;
+
+	// cos(3 x) of all lanes
+	std::vector<double> cos3x;
+
+	std::vector<unsigned char> terminal;
+};
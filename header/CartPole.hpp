@@ -8,10 +8,10 @@ public:
 	CartPole();
 	int getStateDim() const;
 	int getNumActions() const;
-	double update(const int & action, std::mt19937_64 & generator);
-	std::vector<double> getState(std::mt19937_64 & generator);
+	double update(const int & action, Philox & generator);
+	std::vector<double> getState(Philox & generator);
 	bool inTerminalState() const;
-	void newEpisode(std::mt19937_64 & generator);
+	void newEpisode(Philox & generator);
 
 private:
 	// Standard parameters for the CartPole domain
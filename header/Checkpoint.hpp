@@ -0,0 +1,107 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+#include <chrono>
+
+/*		Header for checkpoints of CMA-ES searches, which let an interrupted HCOPI run continue where it
+		stopped instead of starting over.
+
+		A CMAESState holds everything a CMA-ES search carries from one generation to the next (the mean,
+		step size, evolution paths and covariance model of its variant, the number of evaluations so far,
+		the state of its normal distribution and the position of its generator), so a search resumed from
+		a checkpoint samples and evaluates exactly the populations the uninterrupted search would have, and
+		finds the same solution. Quantities derived from the state (B * diag(D), C^-1/2) are recomputed.
+
+		A checkpoint file is a CheckpointHeader followed by the arrays of the state, each as its row and
+		column counts and its values, in the host's native byte order. It is written to a temporary file
+		that is synced to disk and then renamed over the previous checkpoint, and the rename is synced by
+		syncing the directory, so neither a run killed while writing nor a crash of the host leaves a
+		truncated checkpoint or loses the previous one. The generator is restored by its position, so it must be a stream
+		that starts at block 0 of its (generation, candidate, episode) counter, as the generator of a trial
+		(Philox(seed, trial)) is.
+
+		A checkpointed run is a directory holding a file "run" with the seed and CMA-ES variant of the run
+		and the settings it was started with (see CheckpointRunSettings), one "key value" line each, and a
+		file trial<i>.ckpt for every trial that has started.
+*/
+
+const char CHECKPOINT_MAGIC[8] = {'H', 'C', 'O', 'P', 'I', 'C', 'K', 'P'};
+const uint32_t CHECKPOINT_VERSION = 1;
+
+struct CheckpointHeader
+{
+	char magic[8];					// CHECKPOINT_MAGIC
+	uint32_t version;				// CHECKPOINT_VERSION
+	uint32_t variant;				// a CMAESVariant
+	uint64_t N;						// number of parameters
+	uint64_t lambda;				// population size
+	uint64_t counteval;				// evaluations so far
+	uint64_t usedPaths;				// evolution paths in use (CMAES_LIMITED_MEMORY)
+	uint64_t generatorPosition;		// outputs drawn from the search's generator
+	uint64_t normalStateSize;		// length of the serialized normal distribution, stored after the arrays
+	double sigma;					// step size
+	double eigeneval;				// counteval at the last eigendecomposition (CMAES_FULL)
+};
+
+/*		The state of a CMA-ES search between two generations. Arrays a variant does not use are empty.
+*/
+struct CMAESState
+{
+	CheckpointHeader header = CheckpointHeader();	// zeroed, so fields a variant does not use are written as 0
+	VectorXd xmean;					// mean of the search distribution
+	VectorXd ps, pc;				// evolution paths of the step size and of the covariance
+	VectorXd D;						// square roots of the eigenvalues of C (CMAES_FULL)
+	MatrixXd C;						// covariance matrix (CMAES_FULL), or its diagonal (CMAES_SEPARABLE)
+	MatrixXd B;						// eigenvectors of C (CMAES_FULL)
+	MatrixXd paths;					// evolution paths (CMAES_LIMITED_MEMORY)
+	VectorXd best;					// best solution of the last generation, the result of a finished search
+	std::string normalState;		// the normal distribution, as written by operator<<
+};
+
+/*		The checkpoint file of one CMA-ES search, written at most every interval seconds
+
+	:memberFn CMAESCheckpoint: constructor, takes the file and the minimum time between writes
+	:memberFn load: reads the checkpoint; returns false if the file does not exist
+	:memberFn due: whether the search should save its state now: when it has finished, or when interval
+				   seconds have passed since the last write
+	:memberFn save: writes the state to the file
+
+	:hiddenVar fileName: the checkpoint file
+	:hiddenVar interval: minimum number of seconds between two writes
+	:hiddenVar lastSave: time of the last write, or of the construction
+*/
+
+class CMAESCheckpoint
+{
+public:
+	CMAESCheckpoint(std::string fileName, double interval);
+	bool load(CMAESState &state) const;
+	bool due(bool finished) const;
+	void save(const CMAESState &state);
+private:
+	std::string fileName;
+	double interval;
+	std::chrono::steady_clock::time_point lastSave;
+};
+
+// The settings of a checkpointed run, other than its seed and variant, that change the policies its trials
+// find. A run can only be resumed with the settings it was started with.
+struct CheckpointRunSettings
+{
+	std::string dataFile;			// the data file, as given on the command line; its size is recorded too
+	bool floatSearch;				// --float-search
+	bool stream;					// --stream
+	bool cacheFeatures;				// false for --no-feature-cache
+	double weightTolerance;			// the PDIS weight tolerance, recorded to 6 significant digits
+	int numWorkers;					// number of workers of a sharded run, 0 if the run is not sharded
+};
+
+// Reads the seed and CMA-ES variant of the run checkpointed in directory and checks its settings, or
+// creates the directory and records them for a new run. See Checkpoint.cpp for a description of the arguments.
+void openCheckpointRun(const std::string &directory, bool resume, uint64_t &seed, CMAESVariant &variant,
+					   const CheckpointRunSettings &settings);
+
+// Name of the checkpoint file of a trial of the run checkpointed in directory
+std::string trialCheckpointFile(const std::string &directory, size_t trial);
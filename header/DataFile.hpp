@@ -0,0 +1,192 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for reading data sets from csv data files and from the versioned binary data file format.
+
+		A csv data file holds m, a, k, the behavior parameters and n on its first five lines, followed
+		by one line per history of (state, action, reward) steps and a last line holding p_test.
+
+		The binary data file format is versioned. A binary data file holds everything a
+		data.csv file holds (m, a, k, the behavior parameters, n, the histories and p_test) plus the
+		behavior policy action probabilities computed by augmentData, laid out so that it can be
+		memory mapped and used as a TrajectoryStore without any parsing or copying. Processes that
+		map the same file share one page cache copy of it.
+
+		Layout: a DataFileHeader followed by the sections it points to, each starting on a 64 byte
+		boundary. All values are stored in the host's native byte order.
+
+			behavior parameters		double[numParams]
+			p_test					double[numTestProbs]
+			episode offsets			uint64_t[numEpisodes + 1]
+			states					double[numSteps * m]
+			actions					int32_t[numSteps]
+			rewards					double[numSteps]
+			behavior probabilities	double[numSteps]
+*/
+
+const char DATA_FILE_MAGIC[8] = {'H', 'C', 'O', 'P', 'I', 'D', 'A', 'T'};
+const uint32_t DATA_FILE_VERSION = 1;
+
+struct DataFileHeader
+{
+	char magic[8];					// DATA_FILE_MAGIC
+	uint32_t version;				// DATA_FILE_VERSION
+	uint32_t headerSize;			// sizeof(DataFileHeader), guards against layout mismatches
+	int32_t m;						// number of state features
+	int32_t a;						// number of discrete actions
+	int32_t k;						// order of the FourierBasis used by the behavior policy
+	int32_t n;						// number of episodes as declared by the source data file
+	uint64_t numParams;
+	uint64_t numTestProbs;
+	uint64_t numEpisodes;
+	uint64_t numSteps;
+	uint64_t paramsOffset;			// byte offsets of the sections from the start of the file
+	uint64_t testProbsOffset;
+	uint64_t offsetsOffset;
+	uint64_t statesOffset;
+	uint64_t actionsOffset;
+	uint64_t rewardsOffset;
+	uint64_t behaviorProbsOffset;
+	uint64_t fileSize;
+};
+
+// Parses a csv data file in parallel. See DataFile.cpp for a description of the arguments.
+TrajectoryStore readDataFile(std::string dataFile, int &m, int &a, int &k, std::vector<double> &params,
+							 int &n, std::vector<double> &p_test);
+
+// Returns true if dataFile starts with the binary data file magic
+bool isBinaryDataFile(std::string dataFile);
+
+// Writes D and the data file header values to dataFile in the binary format. D must already hold
+// the behavior probabilities (see augmentData).
+void writeBinaryDataFile(std::string dataFile, const TrajectoryStore &D, int m, int a, int k,
+						 const std::vector<double> &params, int n, const std::vector<double> &p_test);
+
+/*		Writes a binary data file from histories that arrive a block at a time (e.g. from the rollout
+		generator) without holding the whole data set in memory. The step columns are streamed to
+		temporary files next to the data file and copied into their sections by finish.
+
+	:memberFn BinaryDataFileWriter: constructor, takes the header values known up front
+	:memberFn append: appends the histories of a block; its offsets start at 0 and its behavior
+					  probabilities must be filled in
+	:memberFn finish: writes the data file with the given p_test and removes the temporary files
+
+	:hiddenVar dataFile: name of the data file
+	:hiddenVar m, a, k, params: header values
+	:hiddenVar offsets: the episode offsets appended so far
+	:hiddenVar columns: the temporary files of the states, actions, rewards and behavior probabilities
+*/
+
+class BinaryDataFileWriter
+{
+public:
+	BinaryDataFileWriter(std::string dataFile, int m, int a, int k, const std::vector<double> &params);
+	void append(const TrajectoryColumns &block);
+	void finish(const std::vector<double> &p_test);
+private:
+	std::string columnFile(int column) const;
+
+	std::string dataFile;
+	int m, a, k;
+	std::vector<double> params;
+	std::vector<uint64_t> offsets;
+	std::ofstream columns[4];
+};
+
+// Memory maps a binary data file read only. Takes the same outputs as readDataFile and returns a
+// store viewing the mapped columns, which stays mapped for as long as the store or any subset of it exists.
+TrajectoryStore mapBinaryDataFile(std::string dataFile, int &m, int &a, int &k, std::vector<double> &params,
+								  int &n, std::vector<double> &p_test);
+
+/*		Reads a data file one chunk of episodes at a time, for data sets that do not fit in memory. A pass
+		over the stream holds only the chunk being processed and the next one, which is read while the
+		first is processed.
+
+		Chunks of a binary data file are read straight from its column sections. A csv data file is
+		scanned once by the constructor, which counts the histories and records the position of every
+		chunkEpisodes-th one; its chunks are parsed as they are read and get their behavior probabilities
+		from augmentData. Every chunk owns its columns, with step indices starting at 0.
+
+	:memberFn DataFileStream: constructor, reads the header values (and indexes a csv file)
+	:memberFn subset: returns a stream over a contiguous range of the episodes
+	:memberFn getM, getA, getK, getBehaviorParameters: header values of the file
+	:memberFn getNumEpisodes: number of episodes in the stream
+	:memberFn forEachChunk: reads the episodes in order and calls visit on every chunk of them
+	:memberFn read: reads all episodes of the stream into one store, for a subset that fits in memory
+
+	:hiddenVar dataFile: name of the data file
+	:hiddenVar binary: whether the file is in the binary format
+	:hiddenVar m, a, k, params: header values
+	:hiddenVar header: the header of a binary file
+	:hiddenVar lineIndex: for a csv file, the byte offset of the line of every chunkEpisodes-th history
+	:hiddenVar firstEpisode, lastEpisode: the range of episodes of the file in the stream
+	:hiddenVar chunkEpisodes: number of episodes per chunk
+*/
+
+// Number of episodes per chunk of a DataFileStream
+const size_t DATA_STREAM_CHUNK_EPISODES = 4096;
+
+class DataFileStream
+{
+public:
+	explicit DataFileStream(std::string dataFile, size_t chunkEpisodes = DATA_STREAM_CHUNK_EPISODES);
+	DataFileStream subset(size_t first, size_t last) const;
+	int getM() const { return m; }
+	int getA() const { return a; }
+	int getK() const { return k; }
+	const std::vector<double> & getBehaviorParameters() const { return params; }
+	size_t getNumEpisodes() const { return lastEpisode - firstEpisode; }
+	void forEachChunk(const std::function<void(const TrajectoryStore &)> &visit) const;
+	TrajectoryStore read() const;
+private:
+	TrajectoryStore readBinaryChunk(int fd, size_t first, size_t last) const;
+	TrajectoryStore readCsvChunk(std::istream &in, size_t numEpisodes, const Policy &B) const;
+
+	std::string dataFile;
+	bool binary;
+	int m, a, k;
+	std::vector<double> params;
+	DataFileHeader header;
+	std::vector<uint64_t> lineIndex;
+	size_t firstEpisode, lastEpisode;
+	size_t chunkEpisodes;
+};
+
+/*		Reads the episodes appended to an episode log: a csv file of history lines in the layout of the
+		histories of a csv data file (no header lines and no p_test line), which producers append to as
+		new episodes of the behavior policy arrive. Every call returns only the histories appended since
+		the previous one.
+
+	:memberFn EpisodeLogReader: constructor; the log is read from its start
+	:memberFn readNew: returns the complete histories appended since the last call, augmented with their
+					   behavior probabilities
+	:memberFn getPosition: byte offset in the log up to which histories have been read
+
+	:hiddenVar logFile: name of the log
+	:hiddenVar m: number of state features
+	:hiddenVar params, B: the behavior policy
+	:hiddenVar position: byte offset of the first history not read yet
+*/
+
+class EpisodeLogReader
+{
+public:
+	EpisodeLogReader(std::string logFile, int m, const std::vector<double> &params, const Policy &B);
+	TrajectoryStore readNew();
+	uint64_t getPosition() const { return position; }
+private:
+	std::string logFile;
+	int m;
+	std::vector<double> params;
+	const Policy &B;
+	uint64_t position;
+};
+
+// Computes the behavior policy probabilities of every step of D under params and stores them in D.
+// Returns the average undiscounted return of the histories.
+double augmentData(TrajectoryStore &D, std::vector<double> params, const Policy &B);
+
+// Returns the average undiscounted return of the histories in D
+double averageReturn(const TrajectoryStore &D);
@@ -19,12 +19,12 @@
 class FCHC
 {
 public:
-	FCHC(std::vector<double> initparams, double initsigma, double (*f)(std::vector<double> p, int n, mt19937_64 &generator, bool r), int nEpisodes);
-	void train(mt19937_64 &generator);
+	FCHC(std::vector<double> initparams, double initsigma, double (*f)(std::vector<double> p, int n, Philox &generator, bool r), int nEpisodes);
+	void train(Philox &generator);
 	std::vector<double> getParameters();
 private:
 	int numEpisodes;
-	double (*evalFunction)(std::vector<double> p, int n, mt19937_64 &generator, bool r);
+	double (*evalFunction)(std::vector<double> p, int n, Philox &generator, bool r);
 	std::vector<double> bestParams;
 	double bestJ = -DBL_MAX;
 	double sigma;
@@ -0,0 +1,38 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for the FeatureCacheT class which holds the FourierBasis features of every state in a
+		TrajectoryStore in one contiguous row-major matrix, so that the features are computed once
+		instead of every time a policy is evaluated on the data. Rows are indexed by the same absolute
+		step indices as the store, so a cache built from a store also serves every subset of it.
+
+		The features are stored as Scalar. FeatureCache (double) serves every evaluation; FeatureCacheF
+		(float) halves the memory and bandwidth of the cache and doubles the SIMD width of the policy
+		products, for the candidate search where only the ranking of candidates matters.
+
+	:memberFn FeatureCacheT: constructor, basifies every state of the store
+	:memberFn getNumFeatures: number of features per step
+	:memberFn getFeatures: pointer to the numFeatures features of the state at a step
+
+	:hiddenVar numFeatures: number of features per step
+	:hiddenVar firstStep: absolute index of the first step covered by the cache
+	:hiddenVar features: numFeatures values per step
+*/
+
+template<typename Scalar>
+class FeatureCacheT
+{
+public:
+	FeatureCacheT(const TrajectoryStore &D, const FourierBasis &fb);
+	int getNumFeatures() const { return numFeatures; }
+	const Scalar * getFeatures(size_t step) const { return &features[(step - firstStep) * numFeatures]; }
+private:
+	int numFeatures;
+	size_t firstStep;
+	std::vector<Scalar> features;
+};
+
+typedef FeatureCacheT<double> FeatureCache;
+typedef FeatureCacheT<float> FeatureCacheF;
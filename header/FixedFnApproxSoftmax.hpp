@@ -0,0 +1,130 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+#include <array>
+
+/*		Header for the compile time specialized kernels of FourierBasis and FnApproxSoftmax
+
+		FourierBasis and FnApproxSoftmax take the state dimension, number of actions and basis orders at
+		run time. For the configurations listed in FixedFnApproxSoftmax.cpp the same computations are also
+		instantiated with all of these as template parameters: the coefficient table of the basis is
+		generated by a constexpr function, the features and weights have a fixed number of columns and the
+		softmax rows a fixed length, so the compiler fully unrolls the loops over state dimensions, features
+		and actions and drops the zero coefficients. FourierBasis::init and the FnApproxSoftmax constructor look their
+		configuration up and use these kernels when it is listed; other configurations keep the dynamic
+		code.
+
+		The kernels compute the same quantities as the dynamic code; only the summation order of the action
+		preferences may differ.
+*/
+
+// Number of features of a FourierBasis, as computed by FourierBasis::init
+constexpr int fourierNumTerms(int stateDim, int iOrder, int dOrder)
+{
+	int dTerms = 1;
+	for(int i = 0; i < stateDim; i++)
+		dTerms *= dOrder + 1;
+	return iOrder * stateDim + dTerms - (iOrder < dOrder ? iOrder : dOrder) * stateDim;
+}
+
+/*		The coefficient table of a FourierBasis, in the order FourierBasis::init produces it: the dependent
+		terms counting up with the first state variable as the fastest digit, then the independent terms
+*/
+template<int StateDim, int IOrder, int DOrder>
+struct FourierCoefficients
+{
+	static constexpr int numTerms = fourierNumTerms(StateDim, IOrder, DOrder);
+	typedef std::array<std::array<double, StateDim>, numTerms> Table;
+
+	static constexpr Table make()
+	{
+		Table c{};
+		std::array<double, StateDim> counter{};
+		int termCount = 0;
+		for(; termCount < numTerms - (IOrder > DOrder ? IOrder - DOrder : 0) * StateDim; termCount++)
+		{
+			c[termCount] = counter;
+			for(int i = 0; i < StateDim; i++)
+			{
+				counter[i]++;
+				if(counter[i] <= DOrder)
+					break;
+				counter[i] = 0;
+			}
+		}
+		for(int i = 0; i < StateDim; i++)
+			for(int j = DOrder + 1; j <= IOrder; j++)
+			{
+				c[termCount][i] = (double)j;
+				termCount++;
+			}
+		return c;
+	}
+
+	static constexpr Table table = make();
+};
+
+// FourierBasis::basify(x, count, out) for a fixed configuration
+template<int StateDim, int IOrder, int DOrder>
+struct FixedFourierBasis
+{
+	typedef FourierCoefficients<StateDim, IOrder, DOrder> C;
+
+	static void basify(const double * x, size_t count, double * out)
+	{
+		for(size_t r = 0; r < count; r++)
+		{
+			const double * row = x + r * StateDim;
+			double * rowOut = out + r * C::numTerms;
+			for(int i = 0; i < C::numTerms; i++)
+			{
+				double d = 0;
+				for(int j = 0; j < StateDim; j++)
+					d += C::table[i][j] * row[j];
+				rowOut[i] = M_PI * d;
+			}
+		}
+		vecCos(out, out, count * C::numTerms);
+	}
+};
+
+/*		FnApproxSoftmax::getProbsFromFeaturesMulti for a fixed number of actions and features. Scalar is the
+		type of the features and of the preference sums (as in the dynamic float version); the softmax
+		runs in double.
+*/
+template<int NumActions, int NumFeatures, typename Scalar>
+struct FixedSoftmax
+{
+	static void probsFromFeaturesMulti(const double * thetas, int numPolicies, const Scalar * phi, const int * actions,
+									   size_t count, double sigma, double * out, bool logProbs)
+	{
+		typedef Eigen::Matrix<Scalar, Eigen::Dynamic, NumFeatures, Eigen::RowMajor> Features;
+		typedef Eigen::Matrix<double, Eigen::Dynamic, NumFeatures, Eigen::RowMajor> Weights;
+		typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Logits;
+		// as in the dynamic version, the parameter vectors stacked on top of each other make one product
+		Eigen::Map<const Features> features(phi, count, NumFeatures);
+		Features weights = Eigen::Map<const Weights>(thetas, numPolicies * NumActions, NumFeatures).template cast<Scalar>();
+		Logits logits = sigma * (features * weights.transpose()).template cast<double>();
+		for(int k = 0; k < numPolicies; k++)
+			softmaxSelect(logits.data() + k * NumActions, NumActions, numPolicies * NumActions, actions, count, out + k * count, logProbs);
+	}
+};
+
+// Kernels of one listed configuration; see FixedFnApproxSoftmax.cpp
+struct FixedPolicyKernels
+{
+	int stateDim, numActions, iOrder, dOrder;
+	BasifyKernel basify;
+	void (*probs)(const double * thetas, int numPolicies, const double * phi, const int * actions, size_t count,
+				  double sigma, double * out, bool logProbs);
+	void (*probsFloat)(const double * thetas, int numPolicies, const float * phi, const int * actions, size_t count,
+					   double sigma, double * out, bool logProbs);
+};
+
+// Returns the kernels of a configuration, or NULL if it is not listed
+const FixedPolicyKernels * findFixedPolicyKernels(int stateDim, int numActions, int iOrder, int dOrder);
+
+// Returns the basify kernel of a basis configuration listed with any number of actions, or NULL
+BasifyKernel findFixedBasify(int stateDim, int iOrder, int dOrder);
@@ -13,13 +13,24 @@ using namespace std;
 	:memberFn getAction: returns an action given a state
 	:memberFn getActionProb: returns a vector of action probabilities given a state
 	:memberFn getProb: returns the probability of a particular action in a particular state
+	:memberFn getActionProbs: writes the action probabilities of a block of states to a buffer
+	:memberFn getActionProbFromFeatures: returns a vector of action probabilities given the features of a state
+	:memberFn getProbFromFeatures: returns the probability of a particular action given the features of a state
+	:memberFn getProbs: writes the probabilities (or log-probabilities) of a block of state-action pairs to a buffer
+	:memberFn getProbsFromFeatures: getProbs for a block of states given by their features, e.g. from a FeatureCache
+	:memberFn getProbsMulti: getProbs for several parameter vectors at once
+	:memberFn getProbsFromFeaturesMulti: getProbsFromFeatures for several parameter vectors at once
+						The feature functions also take float features (a FeatureCacheF), in which case the
+						action preferences are computed in single precision
+	:memberFn getBasis: returns the FourierBasis used to compute features, e.g. to build a FeatureCache
 
 	:hiddenVar fb: a FourierBasis object which is used to compute a feature vector representation of the current state
-	:hiddenVar parameters: the parameters of the policy
+	:hiddenVar parameters: the parameters of the policy, a numActions x numFeatures row-major matrix
 	:hiddenVar sigma: "temperature" used in the softmax function
 	:hiddenVar stateDim: the dimensionality of states in the underlying MDP
 	:hiddenVar numActions: number of actions in the underlying MDP
 	:hiddenVar numFeatures: number of features to compute using FourierBasis
+	:hiddenVar fixedKernels: the compile time specialized kernels of this configuration, or NULL
 	:hiddenVAr ud: a uniform distribution used for sampling actions
 */
 
@@ -27,17 +38,31 @@ class FnApproxSoftmax : public Policy
 {
 public:
 	FnApproxSoftmax(int sDim, int nActions, int iOrder, int dOrder, std::vector<double> params);
-	std::vector<double> getParameters();
+	std::vector<double> getParameters() const;
 	void setParameters(std::vector<double> params);
-	int getAction(std::vector<double> state, std::mt19937_64 & generator);
-	std::vector<double> getActionProb(std::vector<double> state);
-	double getProb(std::vector<double> state, int action);
+	int getAction(std::vector<double> state, Philox & generator);
+	std::vector<double> getActionProb(std::vector<double> state) const;
+	double getProb(std::vector<double> state, int action) const;
+	void getActionProbs(const double * states, size_t count, double * out) const;
+	std::vector<double> getActionProbFromFeatures(const double * phi) const;
+	double getProbFromFeatures(const double * phi, int action) const;
+	void getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs = false) const;
+	void getProbsFromFeatures(const double * phi, const int * actions, size_t count, double * out, bool logProbs = false) const;
+	void getProbsMulti(const double * thetas, int numPolicies, const double * states, const int * actions,
+					   size_t count, double * out, bool logProbs = false) const;
+	void getProbsFromFeaturesMulti(const double * thetas, int numPolicies, const double * phi, const int * actions,
+								   size_t count, double * out, bool logProbs = false) const;
+	void getProbsFromFeatures(const float * phi, const int * actions, size_t count, double * out, bool logProbs = false) const;
+	void getProbsFromFeaturesMulti(const double * thetas, int numPolicies, const float * phi, const int * actions,
+								   size_t count, double * out, bool logProbs = false) const;
+	const FourierBasis & getBasis() const;
 private:
 	FourierBasis fb;
-	std::vector<std::vector<double>> parameters;
+	std::vector<double> parameters;
 	double sigma;
 	int stateDim;
 	int numActions;
 	int numFeatures;
+	const struct FixedPolicyKernels * fixedKernels;
 	std::uniform_real_distribution<double> ud;
 };
\ No newline at end of file
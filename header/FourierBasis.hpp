@@ -2,6 +2,9 @@
 
 #include "stdafx.h"
 
+// basify(x, count, out) of a FourierBasis configuration fixed at compile time (see FixedFnApproxSoftmax.hpp)
+typedef void (*BasifyKernel)(const double * x, size_t count, double * out);
+
 // A class implementing the Fourier basis
 class FourierBasis
 {
@@ -9,9 +12,13 @@ public:
 	void init(const int & inputDimension, int iOrder, int dOrder);
 	int getNumOutputs() const;
 	std::vector<double> basify(const std::vector<double> & x) const;
+	void basify(const double * x, double * out) const;		// Writes the getNumOutputs() features of x to out
+	void basify(const double * x, size_t count, double * out) const;	// Same for count states stored back to back
+	void basify(const double * x, size_t count, float * out) const;		// Same, rounding the features to float
 
 private:
 	int nTerms;							// Total number of outputs
 	int inputDimension;
 	std::vector<std::vector<double>> c;	// Coefficients
+	BasifyKernel fixedBasify = NULL;	// Specialized basify of this configuration, if there is one
 };
\ No newline at end of file
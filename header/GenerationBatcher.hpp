@@ -0,0 +1,62 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+/*		Header for the GenerationBatcher class, which lets the CMA-ES searches of concurrently running trials
+		share the evaluation of their generations when every evaluation is a pass over data that is
+		expensive to reach (a data set streamed from its file, or the workers of a sharded run).
+
+		A search hands the population of its generation to evaluate, which blocks until every search that
+		has joined and not left yet has handed in its population as well. The last one to arrive evaluates
+		all of them with one call of the pass function, as the columns of one matrix, and wakes the others
+		with the statistics of their columns. So a generation of all trials costs one pass, and no two
+		passes run at once. The statistics of a column do not depend on the other columns, so a search gets
+		the same values as from a pass of its own.
+
+		A search blocks until the others arrive, so every search must run on a thread of its own rather
+		than as a task of the TaskScheduler. The pass itself runs its parallel work on the scheduler.
+
+	:memberFn GenerationBatcher: constructor, takes the pass function
+	:memberFn join: adds count searches to the batch
+	:memberFn evaluate: evaluates a population together with those of the other searches and returns the
+						statistics of its columns; rethrows the exception of a failed pass
+	:memberFn leave: removes a search that has finished (or failed), running the pass of the others if they
+					 are all waiting
+
+	:hiddenVar pass: pass(thetas) returns the statistics of every column of thetas
+	:hiddenVar lock, passDone: guard the members below; waiting searches sleep on passDone
+	:hiddenVar numSearches: searches that have joined and not left
+	:hiddenVar populations: populations handed in for the next pass, in the order they arrived
+	:hiddenVar results: statistics of the populations of the last pass, in the same order
+	:hiddenVar error: the exception of the last pass, if it failed
+	:hiddenVar numPasses: number of passes run, which tells a waiting search that its pass is done
+*/
+
+class GenerationBatcher
+{
+public:
+	typedef std::function<std::vector<RunningStats>(const MatrixXd &thetas)> Pass;
+
+	explicit GenerationBatcher(Pass pass);
+	void join(size_t count);
+	std::vector<RunningStats> evaluate(const MatrixXd &thetas);
+	void leave();
+private:
+	GenerationBatcher(const GenerationBatcher &) = delete;
+	GenerationBatcher & operator=(const GenerationBatcher &) = delete;
+	void runPass(std::unique_lock<std::mutex> &guard);
+
+	Pass pass;
+	std::mutex lock;
+	std::condition_variable passDone;
+	size_t numSearches;
+	std::vector<const MatrixXd *> populations;
+	std::vector<std::vector<RunningStats>> results;
+	std::exception_ptr error;
+	uint64_t numPasses;
+};
@@ -19,21 +19,21 @@ public:	// This means that code outside of this class can see and reference the
 	// Update the state of the environment based on the provided action. We are given a random number
 	// generator to use in case we need to sample any random numbers to compute the state transition. Notice
 	// that this function is not "const", since it will change the state.
-	double update(const int & action, std::mt19937_64 & generator);
+	double update(const int & action, Philox & generator);
 
 	// Get the curretn state, as a vector object. None of these MDPs we use have noise in the observation,
 	// so we won't be using the generator here, but it's passed in case you want to add noise to the state
 	// observations.
 	// ****** IMPORTANT: The environment will return a NORMALIZED state - a vector that already has
 	// all elements in the interval [0,1] (roughly) **********
-	std::vector<double> getState(std::mt19937_64 & generator);
+	std::vector<double> getState(Philox & generator);
 
 	// A function that returns true if the current state is terminal.
 	bool inTerminalState() const;
 
 	// Tell the environment to start a new episode. The random number generator is provided so that you
 	// can sample from d_0, the initial state distribution, if the initial state is not deterministic.
-	void newEpisode(std::mt19937_64 & generator);
+	void newEpisode(Philox & generator);
 
 private:	// This means that the objects below are not visible to code outside of this class.
 	const int size = 3;	// This is the size of the gridworld - it is a 5x5 grid.
@@ -20,6 +20,17 @@ double tinv(double p, unsigned int nu);
 // Get the sample standard deviation of the vector v (an Eigen::VectorXd)
 double stddev(const VectorXd& v);
 
+// Running sample mean and sum of squared deviations from the mean (M2) of a stream of values, using
+// Welford's update. Two RunningStats of disjoint samples can be merged exactly (Chan et al.), so partial
+// statistics computed by different threads or over different parts of a data set can be combined.
+struct RunningStats
+{
+	double n = 0, mean = 0, M2 = 0;
+	void add(const double & x);
+	void merge(const RunningStats & other);
+	double stddev() const;		// Sample standard deviation, sqrt(M2 / (n - 1))
+};
+
 // Assuming v holds i.i.d. samples of a random variable, compute
 // a (1-delta)-confidence upper bound on the expected value of the random
 // variable using Student's t-test. That is:
@@ -31,17 +42,52 @@ double stddev(const VectorXd& v);
 // the points in v.
 double ttestUpperBound(const VectorXd& v, const double& delta, const int numPoints = -1);
 
+// Covariance models of CMA-ES. CMAES_FULL adapts a dense N x N covariance matrix (O(N^2) memory, O(N^3) per
+// decomposition). CMAES_SEPARABLE (sep-CMA-ES) adapts only its diagonal, and CMAES_LIMITED_MEMORY (LM-MA-ES)
+// a few evolution paths, with O(N) and O(N m) cost per sample, for policies with thousands of parameters.
+enum CMAESVariant { CMAES_FULL, CMAES_SEPARABLE, CMAES_LIMITED_MEMORY };
+
+class CMAESCheckpoint;
+
+// Returns the variant named "full", "sep" or "lm". Throws std::invalid_argument for other names.
+CMAESVariant parseCMAESVariant(const string& name);
+
 /*
 This function implements CMA-ES (http://en.wikipedia.org/wiki/CMA-ES). Return
 value is the minimizer / maximizer. This code is written for brevity, not clarity.
 See the link above for a description of what this code is doing.
+
+The solutions of a generation are evaluated in parallel, so f must be safe to call from several threads
+at once. The call for solution i of generation g (counted from 1) gets its own generator,
+generator.getStream(g, i), so the evaluations never share a generator.
+
+If checkpoint is not NULL, a search resumes from the state saved in it, if any, and saves its state to it
+periodically and when it finishes; a resumed search returns the same solution as an uninterrupted one.
 */
 VectorXd CMAES(
 	const VectorXd& initialMean,											// Starting point of the search
 	const double& initialSigma,												// Initial standard deviation of the search around initialMean
 	const unsigned int& numIterations,										// Number of iterations to run before stopping
-	// f, below, is the function to be optimized. Its first argument is the solution, the middle arguments are variables required by f (listed below), and the last is a random number generator.
-	double(*f)(const VectorXd& theta, const void* params[], mt19937_64& generator),
+	// f, below, is the function to be optimized. Its first argument is the solution (a view of a column of the population), the middle arguments are variables required by f (listed below), and the last is a random number generator.
+	double(*f)(const Ref<const VectorXd>& theta, const void* params[], Philox& generator),
 	const void* params[],													// Parrameters of f other than theta
 	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
-	mt19937_64& generator);
\ No newline at end of file
+	Philox& generator,														// The random number generator to use
+	const CMAESVariant& variant = CMAES_FULL,								// The covariance model to use
+	CMAESCheckpoint* checkpoint = NULL);									// Where to save the state of the search, or NULL (see Checkpoint.hpp)
+
+/*
+CMA-ES with a batch objective: f is called once per generation with the whole population (one solution
+per column) and returns the value of every solution, so that it can evaluate them all in one pass.
+*/
+VectorXd CMAES(
+	const VectorXd& initialMean,											// Starting point of the search
+	const double& initialSigma,												// Initial standard deviation of the search around initialMean
+	const unsigned int& numIterations,										// Number of iterations to run before stopping
+	// f, below, is the batch function to be optimized. Its first argument holds the solutions, one per column.
+	VectorXd(*f)(const MatrixXd& thetas, const void* params[], Philox& generator),
+	const void* params[],													// Parrameters of f other than thetas
+	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
+	Philox& generator,														// The random number generator to use
+	const CMAESVariant& variant = CMAES_FULL,								// The covariance model to use
+	CMAESCheckpoint* checkpoint = NULL);									// Where to save the state of the search, or NULL (see Checkpoint.hpp)
\ No newline at end of file
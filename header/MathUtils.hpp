@@ -19,6 +19,11 @@ double mean(const std::vector<double> & v);
 // Compute the sample variance of an std::vector<double>
 double var(const std::vector<double> & v);
 
+// For each of count rows of numActions logits, write the softmax probability (or its log if logProbs)
+// of the row's action to out, using the log-sum-exp trick so that large logits cannot overflow.
+// Consecutive rows start rowStride values apart.
+void softmaxSelect(const double * logits, int numActions, int rowStride, const int * actions, size_t count, double * out, bool logProbs);
+
 /*
 Floating-point modulo:
 The result (the remainder) has same sign as the divisor.
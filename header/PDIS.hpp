@@ -4,16 +4,118 @@
 #include <stdafx.h>
 
 /*		Header declaring functions used in High Confidence Off-Policy Improvement (HCOPI)
+
+		PDIS accumulates importance weights as log-weights, so weights of policies far from the behavior
+		policy neither underflow to denormals nor stall the evaluation. Once the weight of an episode and
+		every weight it could still reach over the episode's remaining steps (bounded through the behavior
+		probabilities, since an evaluation probability is at most 1) are below the weight tolerance, the
+		remaining steps are skipped. A skipped step would have changed that episode's return by less than
+		tolerance * |reward|.
 */
 
+const double PDIS_DEFAULT_WEIGHT_TOLERANCE = 1e-30;
+
+// Number of steps processed and skipped by all PDIS calls so far, counting every evaluation policy
+struct PDISStepCounts
+{
+	uint64_t evaluated;
+	uint64_t skipped;
+};
+
+// Sets the importance weight tolerance of PDIS. A tolerance of 0 disables skipping. Not thread safe:
+// call it before starting to evaluate policies.
+void
+setPDISWeightTolerance(double tolerance);
+
+double
+getPDISWeightTolerance();
+
+PDISStepCounts
+getPDISStepCounts();
+
 std::pair<double, double>
-PDIS(const std::vector<std::vector<double>> &D, const std::vector<double> e_params, Policy &E);
+PDIS(const TrajectoryStore &D, const std::vector<double> &e_params, const Policy &E);
+
+template<typename Scalar>
+std::pair<double, double>
+PDIS(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const std::vector<double> &e_params, const FnApproxSoftmax &E);
+
+std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const MatrixXd &thetas, const Policy &E);
+
+template<typename Scalar>
+std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+
+std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const MatrixXd &thetas, const Policy &E);
+
+template<typename Scalar>
+std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+
+double
+HCOPEObjective(std::pair<double, double> mean_dev, int sSize, double delta, double c);
+
+// Settings of the trials of an HCOPI run of main. A run records them with its results in output/run.txt,
+// where the safety monitor reads them back.
+struct TrialSettings
+{
+	int numTrials;							// number of trials
+	double delta;							// confidence of every trial's safety test
+	double c;								// performance every trial's safety test must show
+	double candidateFraction;				// leading fraction of the data set's episodes that is candidate data;
+											// the rest is safety data
+};
+
+const TrialSettings HCOPI_TRIAL_SETTINGS = { 100, 0.05, 8.0, 0.7 };
+
+// Data and evaluation criteria of HCOPE and HCOPEBatch, passed to them as params[0]
+struct HCOPEParams
+{
+	const TrajectoryStore *Dc;				// data to evaluate candidate solutions on
+	int sSize;								// number of episodes in the safety data
+	double delta;							// confidence of the Student's t bound
+	double c;								// the expected discounted return minimum constraint
+	const Policy *E;						// evaluation policy object
+	const FeatureCache *features;			// optional FeatureCache covering Dc, or NULL
+	const FeatureCacheF *searchFeatures;	// optional FeatureCacheF covering Dc, used instead of features, or NULL
+};
+
+double
+HCOPE(const Ref<const VectorXd> &theta, const void * params[], Philox& generator);
+
+VectorXd
+HCOPEBatch(const MatrixXd &thetas, const void * params[], Philox& generator);
+
+bool
+safetyTest(VectorXd theta, const TrajectoryStore &Ds, double delta, double c, const Policy &E, const FeatureCache *features = NULL);
 
 double
-HCOPE(const VectorXd &theta, const void * params[], mt19937_64& generator);
+safetyTestBound(const RunningStats &stats, double delta);
 
 bool
-safetyTest(VectorXd theta, std::vector<std::vector<double>> &Ds, double delta, double c, Policy &E);
+safetyTest(const RunningStats &stats, double delta, double c);
+
+std::vector<bool>
+safetyTest(const MatrixXd &thetas, const TrajectoryStore &Ds, const std::vector<double> &deltas, const std::vector<double> &cs, const Policy &E, const FeatureCache *features = NULL);
+
+VectorXd
+candidateSelection(const TrajectoryStore &Dc, int sSize, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, const FeatureCache *features = NULL, CMAESVariant variant = CMAES_FULL, const FeatureCacheF *searchFeatures = NULL, CMAESCheckpoint *checkpoint = NULL);
+
+std::pair<VectorXd, bool>
+HCOPI(const TrajectoryStore &Dc, const TrajectoryStore &Ds, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, const FeatureCache *features = NULL, CMAESVariant variant = CMAES_FULL, const FeatureCacheF *searchFeatures = NULL);
+
+// Streaming variants, for data sets larger than memory (see DataFileStream)
+std::vector<RunningStats>
+PDISStats(const DataFileStream &D, const MatrixXd &thetas, const Policy &E);
+
+std::vector<bool>
+safetyTest(const MatrixXd &thetas, const DataFileStream &Ds, const std::vector<double> &deltas, const std::vector<double> &cs, const Policy &E);
+
+// Candidate selection on data evaluated by a GenerationBatcher, e.g. a DataFileStream shared by all trials
+VectorXd
+candidateSelection(GenerationBatcher &batcher, int sSize, double delta, double c, std::vector<double> e_params, Philox &generator, CMAESVariant variant = CMAES_FULL, CMAESCheckpoint *checkpoint = NULL);
 
 std::pair<VectorXd, bool>
-HCOPI(std::vector<std::vector<double>> &Dc, std::vector<std::vector<double>> &Ds, double delta, double c, std::vector<double> e_params, Policy &E, mt19937_64 &generator);
\ No newline at end of file
+HCOPI(const DataFileStream &Dc, const DataFileStream &Ds, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, CMAESVariant variant = CMAES_FULL);
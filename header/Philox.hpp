@@ -0,0 +1,68 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for the Philox class, a counter-based random number generator (Philox4x64-10, Salmon et al.,
+		"Parallel random numbers: as easy as 1, 2, 3", SC 2011) that every sampler of the project accepts.
+
+		The n-th block of four outputs of a stream is a keyed bijection of a counter, so there is no state to
+		carry besides the key and the counter (48 bytes, against 2.5KB for a mt19937_64) and any position of
+		any stream can be reached in O(1). The key is (seed, trial) and the counter is (block, generation,
+		candidate, episode): streams with different (seed, trial, generation, candidate, episode) never
+		overlap, and each one is 2^66 outputs long. A component that needs independent randomness for every
+		generation, candidate or episode derives it with getStream instead of sharing or copying a generator,
+		so sampling can run on any number of threads and any single trial can be reproduced in isolation.
+
+		Philox satisfies the UniformRandomBitGenerator requirements and can be used with the standard
+		distributions. Conventionally the stream (generation 0, candidate 0, episode 0) of a trial belongs to
+		the trial's own search, and the streams of evaluations are numbered from generation 1.
+
+	:memberFn Philox: constructor, selects the stream of (seed, trial, generation, candidate, episode)
+	:memberFn operator(): returns the next 64 random bits
+	:memberFn discard: skips n outputs in O(1)
+	:memberFn seed: restarts the generator at the start of the stream of (seed, 0, 0, 0, 0)
+	:memberFn getStream: returns the generator of another (generation, candidate, episode) stream of the same
+						 seed and trial, starting from its beginning
+	:memberFn getPosition: number of outputs produced since the start of the stream
+	:memberFn checkKnownAnswers: checks the block function against the known-answer vectors of Philox4x64-10
+								 published with the Random123 library
+
+	:hiddenVar key: (seed, trial)
+	:hiddenVar counter: (block, generation, candidate, episode)
+	:hiddenVar output: the current block of outputs
+	:hiddenVar used: number of outputs of the current block already returned
+*/
+
+class Philox
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit Philox(uint64_t seed = 0, uint64_t trial = 0, uint64_t generation = 0, uint64_t candidate = 0,
+					uint64_t episode = 0);
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+	result_type operator()()
+	{
+		if(used == 4)
+		{
+			generateBlock();
+			counter[0]++;
+			used = 0;
+		}
+		return output[used++];
+	}
+	void discard(uint64_t n);
+	void seed(uint64_t s);
+	Philox getStream(uint64_t generation, uint64_t candidate = 0, uint64_t episode = 0) const;
+	uint64_t getPosition() const { return counter[0] * 4 - (4 - used); }
+	static bool checkKnownAnswers();
+private:
+	void generateBlock();
+
+	uint64_t key[2];
+	uint64_t counter[4];
+	uint64_t output[4];
+	int used;
+};
@@ -5,15 +5,55 @@
 
 /*		Header for the Policy abstract base class
 
+		Evaluating a policy never changes it: the probability functions are const and, like getProbsMulti,
+		may be given parameter vectors other than the policy's own. One policy object (its basis and
+		action structure) can therefore be shared by any number of threads, each evaluating its own
+		parameters through getProbsMulti or a PolicyView.
+
 	:memberFn getParameters: parameter getter
 	:memberFn setParameters: parameter setter
 	:memberFn getProb: returns the probability of a particular action in a particular state
+	:memberFn getProbs: writes the probabilities (or log-probabilities) of a block of state-action pairs
+						into a caller provided buffer. states holds count states of the MDP's state
+						dimension back to back (as in a TrajectoryStore), actions holds count actions.
+						Implementations must be safe to call from several threads at once.
+	:memberFn getProbsMulti: getProbs for numPolicies parameter vectors at once, without changing the
+							 policy's own parameters. thetas holds the parameter vectors back to back, in the
+							 layout of getParameters (e.g. the columns of an Eigen::MatrixXd), and out
+							 receives numPolicies rows of count probabilities.
 */
 
 class Policy
 {
 public:
 	virtual void setParameters(std::vector<double> params) = 0;
-	virtual std::vector<double> getParameters() = 0;
-	virtual double getProb(std::vector<double> state, int action) = 0;
+	virtual std::vector<double> getParameters() const = 0;
+	virtual double getProb(std::vector<double> state, int action) const = 0;
+	virtual void getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs = false) const = 0;
+	virtual void getProbsMulti(const double * thetas, int numPolicies, const double * states, const int * actions,
+							   size_t count, double * out, bool logProbs = false) const = 0;
+};
+
+/*		A Policy bound to a parameter vector that it does not own. Binding copies two pointers, so a view
+		can be made per candidate and per thread while the policy itself stays shared and unchanged.
+
+	:memberFn PolicyView: constructor; theta holds parameters in the layout of policy.getParameters()
+						  and must outlive the view
+	:memberFn getProbs: Policy::getProbs under the bound parameters
+
+	:hiddenVar policy: the shared policy
+	:hiddenVar theta: the bound parameters
+*/
+
+class PolicyView
+{
+public:
+	PolicyView(const Policy &policy, const double * theta) : policy(policy), theta(theta) {}
+	void getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs = false) const
+	{
+		policy.getProbsMulti(theta, 1, states, actions, count, out, logProbs);
+	}
+private:
+	const Policy &policy;
+	const double * theta;
 };
\ No newline at end of file
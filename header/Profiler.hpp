@@ -0,0 +1,94 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for the profiler, which records where an HCOPI run spends its time.
+
+		The stages of the pipeline are marked with PROFILE_SCOPE(phase), which times the enclosing scope,
+		and the work they do with PROFILE_COUNT(counter, n). Both record into per thread tables, one row per
+		trial (PROFILE_TRIAL(trial) sets the trial of the current thread; parallelFor hands it on to the
+		tasks it spawns), so enabled they cost two clock reads per scope and a thread local increment per
+		count. Phase times are inclusive (a CMA-ES generation includes its HCOPE calls) and summed over
+		threads.
+
+		Profiling is compiled in with -DHCOPI_PROFILE ("make PROFILE=1"); otherwise the macros expand to
+		nothing. When it is compiled in, a JSON report of the phases and counters of the whole run and of
+		every trial is written at exit to the file named by HCOPI_PROFILE_OUTPUT (default profile.json).
+*/
+
+enum ProfilePhase
+{
+	PROFILE_READ_DATA,				// readDataFile, mapBinaryDataFile
+	PROFILE_AUGMENT_DATA,			// augmentData
+	PROFILE_FEATURE_CACHE,			// building a FeatureCache
+	PROFILE_CANDIDATE_SELECTION,	// candidateSelection
+	PROFILE_CMAES_GENERATION,		// one generation of CMAES
+	PROFILE_HCOPE,					// HCOPE, HCOPEBatch
+	PROFILE_PDIS,					// one PDIS pass over (blocks of) a data set
+	PROFILE_SAFETY_TEST,			// safetyTest
+	NUM_PROFILE_PHASES
+};
+
+enum ProfileCounter
+{
+	PROFILE_EPISODES,				// episodes scored by PDIS, once per evaluation policy
+	PROFILE_STEPS,					// steps scored by PDIS (not skipped), once per evaluation policy
+	PROFILE_EIGEN_DECOMPOSITIONS,	// covariance eigendecompositions of CMAES
+	NUM_PROFILE_COUNTERS
+};
+
+#ifdef HCOPI_PROFILE
+
+#include <chrono>
+
+// Adds n to a counter of the current thread and trial
+void profileCount(ProfileCounter counter, uint64_t n);
+
+// Adds one call of elapsed nanoseconds to a phase of the current thread and trial
+void profileRecord(ProfilePhase phase, uint64_t nanoseconds);
+
+// The trial of the current thread, or -1 outside of trials
+int profileCurrentTrial();
+
+// Writes the JSON report of everything recorded so far
+void writeProfileReport(std::ostream &out);
+
+// Times its scope as one call of a phase
+class ProfileTimer
+{
+public:
+	explicit ProfileTimer(ProfilePhase p) : phase(p), start(std::chrono::steady_clock::now()) {}
+	~ProfileTimer()
+	{
+		profileRecord(phase, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+private:
+	ProfilePhase phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+// Sets the trial of the current thread for its scope
+class ProfileTrialScope
+{
+public:
+	explicit ProfileTrialScope(int trial);
+	~ProfileTrialScope();
+private:
+	int previous;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(phase) ProfileTimer PROFILE_JOIN(profileTimer, __LINE__)(phase)
+#define PROFILE_COUNT(counter, n) profileCount(counter, (uint64_t)(n))
+#define PROFILE_TRIAL(trial) ProfileTrialScope PROFILE_JOIN(profileTrial, __LINE__)(trial)
+
+#else
+
+#define PROFILE_SCOPE(phase)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_TRIAL(trial)
+
+#endif
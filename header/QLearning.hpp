@@ -14,13 +14,13 @@ public:
 	QLearning(const int & stateDim, const int & numActions, const double & alpha, const double & gamma, const double & epsilon, const int & iOrder, const int & dOrder);
 
 	// Train the agent based on the transition s,a,r,sPrime (with sPrimeTerminal indicating if sPrime is a terminal state, meaning we will never run the update with s = sPrime).
-	void train(std::mt19937_64 & generator, const std::vector<double> & s, const int & a, double & r, const std::vector<double> & sPrime, const bool & sPrimeTerminal);
+	void train(Philox & generator, const std::vector<double> & s, const int & a, double & r, const std::vector<double> & sPrime, const bool & sPrimeTerminal);
 
 	// Tell the agent we are starting a new episode.
-	void newEpisode(std::mt19937_64 & generator);
+	void newEpisode(Philox & generator);
 
 	// As the agent to provide an action given that we are in state s.
-	int getAction(const std::vector<double> & s, std::mt19937_64 & generator);
+	int getAction(const std::vector<double> & s, Philox & generator);
 
 private:
 	// This object, once initialized, takes in state-vectors and outputs feature vectors constructed using the Fourier Basis.
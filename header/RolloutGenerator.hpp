@@ -0,0 +1,37 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for the rollout generator, which builds HCOPI data sets by running a FnApproxSoftmax
+		behavior policy in one of the environments.
+
+		Episodes are simulated in blocks of ROLLOUT_BLOCK_EPISODES on the task scheduler, so all threads
+		are used, and episode i draws all of its randomness from the Philox stream (seed, 0, 0, 0, i): the
+		data set does not depend on the number of threads. The blocks of a chunk are formatted in parallel
+		and written in order with one large write each, either in the csv layout of readDataFile or in
+		the binary layout (with the behavior probabilities of the sampled actions, so a binary data set
+		does not need augmentData). Only one chunk of episodes is held in memory at a time. CartPole and
+		MountainCar run the episodes of a block in lockstep on the lanes of their batched versions
+		(BatchEnvironments.hpp).
+*/
+
+// Number of consecutive episodes simulated and formatted by one task
+const int ROLLOUT_BLOCK_EPISODES = 256;
+
+// Number of lanes of the batched environments (BatchEnvironments.hpp) that run the episodes of a block
+const int ROLLOUT_BATCH_LANES = 64;
+
+// Number of blocks generated before they are written out
+const int ROLLOUT_CHUNK_BLOCKS = 256;
+
+enum RolloutEnvironment { ROLLOUT_GRIDWORLD, ROLLOUT_CARTPOLE, ROLLOUT_MOUNTAINCAR };
+
+// Returns the environment named "gridworld", "cartpole" or "mountaincar". Throws std::invalid_argument
+// for other names.
+RolloutEnvironment parseRolloutEnvironment(const std::string &name);
+
+// Generates numEpisodes episodes of env and writes them to dataFile. See RolloutGenerator.cpp for a
+// description of the arguments.
+double generateRollouts(std::string dataFile, bool binary, RolloutEnvironment env, int k, std::vector<double> params,
+						size_t numEpisodes, int maxEpisodeLength, uint64_t seed);
@@ -0,0 +1,62 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		Header for the SafetyMonitor class, which keeps the safety test verdicts of deployed policies up to
+		date as new episodes of the behavior policy arrive.
+
+		For every policy the monitor keeps the running PDIS statistics (RunningStats) of all safety data
+		seen so far. New episodes are scored against all policies in one multi-policy PDIS pass and merged
+		into the statistics, so an update costs O(new episodes x policies) regardless of how much data came
+		before, and the t-test bound and verdict of every policy are available after every update.
+
+		Every update is another look at the same growing sample, and repeating a t-test of confidence delta
+		at every look would make a wrong pass at some look far more likely than delta. So delta is spent
+		over the looks: the j-th look at a policy tests at delta_j = delta * 6 / (pi^2 j^2), and as these
+		sum to delta over all looks, the probability that any verdict ever wrongly passes a policy is at
+		most delta (a union bound). The price is a stricter test at every look than a single test at delta.
+
+		A monitor is not thread safe: one thread updates it and reads its verdicts.
+
+	:memberFn SafetyMonitor: constructor, takes the evaluation policy object shared by the monitored policies
+	:memberFn addPolicy: starts monitoring a parameter vector with its own delta and c; initial holds the
+						 statistics of data it has already been tested on, if any. Returns the policy's index.
+	:memberFn update: folds new episodes (a TrajectoryStore with behavior probabilities, or a stream) into
+					  the statistics of every policy
+	:memberFn getNumPolicies: number of monitored policies
+	:memberFn getStats: the statistics of a policy
+	:memberFn getLooks: number of looks at a policy: updates with new episodes, plus one for initial statistics
+	:memberFn getLookDelta: the confidence a policy is tested at in its current look
+	:memberFn getLowerBound: the safety test's lower bound of a policy at its current look, see safetyTestBound
+	:memberFn passes: whether a policy currently passes its safety test
+
+	:hiddenVar E: the evaluation policy object
+	:hiddenVar thetas: the monitored parameter vectors, one column per policy
+	:hiddenVar deltas, cs: the safety test parameters of every policy
+	:hiddenVar stats: the statistics of every policy
+	:hiddenVar looks: the number of looks at every policy
+*/
+
+class SafetyMonitor
+{
+public:
+	SafetyMonitor(const Policy &E) : E(E) {}
+	int addPolicy(const VectorXd &theta, double delta, double c, const RunningStats &initial = RunningStats());
+	void update(const TrajectoryStore &episodes);
+	void update(const DataFileStream &episodes);
+	int getNumPolicies() const { return (int)stats.size(); }
+	const RunningStats & getStats(int policy) const { return stats[policy]; }
+	uint64_t getLooks(int policy) const { return looks[policy]; }
+	double getLookDelta(int policy) const;
+	double getLowerBound(int policy) const { return safetyTestBound(stats[policy], getLookDelta(policy)); }
+	bool passes(int policy) const { return getLowerBound(policy) >= cs[policy]; }
+private:
+	void merge(const std::vector<RunningStats> &newStats);
+
+	const Policy &E;
+	MatrixXd thetas;
+	std::vector<double> deltas, cs;
+	std::vector<RunningStats> stats;
+	std::vector<uint64_t> looks;
+};
@@ -0,0 +1,77 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+#include <mutex>
+#include <sys/types.h>
+
+/*		Header for sharded HCOPI, which spreads the data of an HCOPI run over several worker processes so
+		that a run is not limited to the memory and cores of one process (or node).
+
+		Every worker splits the data file into Dc and Ds like main does (the first 70% of the episodes are
+		candidate data) and keeps one contiguous shard of each; it only ever reads its shards. The
+		coordinator runs the CMA-ES searches and the safety tests: for every batch of candidates it sends
+		the parameters to all workers, which return the PDIS statistics (RunningStats: count, mean and sum
+		of squared deviations) of their shard, and merges the statistics in shard order, so the result does
+		not depend on the timing of the workers. The searches of all trials evaluate their generations
+		through one GenerationBatcher (see candidateSelection), so a generation of all trials is one round
+		trip to the workers.
+
+		Workers connect to the coordinator over a Unix domain socket (an address that is a path) or TCP (an
+		address of the form host:port, for workers on other nodes). Messages are fixed-size headers
+		followed by arrays of doubles in the native byte order, so all processes must run on the same
+		architecture.
+
+	:memberFn ShardCoordinator: constructor, listens on address, optionally starts local worker processes,
+								and returns once every worker has connected
+	:memberFn ~ShardCoordinator: shuts down the workers and waits for the ones it started
+	:memberFn getNumWorkers: number of workers (and shards)
+	:memberFn getM, getA, getK, getBehaviorParameters: the description of the data set, as sent by the
+													   workers
+	:memberFn getNumEpisodes: number of episodes of the candidate or safety data over all shards
+	:memberFn evaluate: PDIS statistics of every column of thetas on the candidate or safety data
+
+	:hiddenVar workerSockets: connection to the worker of every shard
+	:hiddenVar workerProcesses: the worker processes started by the coordinator
+	:hiddenVar numEpisodes: episodes of the candidate and safety data over all shards
+	:hiddenVar lock: serializes the evaluations, which use every worker (with the searches batched, only the
+					 search batch and the safety test ever contend for it)
+*/
+
+enum ShardDataSet { SHARD_CANDIDATE_DATA, SHARD_SAFETY_DATA };
+
+// Connects to the coordinator at address and serves the PDIS evaluations of shard of numShards shards of
+// dataFile until the coordinator shuts it down. See ShardedHCOPI.cpp for a description of the arguments.
+void runShardWorker(const std::string &address, int shard, int numShards, std::string dataFile, bool cacheFeatures);
+
+class ShardCoordinator
+{
+public:
+	ShardCoordinator(const std::string &address, int numWorkers,
+					 const std::vector<std::string> &spawnArgs = std::vector<std::string>());
+	~ShardCoordinator();
+	int getNumWorkers() const { return (int)workerSockets.size(); }
+	int getM() const { return m; }
+	int getA() const { return a; }
+	int getK() const { return k; }
+	const std::vector<double> & getBehaviorParameters() const { return behaviorParameters; }
+	size_t getNumEpisodes(ShardDataSet set) const { return numEpisodes[set]; }
+	std::vector<RunningStats> evaluate(ShardDataSet set, const MatrixXd &thetas);
+private:
+	ShardCoordinator(const ShardCoordinator &) = delete;
+	ShardCoordinator & operator=(const ShardCoordinator &) = delete;
+	void shutdown();
+
+	std::vector<int> workerSockets;
+	std::vector<pid_t> workerProcesses;
+	int m, a, k;
+	std::vector<double> behaviorParameters;
+	size_t numEpisodes[2];
+	std::mutex lock;
+};
+
+// safetyTest on the merged statistics of the shards, see ShardedHCOPI.cpp. The candidate selection is
+// candidateSelection on a GenerationBatcher whose pass is evaluate(SHARD_CANDIDATE_DATA, thetas).
+std::vector<bool> shardedSafetyTest(ShardCoordinator &coordinator, const MatrixXd &thetas, const std::vector<double> &deltas,
+									const std::vector<double> &cs);
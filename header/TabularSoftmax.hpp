@@ -11,8 +11,10 @@
 	:memberFn getAction: returns an action given a state
 	:memberFn getActionProb: returns a vector of action probabilities given a state
 	:memberFn getProb: returns the probability of a particular action in a particular state
+	:memberFn getProbs: writes the probabilities (or log-probabilities) of a block of state-action pairs to a buffer
+	:memberFn getProbsMulti: getProbs for several parameter vectors at once
 
-	:hiddenVar parameters: the parameters of the policy
+	:hiddenVar parameters: the parameters of the policy, a numStates x numActions row-major table
 	:hiddenVar sigma: "temperature" used in the softmax function
 	:hiddenVar numStates: number of states in the underlying MDP
 	:hiddenVar numActions: number of actions in the underlying MDP
@@ -23,13 +25,16 @@ class TabularSoftmax : public Policy
 {
 public:
 	TabularSoftmax(int numStates, int numActions, std::vector<double> params);
-	std::vector<double> getParameters();
+	std::vector<double> getParameters() const;
 	void setParameters(std::vector<double> params);
-	int getAction(std::vector<double> state, std::mt19937_64 & generator);
-	std::vector<double> getActionProb(std::vector<double> state);
-	double getProb(std::vector<double> state, int action);
+	int getAction(std::vector<double> state, Philox & generator);
+	std::vector<double> getActionProb(std::vector<double> state) const;
+	double getProb(std::vector<double> state, int action) const;
+	void getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs = false) const;
+	void getProbsMulti(const double * thetas, int numPolicies, const double * states, const int * actions,
+					   size_t count, double * out, bool logProbs = false) const;
 private:
-	std::vector<std::vector<double>> parameters;
+	std::vector<double> parameters;
 	double sigma;
 	int numStates;
 	int numActions;
@@ -0,0 +1,132 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/*		Header for the work-stealing task scheduler that runs all parallel work of the program (HCOPI
+		trials, CMA-ES candidates, PDIS episode blocks, data loading) on one fixed pool of threads.
+
+		Every thread of the pool owns a deque of tasks. A thread pushes the tasks it spawns onto the bottom
+		of its own deque and pops from the bottom, so it keeps working on the newest (most nested, cache
+		warm) work; an idle thread steals from the top of another thread's deque, taking the oldest (and
+		usually largest) piece of work. Threads outside the pool, e.g. the main thread, spawn into a shared
+		deque. A thread that waits for a TaskGroup keeps running tasks until the group is done, so nested
+		parallel loops never create new threads and never leave a thread blocked at a barrier while there
+		is work. It runs the group's own tasks first, and otherwise only tasks of groups at least as deeply
+		nested as the group (e.g. the PDIS blocks of other trials, but not a whole queued trial), so a
+		waiter is never held up by an enclosing piece of work and its stack nests at most one task per
+		level of parallelism. It sleeps while no such task is queued and the group's last tasks run on
+		other threads.
+
+		The pool has HCOPI_THREADS threads if that environment variable is set, and otherwise one thread per
+		hardware thread. Waiting threads count towards this, so a program never runs more threads than that.
+
+	:memberFn getInstance: returns the process wide scheduler, created on first use
+	:memberFn getNumThreads: number of threads running tasks, including an external waiting thread
+	:memberFn spawn: queues a task of a TaskGroup
+	:memberFn wait: runs tasks until every task of a TaskGroup has finished, then rethrows the first
+					exception thrown by one of them
+
+	:hiddenVar queues: one deque per pool thread; the last one is shared by threads outside the pool
+	:hiddenVar workers: the pool threads
+	:hiddenVar numQueued: number of tasks sitting in the deques, used to put idle threads to sleep
+	:hiddenVar numSpawned: number of tasks ever spawned, used by waiting threads to notice new tasks
+	:hiddenVar numWaiting: number of waiting threads asleep on waiterWake
+	:hiddenVar sleepLock, wake: idle pool threads sleep on wake until a task is queued
+	:hiddenVar waiterWake: waiting threads sleep on waiterWake until a task is queued or a group finishes
+	:hiddenVar stopping: set when the scheduler is destroyed at exit
+*/
+
+class TaskGroup;
+
+class TaskScheduler
+{
+public:
+	static TaskScheduler & getInstance();
+	int getNumThreads() const { return (int)workers.size() + 1; }
+	void spawn(TaskGroup &group, std::function<void()> task);
+	void wait(TaskGroup &group);
+	~TaskScheduler();
+private:
+	struct Task
+	{
+		std::function<void()> run;
+		TaskGroup * group;
+	};
+	struct TaskQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	TaskScheduler(int numThreads);
+	TaskScheduler(const TaskScheduler &) = delete;
+	TaskScheduler & operator=(const TaskScheduler &) = delete;
+	bool takeTask(int queue, const TaskGroup * group, bool nested, Task &task);
+	bool runOneTask(int queue, const TaskGroup * waitGroup = NULL);
+	void workerLoop(int queue);
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<long> numQueued;
+	std::atomic<unsigned long> numSpawned;
+	int numWaiting;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::condition_variable waiterWake;
+	std::atomic<bool> stopping;
+};
+
+/*		A set of tasks that is waited for as a whole. A group must outlive its tasks, i.e. its owner
+		calls wait() before the group goes out of scope.
+
+	:memberFn run: spawns a task into the group
+	:memberFn wait: runs tasks until every task of the group has finished
+
+	:hiddenVar outstanding: number of spawned tasks that have not finished yet
+	:hiddenVar depth: nesting level of the group: 0 outside of any task, one more than the group of the
+					  task it was created in otherwise
+	:hiddenVar errorLock, error: the first exception thrown by a task of the group
+*/
+
+class TaskGroup
+{
+public:
+	TaskGroup();
+	void run(std::function<void()> task) { TaskScheduler::getInstance().spawn(*this, std::move(task)); }
+	void wait() { TaskScheduler::getInstance().wait(*this); }
+private:
+	friend class TaskScheduler;
+	std::atomic<size_t> outstanding;
+	int depth;
+	std::mutex errorLock;
+	std::exception_ptr error;
+};
+
+/*		Calls body(i) for every i in [begin, end) as separate tasks and returns when all calls have
+		finished. Callers group their work into blocks of a useful size, as every index is one task.
+*/
+template<typename Body>
+void parallelFor(size_t begin, size_t end, const Body &body)
+{
+	TaskGroup group;
+#ifdef HCOPI_PROFILE
+	// the tasks record into the profile of the trial that spawned them, whichever thread runs them. The
+	// trial is captured by reference, as two captured words still fit std::function without an allocation.
+	const int trial = profileCurrentTrial();
+	auto profiledBody = [&body, &trial](size_t i) { PROFILE_TRIAL(trial); body(i); };
+	for(size_t i = begin; i < end; i++)
+		group.run([&profiledBody, i]() { profiledBody(i); });
+#else
+	for(size_t i = begin; i < end; i++)
+		group.run([&body, i]() { body(i); });
+#endif
+	group.wait();
+}
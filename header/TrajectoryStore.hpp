@@ -0,0 +1,102 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+/*		The columns of a TrajectoryStore when the store owns its memory (as opposed to viewing
+		a memory mapped data file). offsets[i] is the first step of episode i and offsets.back()
+		is the total number of steps.
+*/
+struct TrajectoryColumns
+{
+	std::vector<double> states;
+	std::vector<int> actions;
+	std::vector<double> rewards;
+	std::vector<double> behaviorProbs;
+	std::vector<uint64_t> offsets;
+};
+
+/*		Header for the TrajectoryStore class which holds a data set of histories as contiguous
+		per-field columns (states, actions, rewards and behavior probabilities) indexed by a table
+		of episode offsets, instead of one interleaved std::vector<double> per history.
+
+		The store only views its columns through pointers. The memory behind them is either a
+		TrajectoryColumns owned by the store or a memory mapped binary data file (see DataFile.hpp),
+		and is kept alive by a shared pointer so that subsets can share it without copying. Step
+		indices are absolute positions in those columns, so the steps of a subset run from
+		episodeBegin(0) to episodeEnd(getNumEpisodes() - 1) rather than from zero.
+
+		Stores can be moved but not copied: a copy would share the owned columns, and a step added
+		through one copy would reallocate them under the other's column pointers. Use subset to view
+		episodes of a store; subsets are read only views and do not own the columns.
+
+	:memberFn TrajectoryStore: constructors for an empty owning store, a store adopting filled
+							   columns, and a store viewing columns held by some other storage
+	:memberFn addStep: appends a (state, action, reward) step to the episode currently being recorded.
+					   Only valid for stores that own their columns.
+	:memberFn endEpisode: closes the episode currently being recorded. Only valid for stores that own
+						  their columns.
+	:memberFn subset: returns a store viewing a contiguous range of episodes without copying them
+	:memberFn getStateDim: dimensionality of the stored states
+	:memberFn getNumEpisodes: number of episodes in the store
+	:memberFn getNumSteps: total number of steps over all episodes
+	:memberFn episodeBegin: index of the first step of an episode
+	:memberFn episodeEnd: index one past the last step of an episode
+	:memberFn getState: pointer to the stateDim values of the state at a step
+	:memberFn getAction: action taken at a step
+	:memberFn getActions: pointer to the actions from a step on, for use with Policy::getProbs
+	:memberFn getReward: reward received at a step
+	:memberFn getBehaviorProb: probability of the action taken at a step under the behavior policy
+	:memberFn setBehaviorProb: behavior probability setter, used by augmentData. Only valid for stores
+							   that own their columns.
+
+	:hiddenVar stateDim: the dimensionality of states in the underlying MDP
+	:hiddenVar numEpisodes: number of episodes viewed by this store
+	:hiddenVar offsets: numEpisodes + 1 step offsets of the viewed episodes
+	:hiddenVar states: stateDim values per step, episodes stored back to back
+	:hiddenVar actions: one action per step
+	:hiddenVar rewards: one reward per step
+	:hiddenVar behaviorProbs: one behavior policy action probability per step
+	:hiddenVar columns: the owned columns, or null when the store views a mapped file or is a subset
+	:hiddenVar storage: keeps the memory behind the column pointers alive
+*/
+
+class TrajectoryStore
+{
+public:
+	TrajectoryStore(int sDim = 1);
+	TrajectoryStore(int sDim, TrajectoryColumns && cols);
+	TrajectoryStore(int sDim, size_t nEpisodes, const uint64_t * offs, const double * s, const int * acts,
+					const double * r, const double * bProbs, std::shared_ptr<const void> mem);
+	TrajectoryStore(const TrajectoryStore &) = delete;
+	TrajectoryStore & operator=(const TrajectoryStore &) = delete;
+	TrajectoryStore(TrajectoryStore &&) = default;
+	TrajectoryStore & operator=(TrajectoryStore &&) = default;
+	void addStep(const double * state, int action, double reward);
+	void endEpisode();
+	TrajectoryStore subset(size_t first, size_t last) const;
+	int getStateDim() const { return stateDim; }
+	size_t getNumEpisodes() const { return numEpisodes; }
+	size_t getNumSteps() const { return offsets[numEpisodes] - offsets[0]; }
+	size_t episodeBegin(size_t episode) const { return offsets[episode]; }
+	size_t episodeEnd(size_t episode) const { return offsets[episode + 1]; }
+	const double * getState(size_t step) const { return &states[step * stateDim]; }
+	int getAction(size_t step) const { return actions[step]; }
+	const int * getActions(size_t step) const { return &actions[step]; }
+	double getReward(size_t step) const { return rewards[step]; }
+	double getBehaviorProb(size_t step) const { return behaviorProbs[step]; }
+	void setBehaviorProb(size_t step, double prob) { ownedColumns().behaviorProbs[step] = prob; }
+private:
+	TrajectoryColumns & ownedColumns();
+	void bindColumns();
+
+	int stateDim;
+	size_t numEpisodes;
+	const uint64_t * offsets;
+	const double * states;
+	const int * actions;
+	const double * rewards;
+	const double * behaviorProbs;
+	std::shared_ptr<TrajectoryColumns> columns;
+	std::shared_ptr<const void> storage;
+};
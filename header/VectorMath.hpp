@@ -0,0 +1,54 @@
+// Author: npolosky
+#pragma once
+
+#include "stdafx.h"
+
+// Vectorized exp, cos and sin over arrays of doubles. See VectorMath.cpp for implementations.
+//
+// The kernels are compiled for SSE2, AVX2 (with FMA) and AVX-512 in the same binary, and the widest
+// one the host CPU supports is picked the first time one of the functions below is called. The choice
+// can be overridden with the environment variable HCOPI_SIMD=scalar|sse2|avx2|avx512 (it is lowered to
+// what the CPU supports). checkSimdAccuracy holds a kernel set to the error bounds below against the
+// scalar reference path (std::exp / std::cos); ./benchmark runs it on every supported set before its
+// benchmarks, so the program itself does not pay for it. Arguments outside the kernels' reduced ranges
+// (very large |x| for cos, overflow / underflow / NaN for exp) are handed to the scalar functions, and
+// the result for a given argument does not depend on its position in the array.
+
+enum SimdLevel { SIMD_SCALAR = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3 };
+
+// Error bounds of the vector kernels relative to the scalar reference path
+const double VECTOR_EXP_MAX_REL_ERROR = 1e-15;		// relative error of vecExp
+const double VECTOR_COS_MAX_ABS_ERROR = 1e-15;		// absolute error of vecCos and vecSinCos
+
+// out[i] = exp(x[i]) for i < n. x and out may be the same array.
+void vecExp(const double * x, double * out, size_t n);
+
+// out[i] = cos(x[i]) for i < n. x and out may be the same array.
+void vecCos(const double * x, double * out, size_t n);
+
+// sinOut[i] = sin(x[i]) and cosOut[i] = cos(x[i]) for i < n, from one range reduction. x may be the same
+// array as one of the outputs.
+void vecSinCos(const double * x, double * sinOut, double * cosOut, size_t n);
+
+// The scalar reference implementations of vecExp, vecCos and vecSinCos
+void vecExpScalar(const double * x, double * out, size_t n);
+void vecCosScalar(const double * x, double * out, size_t n);
+void vecSinCosScalar(const double * x, double * sinOut, double * cosOut, size_t n);
+
+// The kernel set currently used by vecExp and vecCos
+SimdLevel getSimdLevel();
+
+// The widest kernel set that the host CPU supports
+SimdLevel getSupportedSimdLevel();
+
+// Switch vecExp and vecCos to another kernel set (lowered to what the CPU supports). Not thread safe:
+// call it before starting threads that use vecExp or vecCos.
+void setSimdLevel(SimdLevel level);
+
+// Largest errors of a kernel set against the scalar reference path on the accuracy check's grid of
+// arguments (cosAbsError covers vecCos and both outputs of vecSinCos). Returns true if they are within
+// VECTOR_EXP_MAX_REL_ERROR and VECTOR_COS_MAX_ABS_ERROR.
+bool checkSimdAccuracy(SimdLevel level, double & expRelError, double & cosAbsError);
+
+// Name of a kernel set, e.g. "avx2"
+const char * simdLevelName(SimdLevel level);
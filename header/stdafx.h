@@ -10,22 +10,43 @@
 #define _USE_MATH_DEFINES 
 #include <math.h>
 #include <time.h>
+#include <atomic>
 #include <climits>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 // Tools
 #include "MathUtils.hpp"
+#include "VectorMath.hpp"
+#include "Philox.hpp"
 #include "FourierBasis.hpp"
 #include "HelperFunctions.hpp"
+#include "Checkpoint.hpp"
 #include "Policy.hpp"
-#include "PDIS.hpp"
+#include "Profiler.hpp"
+#include "TaskScheduler.hpp"
+#include "GenerationBatcher.hpp"
+#include "TrajectoryStore.hpp"
+#include "DataFile.hpp"
+#include "FeatureCache.hpp"
 #include "TabularSoftmax.hpp"
 #include "FnApproxSoftmax.hpp"
+#include "FixedFnApproxSoftmax.hpp"
+#include "PDIS.hpp"
+#include "ShardedHCOPI.hpp"
+#include "SafetyMonitor.hpp"
 
 // Environments
 #include "MountainCar.hpp"
 #include "CartPole.hpp"
 // #include "Acrobot.hpp"
 #include "Gridworld.hpp"
+#include "BatchEnvironments.hpp"
+
+// Data set generation
+#include "RolloutGenerator.hpp"
 
 // Agents
 #include "QLearning.hpp"
@@ -0,0 +1,467 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cstring>
+
+using namespace std;
+
+// See BatchEnvironments.hpp for descriptions of the classes.
+
+// The lane loops are written twice: as scalar loops, which follow CartPole and MountainCar exactly, and as
+// vector kernels with GCC vector extensions, instantiated for SSE2, AVX2 and AVX-512 as in VectorMath.cpp.
+// update picks the kernels of the vecExp / vecCos kernel set in use (getSimdLevel), so HCOPI_SIMD=scalar
+// selects the scalar loops. Lanes in a terminal state compute their update like the others and keep their
+// old values through a select.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define KERNEL static inline __attribute__((always_inline))
+
+// 1.5 * 2^52, for rounding doubles of magnitude below 2^51 to integers
+const double FLOOR_MAGIC = 6755399441055744.0;
+
+// Parameters of the CartPole dynamics used by the lane loops
+struct CartPoleConstants
+{
+	double uMax, l, g, m, mc, muc, mup, subDt;
+};
+
+// wrapPosNegPI, inlined: Mod(theta + pi, 2 pi) - pi with the same boundary cases
+static inline double wrapAngle(double theta)
+{
+	const double y = 2.0 * M_PI;
+	double x = theta + M_PI;
+	double r = x - y * std::floor(x / y);
+	if(r >= y)
+		r = 0;
+	else if(r < 0)
+		r = (y + r == y ? 0 : y + r);
+	return r - M_PI;
+}
+
+static inline double boundValue(double x, double minValue, double maxValue)
+{
+	return min(maxValue, max(minValue, x));
+}
+
+// One Euler substep of CartPole::update in every lane not in a terminal state
+static void cartPoleSubstepScalar(const CartPoleConstants &k, const int * actions, const unsigned char * terminal,
+								  const double * sinTheta, const double * cosTheta, double * x, double * v, double * theta,
+								  double * omega, double * t, size_t n)
+{
+	const double uMax = k.uMax, l = k.l, g = k.g, m = k.m, mc = k.mc, muc = k.muc, mup = k.mup, subDt = k.subDt;
+	for(size_t i = 0; i < n; i++)
+	{
+		if(terminal[i])
+			continue;
+		double F = actions[i]*uMax + (actions[i] - 1)*uMax, s = sinTheta[i], c = cosTheta[i];
+		double signV = (double)((v[i] > 0) - (v[i] < 0));
+		double omegaDot = (g*s + c*(muc*signV - F - m*l*omega[i]*omega[i]*s) / (m + mc) - mup*omega[i] / (m*l)) / (l*(4.0 / 3.0 - m / (m + mc)*c*c));
+		double vDot = (F + m*l*(omega[i]*omega[i]*s - omegaDot*c) - muc*signV) / (m + mc);
+		theta[i] += subDt*omega[i];
+		omega[i] += subDt*omegaDot;
+		x[i] += subDt*v[i];
+		v[i] += subDt*vDot;
+		theta[i] = wrapAngle(theta[i]);
+		t[i] += subDt;
+	}
+}
+
+// The velocity and position update of MountainCar::update in every lane not in a terminal state
+static void mountainCarStepScalar(const int * actions, const unsigned char * terminal, const double * cos3x, double * x,
+								  double * xDot, size_t n, double minX, double maxX, double minXDot, double maxXDot)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		if(terminal[i])
+			continue;
+		double u = (double)actions[i] - 1.0;
+		xDot[i] = boundValue(xDot[i] + 0.001*u - 0.0025*cos3x[i], minXDot, maxXDot);
+		x[i] += xDot[i];
+		if(x[i] < minX)
+		{
+			x[i] = minX;
+			xDot[i] = 0;
+		}
+		if(x[i] > maxX)
+			x[i] = maxX;
+	}
+}
+
+// Loads w <= W values into a vector, padding with zeros
+template<typename VD, int W>
+KERNEL VD loadLanes(const double * p, size_t w)
+{
+	VD v = VD{} * 0.0;
+	if(w == W)
+		memcpy(&v, p, sizeof(VD));
+	else
+		memcpy(&v, p, w * sizeof(double));
+	return v;
+}
+
+template<typename VD, int W>
+KERNEL void storeLanes(double * p, VD v, size_t w)
+{
+	if(w == W)
+		memcpy(p, &v, sizeof(VD));
+	else
+		memcpy(p, &v, w * sizeof(double));
+}
+
+// wrapAngle on W lanes; floor by rounding with FLOOR_MAGIC, exact for the small quotients of bounded angles
+template<typename VD>
+KERNEL VD wrapAngleLanes(VD theta)
+{
+	VD zero = theta * 0.0, y = zero + 2.0 * M_PI;
+	VD x = theta + M_PI;
+	VD q = x / y;
+	VD f = (q + FLOOR_MAGIC) - FLOOR_MAGIC;
+	f = (f > q) ? f - 1.0 : f;
+	VD r = x - y * f;
+	r = (r >= y) ? zero : r;
+	r = (r < zero) ? ((y + r == y) ? zero : y + r) : r;
+	return r - M_PI;
+}
+
+// cartPoleSubstepScalar, W lanes at a time
+template<typename VD, int W>
+KERNEL void cartPoleSubstepLanes(const CartPoleConstants &k, const int * actions, const unsigned char * terminal,
+								 const double * sinTheta, const double * cosTheta, double * x, double * v, double * theta,
+								 double * omega, double * t, size_t n)
+{
+	const double uMax = k.uMax, l = k.l, g = k.g, m = k.m, mc = k.mc, muc = k.muc, mup = k.mup, subDt = k.subDt;
+	for(size_t i = 0; i < n; i += W)
+	{
+		size_t w = min((size_t)W, n - i);
+		VD zero = VD{} * 0.0, one = zero + 1.0, F = zero, frozen = zero;
+		for(int j = 0; j < W; j++)
+			if((size_t)j < w)
+			{
+				F[j] = actions[i + j]*uMax + (actions[i + j] - 1)*uMax;
+				frozen[j] = terminal[i + j];
+			}
+		VD s = loadLanes<VD, W>(sinTheta + i, w), c = loadLanes<VD, W>(cosTheta + i, w);
+		VD xi = loadLanes<VD, W>(x + i, w), vi = loadLanes<VD, W>(v + i, w), thetai = loadLanes<VD, W>(theta + i, w);
+		VD omegai = loadLanes<VD, W>(omega + i, w), ti = loadLanes<VD, W>(t + i, w);
+		VD signV = ((vi > zero) ? one : zero) - ((vi < zero) ? one : zero);
+		VD omegaDot = (g*s + c*(muc*signV - F - m*l*omegai*omegai*s) / (m + mc) - mup*omegai / (m*l)) / (l*(4.0 / 3.0 - m / (m + mc)*c*c));
+		VD vDot = (F + m*l*(omegai*omegai*s - omegaDot*c) - muc*signV) / (m + mc);
+		VD newTheta = wrapAngleLanes<VD>(thetai + subDt*omegai);
+		VD newOmega = omegai + subDt*omegaDot;
+		VD newX = xi + subDt*vi;
+		VD newV = vi + subDt*vDot;
+		VD newT = ti + subDt;
+		storeLanes<VD, W>(theta + i, (frozen != zero) ? thetai : newTheta, w);
+		storeLanes<VD, W>(omega + i, (frozen != zero) ? omegai : newOmega, w);
+		storeLanes<VD, W>(x + i, (frozen != zero) ? xi : newX, w);
+		storeLanes<VD, W>(v + i, (frozen != zero) ? vi : newV, w);
+		storeLanes<VD, W>(t + i, (frozen != zero) ? ti : newT, w);
+	}
+}
+
+// mountainCarStepScalar, W lanes at a time
+template<typename VD, int W>
+KERNEL void mountainCarStepLanes(const int * actions, const unsigned char * terminal, const double * cos3x, double * x,
+								 double * xDot, size_t n, double minX, double maxX, double minXDot, double maxXDot)
+{
+	for(size_t i = 0; i < n; i += W)
+	{
+		size_t w = min((size_t)W, n - i);
+		VD zero = VD{} * 0.0, u = zero, frozen = zero;
+		for(int j = 0; j < W; j++)
+			if((size_t)j < w)
+			{
+				u[j] = (double)actions[i + j] - 1.0;
+				frozen[j] = terminal[i + j];
+			}
+		VD xi = loadLanes<VD, W>(x + i, w), xDoti = loadLanes<VD, W>(xDot + i, w), c = loadLanes<VD, W>(cos3x + i, w);
+		// boundValue as min(max, max(min, .)) with std::min / std::max's comparisons
+		VD newXDot = xDoti + 0.001*u - 0.0025*c;
+		newXDot = (minXDot < newXDot) ? newXDot : zero + minXDot;
+		newXDot = (newXDot < maxXDot) ? newXDot : zero + maxXDot;
+		VD newX = xi + newXDot;
+		newXDot = (newX < minX) ? zero : newXDot;
+		newX = (newX < minX) ? zero + minX : newX;
+		newX = (newX > maxX) ? zero + maxX : newX;
+		storeLanes<VD, W>(x + i, (frozen != zero) ? xi : newX, w);
+		storeLanes<VD, W>(xDot + i, (frozen != zero) ? xDoti : newXDot, w);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HCOPI_X86_KERNELS
+
+typedef double vd2 __attribute__((vector_size(16)));
+typedef double vd4 __attribute__((vector_size(32)));
+typedef double vd8 __attribute__((vector_size(64)));
+
+#define CARTPOLE_SUBSTEP_ARGS const CartPoleConstants &k, const int * actions, const unsigned char * terminal, \
+	const double * sinTheta, const double * cosTheta, double * x, double * v, double * theta, double * omega, double * t, size_t n
+#define MOUNTAINCAR_STEP_ARGS const int * actions, const unsigned char * terminal, const double * cos3x, double * x, \
+	double * xDot, size_t n, double minX, double maxX, double minXDot, double maxXDot
+
+__attribute__((target("sse2")))
+static void cartPoleSubstepSSE2(CARTPOLE_SUBSTEP_ARGS) {
+	cartPoleSubstepLanes<vd2, 2>(k, actions, terminal, sinTheta, cosTheta, x, v, theta, omega, t, n);
+}
+
+__attribute__((target("avx2")))
+static void cartPoleSubstepAVX2(CARTPOLE_SUBSTEP_ARGS) {
+	cartPoleSubstepLanes<vd4, 4>(k, actions, terminal, sinTheta, cosTheta, x, v, theta, omega, t, n);
+}
+
+__attribute__((target("avx512f")))
+static void cartPoleSubstepAVX512(CARTPOLE_SUBSTEP_ARGS) {
+	cartPoleSubstepLanes<vd8, 8>(k, actions, terminal, sinTheta, cosTheta, x, v, theta, omega, t, n);
+}
+
+__attribute__((target("sse2")))
+static void mountainCarStepSSE2(MOUNTAINCAR_STEP_ARGS) {
+	mountainCarStepLanes<vd2, 2>(actions, terminal, cos3x, x, xDot, n, minX, maxX, minXDot, maxXDot);
+}
+
+__attribute__((target("avx2")))
+static void mountainCarStepAVX2(MOUNTAINCAR_STEP_ARGS) {
+	mountainCarStepLanes<vd4, 4>(actions, terminal, cos3x, x, xDot, n, minX, maxX, minXDot, maxXDot);
+}
+
+__attribute__((target("avx512f")))
+static void mountainCarStepAVX512(MOUNTAINCAR_STEP_ARGS) {
+	mountainCarStepLanes<vd8, 8>(actions, terminal, cos3x, x, xDot, n, minX, maxX, minXDot, maxXDot);
+}
+#endif
+
+/*		CartPoleBatch
+*/
+CartPoleBatch::CartPoleBatch(size_t numEnvironments)
+	: x(numEnvironments), v(numEnvironments), theta(numEnvironments), omega(numEnvironments), t(numEnvironments),
+	  sinTheta(numEnvironments), cosTheta(numEnvironments), terminal(numEnvironments)
+{
+	newEpisodes();
+}
+
+size_t CartPoleBatch::getNumEnvironments() const
+{
+	return x.size();
+}
+
+int CartPoleBatch::getStateDim() const
+{
+	return 4;
+}
+
+int CartPoleBatch::getNumActions() const
+{
+	return 2;
+}
+
+/*		Applies actions[i] in every lane i that is not in a terminal state: the 10 Euler substeps of
+		CartPole::update, each starting with the sines and cosines of all lanes from vecSinCos and then
+		updating all lanes with the lane kernels of the SIMD level in use.
+
+	:param actions: one action per lane; ignored for lanes in a terminal state
+	:param rewards: receives one reward per lane, 1 for the lanes that moved and 0 for the others
+*/
+void CartPoleBatch::update(const int * actions, double * rewards)
+{
+	size_t n = x.size();
+	CartPoleConstants k = { uMax, l, g, m, mc, muc, mup, dt / (double)simSteps };
+	SimdLevel level = getSimdLevel();
+	for(int step = 0; step < simSteps; step++)
+	{
+		vecSinCos(theta.data(), sinTheta.data(), cosTheta.data(), n);
+		const double * s = sinTheta.data(), * c = cosTheta.data();
+#ifdef HCOPI_X86_KERNELS
+		if(level == SIMD_AVX512)
+			cartPoleSubstepAVX512(k, actions, terminal.data(), s, c, x.data(), v.data(), theta.data(), omega.data(), t.data(), n);
+		else if(level == SIMD_AVX2)
+			cartPoleSubstepAVX2(k, actions, terminal.data(), s, c, x.data(), v.data(), theta.data(), omega.data(), t.data(), n);
+		else if(level == SIMD_SSE2)
+			cartPoleSubstepSSE2(k, actions, terminal.data(), s, c, x.data(), v.data(), theta.data(), omega.data(), t.data(), n);
+		else
+#endif
+			cartPoleSubstepScalar(k, actions, terminal.data(), s, c, x.data(), v.data(), theta.data(), omega.data(), t.data(), n);
+	}
+	// bounding is a no-op for the frozen lanes, which were bounded by their last update
+	for(size_t i = 0; i < n; i++)
+	{
+		x[i] = boundValue(x[i], xMin, xMax);
+		v[i] = boundValue(v[i], vMin, vMax);
+		theta[i] = boundValue(theta[i], thetaMin, thetaMax);
+		omega[i] = boundValue(omega[i], omegaMin, omegaMax);
+		rewards[i] = (terminal[i] ? 0.0 : 1.0);
+	}
+	updateTerminal();
+}
+
+/*		Writes the states of all lanes as CartPole::getState does, lane after lane
+
+	:param out: buffer of getNumEnvironments() * 4 values
+*/
+void CartPoleBatch::getStates(double * out) const
+{
+	for(size_t i = 0; i < x.size(); i++)
+	{
+		out[4 * i] = (x[i] - xMin) / (xMax - xMin);
+		out[4 * i + 1] = (v[i] - vMin) / (vMax - vMin);
+		out[4 * i + 2] = (theta[i] - thetaMin) / (thetaMax - thetaMin);
+		out[4 * i + 3] = (omega[i] - omegaMin) / (omegaMax - omegaMin);
+	}
+}
+
+bool CartPoleBatch::inTerminalState(size_t lane) const
+{
+	return terminal[lane] != 0;
+}
+
+const std::vector<unsigned char> & CartPoleBatch::getTerminalMask() const
+{
+	return terminal;
+}
+
+size_t CartPoleBatch::getNumActive() const
+{
+	return terminal.size() - std::count(terminal.begin(), terminal.end(), 1);
+}
+
+void CartPoleBatch::newEpisode(size_t lane)
+{
+	theta[lane] = omega[lane] = v[lane] = x[lane] = t[lane] = 0;
+	terminal[lane] = 0;
+}
+
+void CartPoleBatch::newEpisodes()
+{
+	for(size_t i = 0; i < x.size(); i++)
+		newEpisode(i);
+}
+
+size_t CartPoleBatch::resetTerminal()
+{
+	size_t count = 0;
+	for(size_t i = 0; i < x.size(); i++)
+		if(terminal[i])
+		{
+			newEpisode(i);
+			count++;
+		}
+	return count;
+}
+
+// The terminal condition of CartPole::inTerminalState for every lane
+void CartPoleBatch::updateTerminal()
+{
+	for(size_t i = 0; i < x.size(); i++)
+		terminal[i] = (unsigned char)((fabs(theta[i]) > M_PI / 15.0) || (fabs(x[i]) >= 2.4) || (t[i] >= 20.0 + 10 * dt));
+}
+
+/*		MountainCarBatch
+*/
+MountainCarBatch::MountainCarBatch(size_t numEnvironments)
+	: x(numEnvironments), xDot(numEnvironments), cos3x(numEnvironments), terminal(numEnvironments)
+{
+	newEpisodes();
+}
+
+size_t MountainCarBatch::getNumEnvironments() const
+{
+	return x.size();
+}
+
+int MountainCarBatch::getStateDim() const
+{
+	return 2;
+}
+
+int MountainCarBatch::getNumActions() const
+{
+	return 3;
+}
+
+/*		Applies actions[i] in every lane i that is not in a terminal state, as MountainCar::update does,
+		with the cosines of all lanes from one vecCos call and the lane kernels of the SIMD level in use.
+
+	:param actions: one action per lane; ignored for lanes in a terminal state
+	:param rewards: receives one reward per lane, -1 for the lanes that moved and 0 for the others
+*/
+void MountainCarBatch::update(const int * actions, double * rewards)
+{
+	size_t n = x.size();
+	for(size_t i = 0; i < n; i++)
+		cos3x[i] = 3.0*x[i];
+	vecCos(cos3x.data(), cos3x.data(), n);
+	SimdLevel level = getSimdLevel();
+#ifdef HCOPI_X86_KERNELS
+	if(level == SIMD_AVX512)
+		mountainCarStepAVX512(actions, terminal.data(), cos3x.data(), x.data(), xDot.data(), n, minX, maxX, minXDot, maxXDot);
+	else if(level == SIMD_AVX2)
+		mountainCarStepAVX2(actions, terminal.data(), cos3x.data(), x.data(), xDot.data(), n, minX, maxX, minXDot, maxXDot);
+	else if(level == SIMD_SSE2)
+		mountainCarStepSSE2(actions, terminal.data(), cos3x.data(), x.data(), xDot.data(), n, minX, maxX, minXDot, maxXDot);
+	else
+#endif
+		mountainCarStepScalar(actions, terminal.data(), cos3x.data(), x.data(), xDot.data(), n, minX, maxX, minXDot, maxXDot);
+	for(size_t i = 0; i < n; i++)
+		rewards[i] = (terminal[i] ? 0.0 : -1.0);
+	updateTerminal();
+}
+
+/*		Writes the states of all lanes as MountainCar::getState does, lane after lane
+
+	:param out: buffer of getNumEnvironments() * 2 values
+*/
+void MountainCarBatch::getStates(double * out) const
+{
+	for(size_t i = 0; i < x.size(); i++)
+	{
+		out[2 * i] = (x[i] - minX) / (maxX - minX);
+		out[2 * i + 1] = (xDot[i] - minXDot) / (maxXDot - minXDot);
+	}
+}
+
+bool MountainCarBatch::inTerminalState(size_t lane) const
+{
+	return terminal[lane] != 0;
+}
+
+const std::vector<unsigned char> & MountainCarBatch::getTerminalMask() const
+{
+	return terminal;
+}
+
+size_t MountainCarBatch::getNumActive() const
+{
+	return terminal.size() - std::count(terminal.begin(), terminal.end(), 1);
+}
+
+void MountainCarBatch::newEpisode(size_t lane)
+{
+	x[lane] = -0.5;
+	xDot[lane] = 0;
+	terminal[lane] = 0;
+}
+
+void MountainCarBatch::newEpisodes()
+{
+	for(size_t i = 0; i < x.size(); i++)
+		newEpisode(i);
+}
+
+size_t MountainCarBatch::resetTerminal()
+{
+	size_t count = 0;
+	for(size_t i = 0; i < x.size(); i++)
+		if(terminal[i])
+		{
+			newEpisode(i);
+			count++;
+		}
+	return count;
+}
+
+// The terminal condition of MountainCar::inTerminalState for every lane
+void MountainCarBatch::updateTerminal()
+{
+	for(size_t i = 0; i < x.size(); i++)
+		terminal[i] = (unsigned char)(x[i] >= maxX);
+}
@@ -3,7 +3,7 @@
 using namespace std;
 
 CartPole::CartPole() {
-	mt19937_64 generator(0);
+	Philox generator(0);
 	newEpisode(generator);
 }
 
@@ -15,7 +15,7 @@ int CartPole::getNumActions() const {
 	return 2;
 }
 
-double CartPole::update(const int & action, mt19937_64 & generator) {
+double CartPole::update(const int & action, Philox & generator) {
 	double F = action*uMax + (action - 1)*uMax, omegaDot, vDot, subDt = dt / (double)simSteps;
 	for (int i = 0; i < simSteps; i++) {
 		omegaDot = (g*sin(theta) + cos(theta)*(muc*sign(v) - F - m*l*omega*omega*sin(theta)) / (m + mc) - mup*omega / (m*l)) / (l*(4.0 / 3.0 - m / (m + mc)*cos(theta)*cos(theta)));
@@ -34,7 +34,7 @@ double CartPole::update(const int & action, mt19937_64 & generator) {
 	return 1;
 }
 
-vector<double> CartPole::getState(mt19937_64 & generator) {
+vector<double> CartPole::getState(Philox & generator) {
 	vector<double> result(4);
 	result[0] = normalize(x, xMin, xMax);
 	result[1] = normalize(v, vMin, vMax);
@@ -47,6 +47,6 @@ bool CartPole::inTerminalState() const {
 	return ((fabs(theta) > M_PI / 15.0) || (fabs(x) >= 2.4) || (t >= 20.0 + 10 * dt));
 }
 
-void CartPole::newEpisode(mt19937_64 & generator) {
+void CartPole::newEpisode(Philox & generator) {
 	theta = omega = v = x = t = 0;
 }
\ No newline at end of file
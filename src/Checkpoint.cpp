@@ -0,0 +1,218 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// See Checkpoint.hpp for a description of the file format.
+
+template<typename M>
+static void writeArray(ofstream &out, const M &array)
+{
+	uint64_t shape[2] = {(uint64_t)array.rows(), (uint64_t)array.cols()};
+	out.write((const char *)shape, sizeof(shape));
+	out.write((const char *)array.data(), array.size() * sizeof(double));
+}
+
+template<typename M>
+static void readArray(ifstream &in, M &array, const std::string &fileName)
+{
+	uint64_t shape[2];
+	if(!in.read((char *)shape, sizeof(shape)))
+		throw runtime_error(fileName + " is truncated");
+	// Every array of a state has at most N * N entries, N < 2^32
+	if(shape[0] > UINT32_MAX || shape[1] > UINT32_MAX)
+		throw runtime_error(fileName + " is not a valid checkpoint");
+	array.resize(shape[0], shape[1]);
+	if(!in.read((char *)array.data(), array.size() * sizeof(double)))
+		throw runtime_error(fileName + " is truncated");
+}
+
+/*		Flushes a file or directory to disk, so its contents (or, for a directory, its entries) survive a
+		crash of the host
+
+	:param path: the file or directory
+*/
+static void syncToDisk(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		throw runtime_error("Could not open " + path + " to sync it: " + strerror(errno));
+	int result = fsync(fd);
+	int error = errno;
+	close(fd);
+	if(result != 0)
+		throw runtime_error("Could not sync " + path + ": " + strerror(error));
+}
+
+CMAESCheckpoint::CMAESCheckpoint(std::string fileName, double interval) :
+	fileName(fileName), interval(interval), lastSave(std::chrono::steady_clock::now())
+{
+}
+
+/*		Reads the checkpoint file
+
+	:param state: receives the state of the search
+
+	Returns false, leaving state untouched, if the file does not exist. Throws std::runtime_error if it
+	exists but is not a checkpoint of this version.
+*/
+bool CMAESCheckpoint::load(CMAESState &state) const
+{
+	ifstream in(fileName, std::ios::binary);
+	if(!in)
+		return false;
+	CheckpointHeader &header = state.header;
+	if(!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+		throw runtime_error(fileName + " is not a checkpoint");
+	if(header.version != CHECKPOINT_VERSION)
+		throw runtime_error(fileName + " has checkpoint version " + to_string(header.version) + ", expected " +
+							to_string(CHECKPOINT_VERSION));
+	readArray(in, state.xmean, fileName);
+	readArray(in, state.ps, fileName);
+	readArray(in, state.pc, fileName);
+	readArray(in, state.D, fileName);
+	readArray(in, state.C, fileName);
+	readArray(in, state.B, fileName);
+	readArray(in, state.paths, fileName);
+	readArray(in, state.best, fileName);
+	if(header.normalStateSize > 1024)
+		throw runtime_error(fileName + " is not a valid checkpoint");
+	state.normalState.resize(header.normalStateSize);
+	if(!in.read(&state.normalState[0], header.normalStateSize))
+		throw runtime_error(fileName + " is truncated");
+	return true;
+}
+
+bool CMAESCheckpoint::due(bool finished) const
+{
+	return finished || std::chrono::duration<double>(std::chrono::steady_clock::now() - lastSave).count() >= interval;
+}
+
+/*		Writes a state to the checkpoint file, replacing the previous one only once it is complete
+
+	:param state: the state of the search; magic, version and normalStateSize of its header are filled in here
+*/
+void CMAESCheckpoint::save(const CMAESState &state)
+{
+	CheckpointHeader header = state.header;
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.normalStateSize = state.normalState.size();
+
+	std::string tempName = fileName + ".tmp";
+	{
+		ofstream out(tempName, std::ios::binary | std::ios::trunc);
+		if(!out)
+			throw runtime_error("Could not open " + tempName + " for writing");
+		out.write((const char *)&header, sizeof(header));
+		writeArray(out, state.xmean);
+		writeArray(out, state.ps);
+		writeArray(out, state.pc);
+		writeArray(out, state.D);
+		writeArray(out, state.C);
+		writeArray(out, state.B);
+		writeArray(out, state.paths);
+		writeArray(out, state.best);
+		out.write(state.normalState.data(), state.normalState.size());
+		out.close();
+		if(!out)
+			throw runtime_error("Could not write " + tempName);
+	}
+	// the data must be on disk before the rename replaces the previous checkpoint, and the rename itself
+	// is only durable once the directory is
+	syncToDisk(tempName);
+	if(rename(tempName.c_str(), fileName.c_str()) != 0)
+		throw runtime_error("Could not rename " + tempName + " to " + fileName + ": " + strerror(errno));
+	size_t slash = fileName.find_last_of('/');
+	syncToDisk(slash == std::string::npos ? "." : (slash == 0 ? "/" : fileName.substr(0, slash)));
+	lastSave = std::chrono::steady_clock::now();
+}
+
+/*		The "key value" lines of a run file that record the settings of the run
+
+	:param settings: the settings of the run
+*/
+static std::vector<std::pair<std::string, std::string>> runSettingLines(const CheckpointRunSettings &settings)
+{
+	// the size of a data file that is not on this host (a sharded run's workers may have it) is -1
+	struct stat dataStat;
+	long long dataFileSize = stat(settings.dataFile.c_str(), &dataStat) == 0 ? (long long)dataStat.st_size : -1;
+	ostringstream tolerance;
+	tolerance << settings.weightTolerance;
+
+	std::vector<std::pair<std::string, std::string>> lines;
+	lines.push_back(make_pair("dataFile", settings.dataFile));
+	lines.push_back(make_pair("dataFileSize", to_string(dataFileSize)));
+	lines.push_back(make_pair("floatSearch", to_string((int)settings.floatSearch)));
+	lines.push_back(make_pair("stream", to_string((int)settings.stream)));
+	lines.push_back(make_pair("featureCache", to_string((int)settings.cacheFeatures)));
+	lines.push_back(make_pair("weightTolerance", tolerance.str()));
+	lines.push_back(make_pair("workers", to_string(settings.numWorkers)));
+	return lines;
+}
+
+/*		Opens the checkpoint directory of a run
+
+	:param directory: the directory holding the checkpoints of the run
+	:param resume: if true, the run checkpointed in directory is continued, and seed and variant are
+				   set to the ones it was started with; settings must be those it was started with.
+				   Otherwise a new run is started: directory is created if needed, must not hold a run
+				   already, and seed, variant and settings are recorded in it.
+	:param seed: the seed of the run
+	:param variant: the CMA-ES variant of the run
+	:param settings: the other settings of the run
+*/
+void openCheckpointRun(const std::string &directory, bool resume, uint64_t &seed, CMAESVariant &variant,
+					   const CheckpointRunSettings &settings)
+{
+	std::string runFile = directory + "/run";
+	std::vector<std::pair<std::string, std::string>> lines = runSettingLines(settings);
+	ifstream in(runFile);
+	if(resume)
+	{
+		std::string key, variantName;
+		if(!in)
+			throw runtime_error("There is no checkpointed run to resume in " + directory);
+		if(!(in >> key >> seed) || key != "seed" || !(in >> key >> variantName) || key != "variant")
+			throw runtime_error(runFile + " is not a valid run file");
+		variant = parseCMAESVariant(variantName);
+		for(const std::pair<std::string, std::string> &line : lines)
+		{
+			std::string value;
+			if(!(in >> key) || key != line.first || !getline(in >> ws, value))
+				throw runtime_error(runFile + " does not record the " + line.first + " of the run");
+			if(value != line.second)
+				throw runtime_error("The run checkpointed in " + directory + " was started with " + line.first + " "
+									+ value + ", not " + line.second + "; resume it with the settings it was started with");
+		}
+		return;
+	}
+	if(in)
+		throw runtime_error(directory + " already holds a checkpointed run; continue it with --resume " + directory);
+	if(mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+		throw runtime_error("Could not create " + directory + ": " + strerror(errno));
+	static const char * variantNames[] = {"full", "sep", "lm"};
+	ofstream out(runFile);
+	out << "seed " << seed << endl;
+	out << "variant " << variantNames[variant] << endl;
+	for(const std::pair<std::string, std::string> &line : lines)
+		out << line.first << " " << line.second << endl;
+	out.close();
+	if(!out)
+		throw runtime_error("Could not write " + runFile);
+	syncToDisk(runFile);
+	syncToDisk(directory);
+}
+
+std::string trialCheckpointFile(const std::string &directory, size_t trial)
+{
+	return directory + "/trial" + to_string(trial) + ".ckpt";
+}
@@ -0,0 +1,894 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Rounds a byte offset up to the next section boundary
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + 63) & ~(uint64_t)63;
+}
+
+/*		Maps a whole file read only and shared
+
+	:param fileName: name of the file to map
+	:param length: set to the length of the file in bytes
+
+	Returns the mapping, which is unmapped once the last copy of the pointer is gone. An empty
+	file gives a null mapping.
+*/
+static std::shared_ptr<const void> mapReadOnly(std::string fileName, size_t &length)
+{
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0)
+		throw runtime_error("Could not open " + fileName);
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw runtime_error("Could not stat " + fileName);
+	}
+	length = (size_t)st.st_size;
+	if(length == 0)
+	{
+		close(fd);
+		return std::shared_ptr<const void>();
+	}
+	void * base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		throw runtime_error("Could not map " + fileName);
+	return std::shared_ptr<const void>(base, [length](const void * p) { munmap(const_cast<void *>(p), length); });
+}
+
+// Skips the whitespace that std::stod and std::stoi would skip around a csv field
+static const char * skipBlanks(const char * p, const char * end)
+{
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+// Returns a pointer to the end of the line starting at p, i.e. to its newline or to end
+static const char * lineEnd(const char * p, const char * end)
+{
+	const char * newline = (const char *)memchr(p, '\n', end - p);
+	return newline ? newline : end;
+}
+
+/*		Parses one comma separated line of doubles, calling store(value) for every field in order.
+		Like splitting the line with getline(ss, substr, ',') and calling stod on every piece, a
+		trailing comma does not produce an extra field.
+*/
+template<typename Store>
+static void parseFields(const char * p, const char * end, Store store)
+{
+	p = skipBlanks(p, end);
+	while(p < end)
+	{
+		if(*p == '+')
+			p++;
+		double value;
+		std::from_chars_result r = std::from_chars(p, end, value);
+		if(r.ec != std::errc())
+			throw runtime_error("Could not parse csv field \"" + std::string(p, lineEnd(p, end)) + "\"");
+		store(value);
+		p = skipBlanks(r.ptr, end);
+		if(p < end && *p++ != ',')
+			throw runtime_error("Expected ',' in csv line");
+		p = skipBlanks(p, end);
+	}
+}
+
+// Counts the fields parseFields would find on a line without parsing them
+static size_t countFields(const char * begin, const char * end)
+{
+	while(end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		end--;
+	begin = skipBlanks(begin, end);
+	if(begin == end)
+		return 0;
+	return std::count(begin, end, ',') + (end[-1] == ',' ? 0 : 1);
+}
+
+// Parses a line holding a single integer, as std::stoi would
+static int parseIntLine(const char * p, const char * end)
+{
+	p = skipBlanks(p, end);
+	if(p < end && *p == '+')
+		p++;
+	int value = 0;
+	if(std::from_chars(p, end, value).ec != std::errc())
+		throw runtime_error("Could not parse csv header line");
+	return value;
+}
+
+/*		Function used to parse a csv data file. The histories are parsed in parallel: the part of the
+		file holding them is split into byte ranges on line boundaries, a first pass over the ranges
+		counts the steps of every history, and a second pass parses every range with std::from_chars
+		straight into its place in the preallocated columns, so the histories end up in file order.
+
+	:param datafile: name of the datafile to read from
+	:param m: number of state features
+	:param a: number of discrete actions
+	:param k: order of the FourierBasis used by the behavior policy
+	:param params: parameters of the behavior policy
+	:param n: number of episodes of data
+	:param p_test: a vector of aciton probabilities corresponding to the first history
+				   in the dataset used for testing policy parameterization
+
+	Returns the data set.
+*/
+TrajectoryStore readDataFile(std::string dataFile, int &m, int &a, int &k, std::vector<double> &params,
+							 int &n, std::vector<double> &p_test)
+{
+	PROFILE_SCOPE(PROFILE_READ_DATA);
+	size_t length;
+	std::shared_ptr<const void> mapping = mapReadOnly(dataFile, length);
+	const char * p = (const char *)mapping.get();
+	const char * end = p + length;
+
+	// The five header lines
+	const char * lines[5];
+	for(int i = 0; i < 5; i++)
+	{
+		if(p >= end)
+			throw runtime_error(dataFile + " is missing header lines");
+		lines[i] = p;
+		p = std::min(end, lineEnd(p, end) + 1);
+	}
+	m = parseIntLine(lines[0], lineEnd(lines[0], end));
+	a = parseIntLine(lines[1], lineEnd(lines[1], end));
+	k = parseIntLine(lines[2], lineEnd(lines[2], end));
+	parseFields(lines[3], lineEnd(lines[3], end), [&params](double v) { params.push_back(v); });
+	n = parseIntLine(lines[4], lineEnd(lines[4], end));
+
+	// The last line holds p_test. As with getline, a final newline does not start another line.
+	const char * bodyEnd = end;
+	if(bodyEnd > p && bodyEnd[-1] == '\n')
+		bodyEnd--;
+	const char * lastLine = bodyEnd;
+	while(lastLine > p && lastLine[-1] != '\n')
+		lastLine--;
+	parseFields(lastLine, bodyEnd, [&p_test](double v) { p_test.push_back(v); });
+	bodyEnd = lastLine;
+
+	// Split the histories into byte ranges that start and end on line boundaries
+	const char * body = p;
+	size_t bodyLength = bodyEnd - body;
+	int numChunks = std::max(1, std::min(TaskScheduler::getInstance().getNumThreads() * 4, (int)(bodyLength >> 20) + 1));
+	std::vector<const char *> chunkBegin(numChunks + 1);
+	chunkBegin[0] = body;
+	for(int c = 1; c < numChunks; c++)
+	{
+		const char * q = std::max(chunkBegin[c - 1], body + bodyLength * c / numChunks);
+		chunkBegin[c] = (q == body ? q : std::min(bodyEnd, lineEnd(q - 1, bodyEnd) + 1));
+	}
+	chunkBegin[numChunks] = bodyEnd;
+
+	// First pass: count the steps of every history in every chunk
+	int stride = m + 2;
+	std::vector<std::vector<uint64_t>> chunkSteps(numChunks);
+	parallelFor(0, numChunks, [&](size_t c)
+	{
+		for(const char * q = chunkBegin[c]; q < chunkBegin[c + 1];)
+		{
+			const char * e = lineEnd(q, chunkBegin[c + 1]);
+			chunkSteps[c].push_back(countFields(q, e) / stride);
+			q = e + 1;
+		}
+	});
+
+	// Lay out the columns and the episode offsets in file order
+	TrajectoryColumns columns;
+	std::vector<size_t> chunkFirstEpisode(numChunks + 1, 0);
+	for(int c = 0; c < numChunks; c++)
+		chunkFirstEpisode[c + 1] = chunkFirstEpisode[c] + chunkSteps[c].size();
+	columns.offsets.resize(chunkFirstEpisode[numChunks] + 1);
+	columns.offsets[0] = 0;
+	for(int c = 0; c < numChunks; c++)
+		for(size_t i = 0; i < chunkSteps[c].size(); i++)
+			columns.offsets[chunkFirstEpisode[c] + i + 1] = columns.offsets[chunkFirstEpisode[c] + i] + chunkSteps[c][i];
+	size_t numSteps = columns.offsets.back();
+	columns.states.resize(numSteps * m);
+	columns.actions.resize(numSteps);
+	columns.rewards.resize(numSteps);
+	columns.behaviorProbs.assign(numSteps, 1.0);
+
+	// Second pass: parse every chunk into its place in the columns
+	parallelFor(0, numChunks, [&](size_t c)
+	{
+		size_t episode = chunkFirstEpisode[c];
+		for(const char * q = chunkBegin[c]; q < chunkBegin[c + 1]; episode++)
+		{
+			const char * e = lineEnd(q, chunkBegin[c + 1]);
+			// each history is a flat list of (state, action, reward) steps with m state features;
+			// fields past the last complete step are ignored
+			size_t t = columns.offsets[episode], stepEnd = columns.offsets[episode + 1];
+			int field = 0;
+			parseFields(q, e, [&](double v)
+			{
+				if(t >= stepEnd)
+					return;
+				if(field < m)
+					columns.states[t * m + field] = v;
+				else if(field == m)
+					columns.actions[t] = (int)v;
+				else
+					columns.rewards[t] = v;
+				if(++field == stride)
+				{
+					field = 0;
+					t++;
+				}
+			});
+			q = e + 1;
+		}
+	});
+
+	return TrajectoryStore(m, std::move(columns));
+}
+
+/*		Checks whether a data file is in the binary format rather than the csv format
+
+	:param dataFile: name of the data file
+*/
+bool isBinaryDataFile(std::string dataFile)
+{
+	ifstream in(dataFile, std::ios::binary);
+	char magic[8];
+	if(!in.read(magic, sizeof(magic)))
+		return false;
+	return memcmp(magic, DATA_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+/*		Fills in a DataFileHeader, laying the sections out one after the other
+*/
+static DataFileHeader makeHeader(int m, int a, int k, int n, uint64_t numParams, uint64_t numTestProbs,
+								 uint64_t numEpisodes, uint64_t numSteps)
+{
+	DataFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DATA_FILE_MAGIC, sizeof(header.magic));
+	header.version = DATA_FILE_VERSION;
+	header.headerSize = sizeof(DataFileHeader);
+	header.m = m;
+	header.a = a;
+	header.k = k;
+	header.n = n;
+	header.numParams = numParams;
+	header.numTestProbs = numTestProbs;
+	header.numEpisodes = numEpisodes;
+	header.numSteps = numSteps;
+	header.paramsOffset = alignSection(sizeof(DataFileHeader));
+	header.testProbsOffset = alignSection(header.paramsOffset + header.numParams * sizeof(double));
+	header.offsetsOffset = alignSection(header.testProbsOffset + header.numTestProbs * sizeof(double));
+	header.statesOffset = alignSection(header.offsetsOffset + (header.numEpisodes + 1) * sizeof(uint64_t));
+	header.actionsOffset = alignSection(header.statesOffset + header.numSteps * m * sizeof(double));
+	header.rewardsOffset = alignSection(header.actionsOffset + header.numSteps * sizeof(int32_t));
+	header.behaviorProbsOffset = alignSection(header.rewardsOffset + header.numSteps * sizeof(double));
+	header.fileSize = header.behaviorProbsOffset + header.numSteps * sizeof(double);
+	return header;
+}
+
+/*		Writes a data set to a binary data file
+
+	:param dataFile: name of the file to write
+	:param D: the data set, with behavior probabilities already computed by augmentData
+	:param m: number of state features
+	:param a: number of discrete actions
+	:param k: order of the FourierBasis used by the behavior policy
+	:param params: parameters of the behavior policy
+	:param n: number of episodes declared by the source data file
+	:param p_test: action probabilities of the first history, used for testing the policy parameterization
+*/
+void writeBinaryDataFile(std::string dataFile, const TrajectoryStore &D, int m, int a, int k,
+						 const std::vector<double> &params, int n, const std::vector<double> &p_test)
+{
+	DataFileHeader header = makeHeader(m, a, k, n, params.size(), p_test.size(), D.getNumEpisodes(), D.getNumSteps());
+
+	ofstream out(dataFile, std::ios::binary | std::ios::trunc);
+	if(!out)
+		throw runtime_error("Could not open " + dataFile + " for writing");
+	uint64_t position = 0;
+	auto writeSection = [&](uint64_t offset, const void * data, uint64_t bytes)
+	{
+		static const char padding[64] = {0};
+		out.write(padding, offset - position);
+		out.write((const char *)data, bytes);
+		position = offset + bytes;
+	};
+
+	// The steps of D start at episodeBegin(0), so offsets are rebased to start at zero in the file
+	size_t firstStep = D.episodeBegin(0);
+	std::vector<uint64_t> offsets(D.getNumEpisodes() + 1);
+	for(size_t i = 0; i <= D.getNumEpisodes(); i++)
+		offsets[i] = (i < D.getNumEpisodes() ? D.episodeBegin(i) : D.episodeEnd(i - 1)) - firstStep;
+	std::vector<int32_t> actions(D.getNumSteps());
+	std::vector<double> rewards(D.getNumSteps()), behaviorProbs(D.getNumSteps());
+	for(size_t t = 0; t < D.getNumSteps(); t++)
+	{
+		actions[t] = D.getAction(firstStep + t);
+		rewards[t] = D.getReward(firstStep + t);
+		behaviorProbs[t] = D.getBehaviorProb(firstStep + t);
+	}
+
+	writeSection(0, &header, sizeof(header));
+	writeSection(header.paramsOffset, params.data(), header.numParams * sizeof(double));
+	writeSection(header.testProbsOffset, p_test.data(), header.numTestProbs * sizeof(double));
+	writeSection(header.offsetsOffset, offsets.data(), offsets.size() * sizeof(uint64_t));
+	writeSection(header.statesOffset, D.getState(firstStep), header.numSteps * m * sizeof(double));
+	writeSection(header.actionsOffset, actions.data(), header.numSteps * sizeof(int32_t));
+	writeSection(header.rewardsOffset, rewards.data(), header.numSteps * sizeof(double));
+	writeSection(header.behaviorProbsOffset, behaviorProbs.data(), header.numSteps * sizeof(double));
+	out.close();
+	if(!out)
+		throw runtime_error("Failed writing " + dataFile);
+}
+
+/*		Constructor for the BinaryDataFileWriter class
+
+	:param dataFile: name of the file to write
+	:param m: number of state features
+	:param a: number of discrete actions
+	:param k: order of the FourierBasis used by the behavior policy
+	:param params: parameters of the behavior policy
+*/
+BinaryDataFileWriter::BinaryDataFileWriter(std::string dataFile, int m, int a, int k, const std::vector<double> &params)
+	: dataFile(dataFile), m(m), a(a), k(k), params(params), offsets(1, 0)
+{
+	for(int c = 0; c < 4; c++)
+	{
+		columns[c].open(columnFile(c), std::ios::binary | std::ios::trunc);
+		if(!columns[c])
+			throw runtime_error("Could not open " + columnFile(c) + " for writing");
+	}
+}
+
+std::string BinaryDataFileWriter::columnFile(int column) const
+{
+	return dataFile + ".column" + to_string(column);
+}
+
+void BinaryDataFileWriter::append(const TrajectoryColumns &block)
+{
+	size_t numSteps = block.offsets.back();
+	std::vector<int32_t> actions(block.actions.begin(), block.actions.end());
+	columns[0].write((const char *)block.states.data(), numSteps * m * sizeof(double));
+	columns[1].write((const char *)actions.data(), numSteps * sizeof(int32_t));
+	columns[2].write((const char *)block.rewards.data(), numSteps * sizeof(double));
+	columns[3].write((const char *)block.behaviorProbs.data(), numSteps * sizeof(double));
+	uint64_t base = offsets.back();
+	for(size_t i = 1; i < block.offsets.size(); i++)
+		offsets.push_back(base + block.offsets[i]);
+}
+
+void BinaryDataFileWriter::finish(const std::vector<double> &p_test)
+{
+	uint64_t numEpisodes = offsets.size() - 1;
+	DataFileHeader header = makeHeader(m, a, k, (int)numEpisodes, params.size(), p_test.size(), numEpisodes, offsets.back());
+	ofstream out(dataFile, std::ios::binary | std::ios::trunc);
+	if(!out)
+		throw runtime_error("Could not open " + dataFile + " for writing");
+	uint64_t position = 0;
+	auto pad = [&](uint64_t offset)
+	{
+		static const char padding[64] = {0};
+		out.write(padding, offset - position);
+		position = offset;
+	};
+	auto writeSection = [&](uint64_t offset, const void * data, uint64_t bytes)
+	{
+		pad(offset);
+		out.write((const char *)data, bytes);
+		position = offset + bytes;
+	};
+	writeSection(0, &header, sizeof(header));
+	writeSection(header.paramsOffset, params.data(), header.numParams * sizeof(double));
+	writeSection(header.testProbsOffset, p_test.data(), header.numTestProbs * sizeof(double));
+	writeSection(header.offsetsOffset, offsets.data(), offsets.size() * sizeof(uint64_t));
+
+	const uint64_t sectionOffsets[4] = {header.statesOffset, header.actionsOffset, header.rewardsOffset, header.behaviorProbsOffset};
+	std::vector<char> buffer(1 << 23);
+	for(int c = 0; c < 4; c++)
+	{
+		columns[c].close();
+		ifstream in(columnFile(c), std::ios::binary);
+		pad(sectionOffsets[c]);
+		while(in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+		{
+			out.write(buffer.data(), in.gcount());
+			position += in.gcount();
+		}
+		in.close();
+		remove(columnFile(c).c_str());
+	}
+	out.close();
+	if(!out || position != header.fileSize)
+		throw runtime_error("Failed writing " + dataFile);
+}
+
+// Throws unless count elements of elementSize bytes starting at offset, aligned to alignment, lie within
+// the first fileSize bytes of the file
+static void checkSection(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t alignment, uint64_t fileSize,
+						 const std::string &dataFile)
+{
+	if(offset % alignment != 0 || offset > fileSize || count > (fileSize - offset) / elementSize)
+		throw runtime_error(dataFile + " is corrupt: a section lies outside the file");
+}
+
+// Throws if header is not the header of a binary data file of length bytes that this code can read
+static void checkHeader(const DataFileHeader &header, size_t length, const std::string &dataFile)
+{
+	if(memcmp(header.magic, DATA_FILE_MAGIC, sizeof(header.magic)) != 0)
+		throw runtime_error(dataFile + " is not a binary data file");
+	if(header.version != DATA_FILE_VERSION || header.headerSize != sizeof(DataFileHeader))
+		throw runtime_error(dataFile + " has unsupported binary data file version " + to_string(header.version));
+	if(header.fileSize != length)
+		throw runtime_error(dataFile + " is truncated");
+	if(header.m < 1 || header.a < 1 || header.k < 0 || header.numEpisodes >= header.fileSize)
+		throw runtime_error(dataFile + " is corrupt: invalid header values");
+	checkSection(header.paramsOffset, header.numParams, sizeof(double), sizeof(double), header.fileSize, dataFile);
+	checkSection(header.testProbsOffset, header.numTestProbs, sizeof(double), sizeof(double), header.fileSize, dataFile);
+	checkSection(header.offsetsOffset, header.numEpisodes + 1, sizeof(uint64_t), sizeof(uint64_t), header.fileSize, dataFile);
+	checkSection(header.statesOffset, header.numSteps, header.m * sizeof(double), sizeof(double), header.fileSize, dataFile);
+	checkSection(header.actionsOffset, header.numSteps, sizeof(int32_t), sizeof(int32_t), header.fileSize, dataFile);
+	checkSection(header.rewardsOffset, header.numSteps, sizeof(double), sizeof(double), header.fileSize, dataFile);
+	checkSection(header.behaviorProbsOffset, header.numSteps, sizeof(double), sizeof(double), header.fileSize, dataFile);
+}
+
+// Throws unless the count episode offsets are non-decreasing and at most numSteps, so that every episode
+// they delimit lies within the step columns
+static void checkOffsets(const uint64_t * offsets, size_t count, uint64_t numSteps, const std::string &dataFile)
+{
+	for(size_t i = 0; i < count; i++)
+		if(offsets[i] > numSteps || (i > 0 && offsets[i] < offsets[i - 1]))
+			throw runtime_error(dataFile + " is corrupt: invalid episode offsets");
+}
+
+/*		Memory maps a binary data file. Nothing is parsed or copied except the small header values, and
+		only the episode offsets (8 bytes per episode) are read, to check that every episode lies within
+		the file, so startup cost barely grows with the size of the data set.
+
+	:param dataFile: name of the binary data file
+	:param m: number of state features
+	:param a: number of discrete actions
+	:param k: order of the FourierBasis used by the behavior policy
+	:param params: parameters of the behavior policy
+	:param n: number of episodes declared by the source data file
+	:param p_test: a vector of action probabilities corresponding to the first history
+				   in the dataset used for testing policy parameterization
+
+	Returns a store viewing the mapped data set, with behavior probabilities already filled in.
+*/
+TrajectoryStore mapBinaryDataFile(std::string dataFile, int &m, int &a, int &k, std::vector<double> &params,
+								  int &n, std::vector<double> &p_test)
+{
+	PROFILE_SCOPE(PROFILE_READ_DATA);
+	size_t length;
+	std::shared_ptr<const void> mapping = mapReadOnly(dataFile, length);
+	if(length < sizeof(DataFileHeader))
+		throw runtime_error(dataFile + " is too small to be a binary data file");
+
+	const char * bytes = (const char *)mapping.get();
+	const DataFileHeader * header = (const DataFileHeader *)bytes;
+	checkHeader(*header, length, dataFile);
+
+	m = header->m;
+	a = header->a;
+	k = header->k;
+	n = header->n;
+	const uint64_t * offsets = (const uint64_t *)(bytes + header->offsetsOffset);
+	checkOffsets(offsets, header->numEpisodes + 1, header->numSteps, dataFile);
+	const double * paramsBegin = (const double *)(bytes + header->paramsOffset);
+	params.assign(paramsBegin, paramsBegin + header->numParams);
+	const double * testBegin = (const double *)(bytes + header->testProbsOffset);
+	p_test.assign(testBegin, testBegin + header->numTestProbs);
+
+	return TrajectoryStore(m, header->numEpisodes,
+						   offsets,
+						   (const double *)(bytes + header->statesOffset),
+						   (const int *)(bytes + header->actionsOffset),
+						   (const double *)(bytes + header->rewardsOffset),
+						   (const double *)(bytes + header->behaviorProbsOffset),
+						   mapping);
+}
+
+// Reads bytes bytes at offset of a file, throwing if the file ends first
+static void readAt(int fd, void * data, size_t bytes, uint64_t offset, const std::string &fileName)
+{
+	char * p = (char *)data;
+	while(bytes > 0)
+	{
+		ssize_t n = pread(fd, p, bytes, (off_t)offset);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			throw runtime_error("Could not read " + fileName);
+		p += n;
+		bytes -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+}
+
+/*		Parses one history line of a csv data file and appends it to columns as an episode, one at a time
+		where readDataFile parses all histories at once. columns.offsets must hold at least the initial 0;
+		the behavior probabilities are left to the caller.
+*/
+static void appendHistory(TrajectoryColumns &columns, int m, const char * begin, const char * end)
+{
+	int stride = m + 2;
+	size_t t = columns.offsets.back(), stepEnd = t + countFields(begin, end) / stride;
+	columns.states.resize(stepEnd * m);
+	columns.actions.resize(stepEnd);
+	columns.rewards.resize(stepEnd);
+	// fields past the last complete step are ignored, as in readDataFile
+	int field = 0;
+	parseFields(begin, end, [&](double v)
+	{
+		if(t >= stepEnd)
+			return;
+		if(field < m)
+			columns.states[t * m + field] = v;
+		else if(field == m)
+			columns.actions[t] = (int)v;
+		else
+			columns.rewards[t] = v;
+		if(++field == stride)
+		{
+			field = 0;
+			t++;
+		}
+	});
+	columns.offsets.push_back(stepEnd);
+}
+
+/*		Constructor for the DataFileStream class
+
+	:param dataFile: name of a csv or binary data file
+	:param chunkEpisodes: number of episodes per chunk; a pass holds two chunks in memory
+*/
+DataFileStream::DataFileStream(std::string dataFile, size_t chunkEpisodes)
+	: dataFile(dataFile), binary(isBinaryDataFile(dataFile)), m(0), a(0), k(0), firstEpisode(0), lastEpisode(0),
+	  chunkEpisodes(std::max((size_t)1, chunkEpisodes))
+{
+	memset(&header, 0, sizeof(header));
+	if(binary)
+	{
+		int fd = open(dataFile.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw runtime_error("Could not open " + dataFile);
+		struct stat st;
+		try
+		{
+			if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DataFileHeader))
+				throw runtime_error(dataFile + " is too small to be a binary data file");
+			readAt(fd, &header, sizeof(header), 0, dataFile);
+			checkHeader(header, (size_t)st.st_size, dataFile);
+			params.resize(header.numParams);
+			readAt(fd, params.data(), params.size() * sizeof(double), header.paramsOffset, dataFile);
+		}
+		catch(...)
+		{
+			close(fd);
+			throw;
+		}
+		close(fd);
+		m = header.m;
+		a = header.a;
+		k = header.k;
+		lastEpisode = header.numEpisodes;
+		return;
+	}
+
+	ifstream in(dataFile, std::ios::binary);
+	if(!in)
+		throw runtime_error("Could not open " + dataFile);
+	std::string lines[5];
+	for(int i = 0; i < 5; i++)
+		if(!getline(in, lines[i]))
+			throw runtime_error(dataFile + " is missing header lines");
+	m = parseIntLine(lines[0].data(), lines[0].data() + lines[0].size());
+	a = parseIntLine(lines[1].data(), lines[1].data() + lines[1].size());
+	k = parseIntLine(lines[2].data(), lines[2].data() + lines[2].size());
+	parseFields(lines[3].data(), lines[3].data() + lines[3].size(), [this](double v) { params.push_back(v); });
+
+	// Every line of the body is a history except the last one, which holds p_test. As with getline, a
+	// final newline does not start another line.
+	uint64_t bufferStart = (uint64_t)in.tellg(), lineNumber = 0;
+	bool lineOpen = false;
+	lineIndex.push_back(bufferStart);
+	std::vector<char> buffer(1 << 23);
+	while(in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+	{
+		size_t count = (size_t)in.gcount();
+		const char * end = buffer.data() + count;
+		for(const char * q = buffer.data(); (q = (const char *)memchr(q, '\n', end - q)) != NULL;)
+		{
+			q++;
+			if(++lineNumber % this->chunkEpisodes == 0)
+				lineIndex.push_back(bufferStart + (q - buffer.data()));
+		}
+		lineOpen = (end[-1] != '\n');
+		bufferStart += count;
+	}
+	uint64_t numLines = lineNumber + (lineOpen ? 1 : 0);
+	if(numLines == 0)
+		throw runtime_error(dataFile + " is missing its p_test line");
+	lastEpisode = numLines - 1;
+	lineIndex.resize((lastEpisode + this->chunkEpisodes - 1) / this->chunkEpisodes);
+}
+
+/*		Views a contiguous range of episodes of the stream
+
+	:param first: index of the first episode to view
+	:param last: index one past the last episode to view
+
+	Returns a stream of episodes [first, last) of this stream.
+*/
+DataFileStream DataFileStream::subset(size_t first, size_t last) const
+{
+	if(first > last || last > getNumEpisodes())
+		throw invalid_argument("DataFileStream::subset: episode range out of bounds");
+	DataFileStream result = *this;
+	result.firstEpisode = firstEpisode + first;
+	result.lastEpisode = firstEpisode + last;
+	return result;
+}
+
+/*		Reads episodes [first, last) of a binary data file into a store that owns its columns
+*/
+TrajectoryStore DataFileStream::readBinaryChunk(int fd, size_t first, size_t last) const
+{
+	PROFILE_SCOPE(PROFILE_READ_DATA);
+	TrajectoryColumns columns;
+	columns.offsets.resize(last - first + 1);
+	readAt(fd, columns.offsets.data(), columns.offsets.size() * sizeof(uint64_t), header.offsetsOffset + first * sizeof(uint64_t), dataFile);
+	checkOffsets(columns.offsets.data(), columns.offsets.size(), header.numSteps, dataFile);
+	uint64_t firstStep = columns.offsets[0], numSteps = columns.offsets.back() - firstStep;
+	for(auto &offset : columns.offsets)
+		offset -= firstStep;
+	columns.states.resize(numSteps * m);
+	columns.actions.resize(numSteps);
+	columns.rewards.resize(numSteps);
+	columns.behaviorProbs.resize(numSteps);
+	static_assert(sizeof(int) == sizeof(int32_t), "actions are stored as int32_t");
+	readAt(fd, columns.states.data(), numSteps * m * sizeof(double), header.statesOffset + firstStep * m * sizeof(double), dataFile);
+	readAt(fd, columns.actions.data(), numSteps * sizeof(int32_t), header.actionsOffset + firstStep * sizeof(int32_t), dataFile);
+	readAt(fd, columns.rewards.data(), numSteps * sizeof(double), header.rewardsOffset + firstStep * sizeof(double), dataFile);
+	readAt(fd, columns.behaviorProbs.data(), numSteps * sizeof(double), header.behaviorProbsOffset + firstStep * sizeof(double), dataFile);
+	return TrajectoryStore(m, std::move(columns));
+}
+
+/*		Parses the next numEpisodes history lines of a csv data file and computes their behavior
+		probabilities with B
+*/
+TrajectoryStore DataFileStream::readCsvChunk(std::istream &in, size_t numEpisodes, const Policy &B) const
+{
+	TrajectoryColumns columns;
+	{
+		PROFILE_SCOPE(PROFILE_READ_DATA);
+		columns.offsets.reserve(numEpisodes + 1);
+		columns.offsets.push_back(0);
+		std::string line;
+		for(size_t i = 0; i < numEpisodes; i++)
+		{
+			if(!getline(in, line))
+				throw runtime_error(dataFile + " ended before its last history");
+			appendHistory(columns, m, line.data(), line.data() + line.size());
+		}
+		columns.behaviorProbs.assign(columns.offsets.back(), 1.0);
+	}
+	TrajectoryStore chunk(m, std::move(columns));
+	if(chunk.getNumEpisodes() > 0)
+		augmentData(chunk, params, B);
+	return chunk;
+}
+
+/*		Reads the episodes of the stream in order, one chunk at a time, and calls visit on every chunk.
+		The next chunk is read by a task of the scheduler while visit processes the current one. Several
+		passes may run at once, e.g. from different threads: every pass opens the file on its own.
+
+	:param visit: called with every chunk in order; the chunk is only valid during the call
+*/
+void DataFileStream::forEachChunk(const std::function<void(const TrajectoryStore &)> &visit) const
+{
+	int fd = -1;
+	ifstream in;
+	std::unique_ptr<FnApproxSoftmax> behavior;
+	if(binary)
+	{
+		fd = open(dataFile.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw runtime_error("Could not open " + dataFile);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	else
+	{
+		in.open(dataFile, std::ios::binary);
+		if(!in)
+			throw runtime_error("Could not open " + dataFile);
+		// seek to the indexed history before the stream's first one, then skip to it
+		if(firstEpisode < lastEpisode)
+		{
+			in.seekg((std::streamoff)lineIndex[firstEpisode / chunkEpisodes]);
+			std::string line;
+			for(size_t i = 0; i < firstEpisode % chunkEpisodes; i++)
+				getline(in, line);
+		}
+		behavior.reset(new FnApproxSoftmax(m, a, 1, k, params));
+	}
+	auto readChunk = [&](size_t first, size_t last)
+	{
+		return binary ? readBinaryChunk(fd, first, last) : readCsvChunk(in, last - first, *behavior);
+	};
+
+	try
+	{
+		TrajectoryStore current, upcoming;
+		if(firstEpisode < lastEpisode)
+			current = readChunk(firstEpisode, std::min(lastEpisode, firstEpisode + chunkEpisodes));
+		for(size_t begin = firstEpisode; begin < lastEpisode;)
+		{
+			size_t next = std::min(lastEpisode, begin + chunkEpisodes);
+			TaskGroup prefetch;
+			if(next < lastEpisode)
+				prefetch.run([&]() { upcoming = readChunk(next, std::min(lastEpisode, next + chunkEpisodes)); });
+			try
+			{
+				visit(current);
+			}
+			catch(...)
+			{
+				prefetch.wait();
+				throw;
+			}
+			prefetch.wait();
+			current = std::move(upcoming);
+			begin = next;
+		}
+	}
+	catch(...)
+	{
+		if(fd >= 0)
+			close(fd);
+		throw;
+	}
+	if(fd >= 0)
+		close(fd);
+}
+
+/*		Reads the episodes of the stream a chunk at a time (so a csv file is only parsed and augmented for
+		the stream's episodes) and copies them into one store that owns its columns
+
+	Returns a store of all episodes of the stream, with step indices starting at 0
+*/
+TrajectoryStore DataFileStream::read() const
+{
+	TrajectoryColumns columns;
+	columns.offsets.push_back(0);
+	forEachChunk([&](const TrajectoryStore &chunk)
+	{
+		size_t numSteps = chunk.getNumSteps(), base = columns.actions.size();
+		for(size_t t = 0; t < numSteps; t++)
+		{
+			columns.states.insert(columns.states.end(), chunk.getState(t), chunk.getState(t) + m);
+			columns.actions.push_back(chunk.getAction(t));
+			columns.rewards.push_back(chunk.getReward(t));
+			columns.behaviorProbs.push_back(chunk.getBehaviorProb(t));
+		}
+		for(size_t i = 0; i < chunk.getNumEpisodes(); i++)
+			columns.offsets.push_back(base + chunk.episodeEnd(i));
+	});
+	return TrajectoryStore(m, std::move(columns));
+}
+
+/*		Constructor for the EpisodeLogReader class
+
+	:param logFile: name of the episode log; it does not need to exist yet
+	:param m: number of state features
+	:param params: parameters of the behavior policy that generates the logged episodes
+	:param B: behavior policy object; its own parameters are not used or changed
+*/
+EpisodeLogReader::EpisodeLogReader(std::string logFile, int m, const std::vector<double> &params, const Policy &B)
+	: logFile(logFile), m(m), params(params), B(B), position(0)
+{
+}
+
+/*		Reads the histories appended to the log since the last call. A line is only read once its newline
+		has been written, so a history that is still being appended is left for the next call. A log that
+		is shorter than what was already read has been replaced, and is read from its start.
+
+	Returns the new histories, with their behavior probabilities computed.
+*/
+TrajectoryStore EpisodeLogReader::readNew()
+{
+	TrajectoryColumns columns;
+	columns.offsets.push_back(0);
+	ifstream in(logFile, std::ios::binary);
+	if(in)
+	{
+		in.seekg(0, std::ios::end);
+		uint64_t length = (uint64_t)in.tellg();
+		if(length < position)
+			position = 0;
+		std::vector<char> buffer(length - position);
+		in.seekg((std::streamoff)position);
+		in.read(buffer.data(), buffer.size());
+		buffer.resize((size_t)in.gcount());
+
+		const char * p = buffer.data(), * end = p + buffer.size();
+		while(p < end)
+		{
+			const char * newline = (const char *)memchr(p, '\n', end - p);
+			if(!newline)
+				break;
+			// blank lines (e.g. a log that starts with a newline) are not episodes
+			if(countFields(p, newline) > 0)
+				appendHistory(columns, m, p, newline);
+			p = newline + 1;
+		}
+		position += p - buffer.data();
+	}
+	columns.behaviorProbs.assign(columns.offsets.back(), 1.0);
+	TrajectoryStore episodes(m, std::move(columns));
+	if(episodes.getNumEpisodes() > 0)
+		augmentData(episodes, params, B);
+	return episodes;
+}
+
+/* Function to compute behavior policy probabilities and store them in the dataset
+
+	:param D: data set of histories; the behavior probability of every step is filled in
+	:param params: behavior policy parameters
+	:param B: behavior policy object; its own parameters are not used or changed
+
+	Returns the expected discounted return of the behavior policy
+*/
+double augmentData(TrajectoryStore &D, std::vector<double> params, const Policy &B)
+{
+	PROFILE_SCOPE(PROFILE_AUGMENT_DATA);
+	PolicyView behavior(B, params.data());
+	std::vector<double> returns(D.getNumEpisodes(), 0.0);
+	// The probabilities of blocks of consecutive episodes are computed with one batched call
+	const int blockEpisodes = 256;
+	int numBlocks = ((int)D.getNumEpisodes() + blockEpisodes - 1) / blockEpisodes;
+	parallelFor(0, numBlocks, [&](size_t b)
+	{
+		size_t first = b * blockEpisodes, last = std::min(D.getNumEpisodes(), first + blockEpisodes);
+		size_t begin = D.episodeBegin(first), end = D.episodeEnd(last - 1);
+		std::vector<double> probs(end - begin);
+		behavior.getProbs(D.getState(begin), D.getActions(begin), end - begin, probs.data());
+		for(size_t i = first; i < last; i++)
+		{
+			for(size_t t = D.episodeBegin(i); t < D.episodeEnd(i); t++)
+			{
+				returns[i] += D.getReward(t);
+				D.setBehaviorProb(t, probs[t - begin]);
+			}
+		}
+	});
+	return mean(returns);
+}
+
+/*		Computes the average undiscounted return of the histories in a data set
+
+	:param D: data set of histories
+*/
+double averageReturn(const TrajectoryStore &D)
+{
+	std::vector<double> returns(D.getNumEpisodes(), 0.0);
+	for(size_t i = 0; i < D.getNumEpisodes(); i++)
+		for(size_t t = D.episodeBegin(i); t < D.episodeEnd(i); t++)
+			returns[i] += D.getReward(t);
+	return mean(returns);
+}
@@ -11,7 +11,7 @@ using namespace std;
 	:param nEpisodes: the number of episodes to evaluate each parameter setting for
 
 */ 
-FCHC::FCHC(std::vector<double> initparams, double initsigma, double (*f)(std::vector<double> p, int n, mt19937_64 &generator, bool r), int nEpisodes)
+FCHC::FCHC(std::vector<double> initparams, double initsigma, double (*f)(std::vector<double> p, int n, Philox &generator, bool r), int nEpisodes)
 {
 	bestParams = initparams;
 	sigma = initsigma;
@@ -32,7 +32,7 @@ FCHC::getParameters()
 	:param generator: a RNG used for generating new parameter samples
 */
 void
-FCHC::train(mt19937_64 &generator)
+FCHC::train(Philox &generator)
 {
 	std::vector<double> new_theta(bestParams.size());
 	for(int i = 0; i < bestParams.size(); i++)
@@ -0,0 +1,28 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+/*		Constructor for the FeatureCacheT class. Computes the features of every step of D in parallel.
+
+	:param D: the data set whose states are basified; the cache can be used with D and its subsets
+	:param fb: the FourierBasis of the policy that will be evaluated with the cache
+*/
+template<typename Scalar>
+FeatureCacheT<Scalar>::FeatureCacheT(const TrajectoryStore &D, const FourierBasis &fb)
+{
+	PROFILE_SCOPE(PROFILE_FEATURE_CACHE);
+	numFeatures = fb.getNumOutputs();
+	firstStep = (D.getNumEpisodes() > 0 ? D.episodeBegin(0) : 0);
+	features.resize(D.getNumSteps() * numFeatures);
+	long long numSteps = (long long)D.getNumSteps();
+	const long long blockSteps = 1024;
+	parallelFor(0, (size_t)((numSteps + blockSteps - 1) / blockSteps), [&](size_t b)
+	{
+		long long t = (long long)b * blockSteps;
+		fb.basify(D.getState(firstStep + t), (size_t)min(blockSteps, numSteps - t), &features[t * numFeatures]);
+	});
+}
+
+template class FeatureCacheT<double>;
+template class FeatureCacheT<float>;
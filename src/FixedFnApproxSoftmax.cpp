@@ -0,0 +1,38 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+// The kernels of the configuration (stateDim, numActions, iOrder, dOrder)
+#define FIXED_POLICY(m, a, i, d) \
+	{ m, a, i, d, &FixedFourierBasis<m, i, d>::basify, \
+	  &FixedSoftmax<a, fourierNumTerms(m, i, d), double>::probsFromFeaturesMulti, \
+	  &FixedSoftmax<a, fourierNumTerms(m, i, d), float>::probsFromFeaturesMulti }
+
+// Configurations with specialized kernels: the one dimensional two and four action data sets main runs on, and
+// the policies of MountainCar (2 state variables, 3 actions) and CartPole (4 state variables, 2 actions),
+// all with the independent order of 1 that main uses
+static const FixedPolicyKernels fixedPolicies[] =
+{
+	FIXED_POLICY(1, 2, 1, 1), FIXED_POLICY(1, 2, 1, 2), FIXED_POLICY(1, 2, 1, 3), FIXED_POLICY(1, 2, 1, 4),
+	FIXED_POLICY(1, 2, 1, 5),
+	FIXED_POLICY(1, 4, 1, 1), FIXED_POLICY(1, 4, 1, 2), FIXED_POLICY(1, 4, 1, 3),
+	FIXED_POLICY(2, 3, 1, 1), FIXED_POLICY(2, 3, 1, 2), FIXED_POLICY(2, 3, 1, 3),
+	FIXED_POLICY(4, 2, 1, 1), FIXED_POLICY(4, 2, 1, 2), FIXED_POLICY(4, 2, 1, 3)
+};
+
+const FixedPolicyKernels * findFixedPolicyKernels(int stateDim, int numActions, int iOrder, int dOrder)
+{
+	for(const FixedPolicyKernels &k : fixedPolicies)
+		if(k.stateDim == stateDim && k.numActions == numActions && k.iOrder == iOrder && k.dOrder == dOrder)
+			return &k;
+	return NULL;
+}
+
+BasifyKernel findFixedBasify(int stateDim, int iOrder, int dOrder)
+{
+	for(const FixedPolicyKernels &k : fixedPolicies)
+		if(k.stateDim == stateDim && k.iOrder == iOrder && k.dOrder == dOrder)
+			return k.basify;
+	return NULL;
+}
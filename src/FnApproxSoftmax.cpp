@@ -18,6 +18,7 @@ FnApproxSoftmax::FnApproxSoftmax(int sDim, int nActions, int iOrder, int dOrder,
 
 	stateDim = sDim;
 	numActions = nActions;
+	fixedKernels = findFixedPolicyKernels(sDim, nActions, iOrder, dOrder);
 	setParameters(params);
 
 	ud = uniform_real_distribution<double>(0, 1);
@@ -26,13 +27,9 @@ FnApproxSoftmax::FnApproxSoftmax(int sDim, int nActions, int iOrder, int dOrder,
 
 /*		Parameter getter function. This also describes how the paramter vector maps to states and actions
 */
-std::vector<double> FnApproxSoftmax::getParameters()
+std::vector<double> FnApproxSoftmax::getParameters() const
 {
-	std::vector<double> params(numActions*numFeatures);
-	for(int i = 0; i < numActions; i++)
-		for(int j = 0; j < numFeatures; j++)
-			params.push_back(parameters[i][j]);
-	return params;
+	return parameters;
 }
 
 /*		Parameter setter function. This also describes how the paramter vector maps to states and actions
@@ -44,15 +41,8 @@ void FnApproxSoftmax::setParameters(std::vector<double> params)
 		params.resize(numActions * numFeatures);
 		std::fill(params.begin(), params.end(), 0.1);
 	}
-	std::vector<std::vector<double>> new_params(numActions);
-	for(int i = 0; i < numActions; i++)
-	{
-		std::vector<double> w_a(numFeatures);
-		for(int j = 0; j < numFeatures; j++)
-			w_a[j] = params[(i*numFeatures) + j];
-		new_params[i] = w_a;
-	}
-	parameters = new_params;
+	// Row i holds the weights of action i, so parameters[(i*numFeatures) + j] is the weight of feature j for action i
+	parameters.assign(params.begin(), params.begin() + numActions * numFeatures);
 }
 
 /*		Returns an action given a state.
@@ -60,7 +50,7 @@ void FnApproxSoftmax::setParameters(std::vector<double> params)
 	:param state: vector representation of the current state
 	:param generator: RNG used to sample action from softmax distribution
 */
-int FnApproxSoftmax::getAction(std::vector<double> state, std::mt19937_64 & generator)
+int FnApproxSoftmax::getAction(std::vector<double> state, Philox & generator)
 {
 	std::vector<double> actionprob = getActionProb(state);
 	double sample = ud(generator);
@@ -79,20 +69,30 @@ int FnApproxSoftmax::getAction(std::vector<double> state, std::mt19937_64 & gene
 
 	:param state: vector representation of the current state
 */
-std::vector<double> FnApproxSoftmax::getActionProb(std::vector<double> state)
+std::vector<double> FnApproxSoftmax::getActionProb(std::vector<double> state) const
 {
 	std::vector<double> phi = fb.basify(state);
+	return getActionProbFromFeatures(phi.data());
+}
+
+/*		Returns a vector of action probabilities given the features of a state, skipping the
+		FourierBasis computation. Used with a FeatureCache.
+
+	:param phi: pointer to the numFeatures features of the current state
+*/
+std::vector<double> FnApproxSoftmax::getActionProbFromFeatures(const double * phi) const
+{
 	std::vector<double> actionprob(numActions, 0.0);
 	for(int i = 0; i < numActions; i++)
 		for(int j = 0; j < numFeatures; j++)
-			actionprob[i] += parameters[i][j] * phi[j];
+			actionprob[i] += parameters[(i*numFeatures) + j] * phi[j];
 
 	double sum_of_elems = 0.0;
 	for(auto &d : actionprob)
-	{
-		d = exp(sigma * d);
+		d = sigma * d;
+	vecExp(actionprob.data(), actionprob.data(), numActions);
+	for(auto &d : actionprob)
 		sum_of_elems += d;
-	}
 	for(auto &d : actionprob)
 		d = d / sum_of_elems;
 	return actionprob;
@@ -103,7 +103,176 @@ std::vector<double> FnApproxSoftmax::getActionProb(std::vector<double> state)
 	:param state: vector representation of the current state
 	:param action: the action to evaluate the policy at
 */
-double FnApproxSoftmax::getProb(std::vector<double> state, int action)
+double FnApproxSoftmax::getProb(std::vector<double> state, int action) const
 {
 	return getActionProb(state)[action];
+}
+
+/*		Writes the action probabilities of a block of states to a buffer, computed per state as
+		getActionProb does, with one basify call and one vecExp call for the whole block.
+
+	:param states: count states of stateDim values each, back to back
+	:param count: number of states
+	:param out: buffer receiving count x numActions probabilities, row-major
+*/
+void FnApproxSoftmax::getActionProbs(const double * states, size_t count, double * out) const
+{
+	std::vector<double> phi(count * numFeatures);
+	fb.basify(states, count, phi.data());
+	for(size_t r = 0; r < count; r++)
+	{
+		const double * rowPhi = phi.data() + r * numFeatures;
+		double * rowOut = out + r * numActions;
+		for(int i = 0; i < numActions; i++)
+		{
+			rowOut[i] = 0.0;
+			for(int j = 0; j < numFeatures; j++)
+				rowOut[i] += parameters[(i*numFeatures) + j] * rowPhi[j];
+			rowOut[i] = sigma * rowOut[i];
+		}
+	}
+	vecExp(out, out, count * numActions);
+	for(size_t r = 0; r < count; r++)
+	{
+		double * rowOut = out + r * numActions;
+		double sum_of_elems = 0.0;
+		for(int i = 0; i < numActions; i++)
+			sum_of_elems += rowOut[i];
+		for(int i = 0; i < numActions; i++)
+			rowOut[i] = rowOut[i] / sum_of_elems;
+	}
+}
+
+/*		Returns the probability of an action given the features of a state.
+
+	:param phi: pointer to the numFeatures features of the current state
+	:param action: the action to evaluate the policy at
+*/
+double FnApproxSoftmax::getProbFromFeatures(const double * phi, int action) const
+{
+	return getActionProbFromFeatures(phi)[action];
+}
+
+/*		Writes the probabilities of a block of state-action pairs to a buffer. The states are basified
+		into a count x numFeatures matrix and handed to getProbsFromFeatures.
+
+	:param states: count states of stateDim values each, back to back
+	:param actions: count actions, one per state
+	:param count: number of state-action pairs
+	:param out: buffer receiving count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void FnApproxSoftmax::getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs) const
+{
+	std::vector<double> phi(count * numFeatures);
+	fb.basify(states, count, phi.data());
+	getProbsFromFeatures(phi.data(), actions, count, out, logProbs);
+}
+
+/*		Writes the probabilities of a block of state-action pairs, given the features of the states, to a
+		buffer. The action preferences of the whole block are one matrix product of the features with the
+		transposed parameter matrix, followed by a log-sum-exp softmax per state.
+
+	:param phi: count rows of numFeatures features, back to back
+	:param actions: count actions, one per row of phi
+	:param count: number of state-action pairs
+	:param out: buffer receiving count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void FnApproxSoftmax::getProbsFromFeatures(const double * phi, const int * actions, size_t count, double * out, bool logProbs) const
+{
+	if(fixedKernels)
+	{
+		fixedKernels->probs(parameters.data(), 1, phi, actions, count, sigma, out, logProbs);
+		return;
+	}
+	typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowMatrixXd;
+	Map<const RowMatrixXd> features(phi, count, numFeatures);
+	Map<const RowMatrixXd> weights(parameters.data(), numActions, numFeatures);
+	RowMatrixXd logits = sigma * (features * weights.transpose());
+	softmaxSelect(logits.data(), numActions, numActions, actions, count, out, logProbs);
+}
+
+/*		Writes the probabilities of a block of state-action pairs under several parameter vectors to a
+		buffer. The states are basified once and shared by all parameter vectors.
+
+	:param thetas: numPolicies parameter vectors of numActions*numFeatures values, back to back
+	:param numPolicies: number of parameter vectors
+	:param states: count states of stateDim values each, back to back
+	:param actions: count actions, one per state
+	:param count: number of state-action pairs
+	:param out: buffer receiving numPolicies rows of count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void FnApproxSoftmax::getProbsMulti(const double * thetas, int numPolicies, const double * states, const int * actions,
+									size_t count, double * out, bool logProbs) const
+{
+	std::vector<double> phi(count * numFeatures);
+	fb.basify(states, count, phi.data());
+	getProbsFromFeaturesMulti(thetas, numPolicies, phi.data(), actions, count, out, logProbs);
+}
+
+/*		Writes the probabilities of a block of state-action pairs, given the features of the states, under
+		several parameter vectors to a buffer. The parameter vectors stacked on top of each other form one
+		(numPolicies*numActions) x numFeatures row-major matrix, so the action preferences of every policy
+		for the whole block are a single matrix product with the features.
+
+	:param thetas: numPolicies parameter vectors of numActions*numFeatures values, back to back
+	:param numPolicies: number of parameter vectors
+	:param phi: count rows of numFeatures features, back to back
+	:param actions: count actions, one per row of phi
+	:param count: number of state-action pairs
+	:param out: buffer receiving numPolicies rows of count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void FnApproxSoftmax::getProbsFromFeaturesMulti(const double * thetas, int numPolicies, const double * phi, const int * actions,
+												size_t count, double * out, bool logProbs) const
+{
+	if(fixedKernels)
+	{
+		fixedKernels->probs(thetas, numPolicies, phi, actions, count, sigma, out, logProbs);
+		return;
+	}
+	typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowMatrixXd;
+	Map<const RowMatrixXd> features(phi, count, numFeatures);
+	Map<const RowMatrixXd> weights(thetas, numPolicies * numActions, numFeatures);
+	RowMatrixXd logits = sigma * (features * weights.transpose());
+	for(int k = 0; k < numPolicies; k++)
+		softmaxSelect(logits.data() + k * numActions, numActions, numPolicies * numActions, actions, count, out + k * count, logProbs);
+}
+
+/*		getProbsFromFeatures for float features, e.g. from a FeatureCacheF
+*/
+void FnApproxSoftmax::getProbsFromFeatures(const float * phi, const int * actions, size_t count, double * out, bool logProbs) const
+{
+	getProbsFromFeaturesMulti(parameters.data(), 1, phi, actions, count, out, logProbs);
+}
+
+/*		getProbsFromFeaturesMulti for float features, e.g. from a FeatureCacheF. The product of the features
+		with the parameters runs in single precision, at twice the SIMD width and half the memory traffic
+		of the double version; the softmax of the resulting action preferences runs in double.
+*/
+void FnApproxSoftmax::getProbsFromFeaturesMulti(const double * thetas, int numPolicies, const float * phi, const int * actions,
+												size_t count, double * out, bool logProbs) const
+{
+	if(fixedKernels)
+	{
+		fixedKernels->probsFloat(thetas, numPolicies, phi, actions, count, sigma, out, logProbs);
+		return;
+	}
+	typedef Matrix<float, Dynamic, Dynamic, RowMajor> RowMatrixXf;
+	typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowMatrixXd;
+	Map<const RowMatrixXf> features(phi, count, numFeatures);
+	Map<const RowMatrixXd> weights(thetas, numPolicies * numActions, numFeatures);
+	RowMatrixXf weightsf = weights.cast<float>();
+	RowMatrixXd logits = sigma * (features * weightsf.transpose()).cast<double>();
+	for(int k = 0; k < numPolicies; k++)
+		softmaxSelect(logits.data() + k * numActions, numActions, numPolicies * numActions, actions, count, out + k * count, logProbs);
+}
+
+/*		Returns the FourierBasis used to compute the features of states
+*/
+const FourierBasis & FnApproxSoftmax::getBasis() const
+{
+	return fb;
 }
\ No newline at end of file
@@ -24,6 +24,7 @@ void FourierBasis::init(const int & inputDimension, int iOrder, int dOrder) {
 			termCount++;
 		}
 	}
+	fixedBasify = findFixedBasify(inputDimension, iOrder, dOrder);
 }
 
 int FourierBasis::getNumOutputs() const {
@@ -32,7 +33,42 @@ int FourierBasis::getNumOutputs() const {
 
 vector<double> FourierBasis::basify(const vector<double> & x) const {
 	vector<double> result(nTerms);
-	for (int i = 0; i < nTerms; i++)
-		result[i] = cos(M_PI*dot(c[i], x));
+	basify(x.data(), result.data());
 	return result;
+}
+
+void FourierBasis::basify(const double * x, double * out) const {
+	basify(x, 1, out);
+}
+
+// The cosine arguments of all count states are computed first, so that vecCos runs over one long array
+void FourierBasis::basify(const double * x, size_t count, double * out) const {
+	if (fixedBasify) {
+		fixedBasify(x, count, out);
+		return;
+	}
+	for (size_t r = 0; r < count; r++) {
+		const double * row = x + r * inputDimension;
+		double * rowOut = out + r * nTerms;
+		for (int i = 0; i < nTerms; i++) {
+			double d = 0;
+			for (int j = 0; j < inputDimension; j++)
+				d += c[i][j] * row[j];
+			rowOut[i] = M_PI*d;
+		}
+	}
+	vecCos(out, out, count * nTerms);
+}
+
+// The features are computed in double a few states at a time and rounded, so no state's cosine
+// arguments lose precision
+void FourierBasis::basify(const double * x, size_t count, float * out) const {
+	const size_t chunk = 64;
+	vector<double> rows(min(count, chunk) * nTerms);
+	for (size_t r = 0; r < count; r += chunk) {
+		size_t n = min(chunk, count - r);
+		basify(x + r * inputDimension, n, rows.data());
+		for (size_t i = 0; i < n * nTerms; i++)
+			out[r * nTerms + i] = (float)rows[i];
+	}
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+// See GenerationBatcher.hpp for a description of the batching.
+
+GenerationBatcher::GenerationBatcher(Pass pass)
+	: pass(std::move(pass)), numSearches(0), numPasses(0)
+{
+}
+
+void GenerationBatcher::join(size_t count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	numSearches += count;
+}
+
+/*		Hands in the population of a search's generation and waits for the pass that evaluates it
+
+	:param thetas: the population, one column per candidate; it must stay valid until evaluate returns
+
+	Returns the statistics of the importance sampled returns of every column of thetas
+*/
+std::vector<RunningStats> GenerationBatcher::evaluate(const MatrixXd &thetas)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	size_t index = populations.size();
+	uint64_t passBefore = numPasses;
+	populations.push_back(&thetas);
+	if(populations.size() == numSearches)
+		runPass(guard);
+	else
+		passDone.wait(guard, [this, passBefore] { return numPasses != passBefore; });
+	// the results stay until the next pass, which needs this search's next population
+	if(error)
+		std::rethrow_exception(error);
+	return results[index];
+}
+
+void GenerationBatcher::leave()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	numSearches--;
+	if(!populations.empty() && populations.size() == numSearches)
+		runPass(guard);
+}
+
+/*		Evaluates the populations handed in so far in one call of pass and wakes their searches. Called with
+		the lock held, once every search has handed in its population; the lock is released during the pass.
+*/
+void GenerationBatcher::runPass(std::unique_lock<std::mutex> &guard)
+{
+	std::vector<const MatrixXd *> batch;
+	batch.swap(populations);
+	guard.unlock();
+
+	std::vector<std::vector<RunningStats>> batchResults(batch.size());
+	std::exception_ptr batchError;
+	try
+	{
+		Index numColumns = 0;
+		for(const MatrixXd * population : batch)
+			numColumns += population->cols();
+		MatrixXd thetas(batch[0]->rows(), numColumns);
+		for(Index i = 0, column = 0; i < (Index)batch.size(); column += batch[i]->cols(), i++)
+			thetas.middleCols(column, batch[i]->cols()) = *batch[i];
+		std::vector<RunningStats> stats = pass(thetas);
+		for(size_t i = 0, column = 0; i < batch.size(); column += batch[i]->cols(), i++)
+			batchResults[i].assign(stats.begin() + column, stats.begin() + column + batch[i]->cols());
+	}
+	catch(...)
+	{
+		batchError = std::current_exception();
+	}
+
+	guard.lock();
+	results = std::move(batchResults);
+	error = batchError;
+	numPasses++;
+	passDone.notify_all();
+}
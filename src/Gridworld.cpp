@@ -8,7 +8,7 @@ This file contains the implementations of all of the functions defined in the Gr
 
 // Implement the constructor.
 Gridworld::Gridworld() {
-	mt19937_64 generator(0);	// Initialize the RNG.
+	Philox generator(0);	// Initialize the RNG.
 	newEpisode(generator);		// Start a new episode.
 }
 
@@ -20,7 +20,7 @@ int Gridworld::getNumActions() const {
 	return 4;					// up/down/left/right
 }
 
-double Gridworld::update(const int & action, mt19937_64 & generator) {
+double Gridworld::update(const int & action, Philox & generator) {
 	// Actions correspond to up/down/left/right, where (0,0) is bottom left. Actions always succeed
 	if (action == 0)
 		y++;
@@ -36,7 +36,7 @@ double Gridworld::update(const int & action, mt19937_64 & generator) {
 	else return -1;	// Reward is always -1
 }
 
-vector<double> Gridworld::getState(mt19937_64 & generator) {
+vector<double> Gridworld::getState(Philox & generator) {
 	vector<double> result(1, 0.0);	// Effective tabular representation, one element per state, all set to zero.
 	result[0] = ((x + y*size) * 1.0) / ((size * size) - 1.0);				// Set the s'th element to be 1, where we map x-y coordinates to unique integers.	
 	return result;
@@ -46,6 +46,6 @@ bool Gridworld::inTerminalState() const {
 	return ((x == size - 1) && (y == size - 1));	// Are we in state (size-1,size-1)?
 }
 
-void Gridworld::newEpisode(mt19937_64 & generator) {
+void Gridworld::newEpisode(Philox & generator) {
 	x = y = 0;								// Always start in state (0,0).
 }
\ No newline at end of file
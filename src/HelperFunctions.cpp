@@ -1,5 +1,7 @@
 #include "stdafx.h"
 
+#include <sstream>
+
 // This function returns the inverse of Student's t CDF using the degrees of
 // freedom in nu for the corresponding probabilities in p. That is, it is
 // a C++ implementation of Matlab's tinv function: https://www.mathworks.com/help/stats/tinv.html
@@ -18,6 +20,28 @@ double stddev(const VectorXd& v) {
 	return result;								// Return the value that we've computed.
 }
 
+// Adds one value to the running statistics (Welford's update)
+void RunningStats::add(const double & x) {
+	n += 1;
+	double d = x - mean;
+	mean += d / n;
+	M2 += d * (x - mean);
+}
+
+// Merges the statistics of a disjoint sample into these statistics
+void RunningStats::merge(const RunningStats & other) {
+	if (other.n == 0)
+		return;
+	double total = n + other.n, d = other.mean - mean;
+	mean += d * other.n / total;
+	M2 += other.M2 + d * d * n * other.n / total;
+	n = total;
+}
+
+double RunningStats::stddev() const {
+	return sqrt(M2 / (n - 1.0));
+}
+
 // Assuming v holds i.i.d. samples of a random variable, compute
 // a (1-delta)-confidence upper bound on the expected value of the random
 // variable using Student's t-test. That is:
@@ -33,19 +57,74 @@ double ttestUpperBound(const VectorXd& v, const double& delta, const int numPoin
 }
 
 /*
-This function implements CMA-ES (http://en.wikipedia.org/wiki/CMA-ES). Return
-value is the minimizer / maximizer. This code is written for brevity, not clarity.
-See the link above for a description of what this code is doing.
+Restores the parts of a checkpointed CMA-ES state that every variant shares (the generator and the normal
+distribution) and checks that the checkpoint belongs to this search. Returns false if there is no
+checkpoint, or if it has not been written yet.
 */
-VectorXd CMAES(
+static bool loadCMAESState(CMAESCheckpoint* checkpoint, CMAESState& state, CMAESVariant variant, unsigned int N, unsigned int lambda,
+	Philox& generator, normal_distribution<double>& distribution)
+{
+	if (checkpoint == NULL || !checkpoint->load(state))
+		return false;
+	const CheckpointHeader& header = state.header;
+	bool valid = header.variant == (uint32_t)variant && header.N == N && header.lambda == lambda && state.xmean.size() == N && state.best.size() == N && state.ps.size() == N;
+	if (variant == CMAES_FULL)
+		valid = valid && state.pc.size() == N && state.D.size() == N && state.C.rows() == N && state.C.cols() == N && state.B.rows() == N && state.B.cols() == N;
+	else if (variant == CMAES_SEPARABLE)
+		valid = valid && state.pc.size() == N && state.C.rows() == N && state.C.cols() == 1;
+	else
+		valid = valid && state.paths.rows() == N && state.paths.cols() == lambda;
+	if (!valid)
+		throw runtime_error("The checkpoint does not belong to a CMA-ES search of this variant and number of parameters");
+	if (header.generatorPosition < generator.getPosition())
+		throw runtime_error("The generator of the checkpointed CMA-ES search is ahead of the checkpoint");
+	generator.discard(header.generatorPosition - generator.getPosition());
+	istringstream in(state.normalState);
+	in >> distribution;
+	if (!in)
+		throw runtime_error("The checkpoint holds an invalid normal distribution");
+	return true;
+}
+
+// Fills in the parts of a CMA-ES state that every variant shares and writes it to checkpoint
+static void saveCMAESState(CMAESCheckpoint* checkpoint, CMAESState& state, CMAESVariant variant, unsigned int N, unsigned int lambda,
+	unsigned int counteval, double sigma, const Philox& generator, const normal_distribution<double>& distribution)
+{
+	state.header.variant = variant;
+	state.header.N = N;
+	state.header.lambda = lambda;
+	state.header.counteval = counteval;
+	state.header.sigma = sigma;
+	state.header.generatorPosition = generator.getPosition();
+	ostringstream out;
+	out << distribution;
+	state.normalState = out.str();
+	checkpoint->save(state);
+}
+
+// Smallest eigenvalue of the full covariance matrix relative to its largest, i.e. a condition number of 1e14
+const double CMAES_MIN_EIGENVALUE_RATIO = 1e-14;
+
+/*
+Shared body of the CMA-ES overloads below. evaluatePopulation(arx, arfitness, generation) must write the
+value of the function being optimized at every column of arx into arfitness; generation counts from 1.
+
+If checkpoint is not NULL, the search starts from the state it holds, if any, and saves its state to it
+after every generation at which checkpoint->due() says so, and after the last one.
+
+All matrices and vectors are allocated before the first generation and reused. The lambda samples of a
+generation come from one matrix product of B * diag(D) with a block of standard normals, and the
+symmetric covariance matrix is decomposed with the self-adjoint eigensolver.
+*/
+template<typename EvaluatePopulation>
+static VectorXd CMAESImpl(
 	const VectorXd& initialMean,											// Starting point of the search
 	const double& initialSigma,												// Initial standard deviation of the search around initialMean
 	const unsigned int& numIterations,										// Number of iterations to run before stopping
-	// f, below, is the function to be optimized. Its first argument is the solution, the middle arguments are variables required by f (listed below), and the last is a random number generator.
-	double(*f)(const VectorXd& theta, const void* params[], mt19937_64& generator),
-	const void* params[],													// Parrameters of f other than theta
 	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
-	mt19937_64& generator)													// The random number generator to use
+	Philox& generator,														// The random number generator to use
+	CMAESCheckpoint* checkpoint,											// Where to save the state of the search, or NULL
+	EvaluatePopulation evaluatePopulation)
 {
 	// Define all of the terms that we will use in the iterations
 	unsigned int N = (unsigned int)initialMean.size(), lambda = 4 + (unsigned int)floor(3.0 * log(N)), hsig;
@@ -57,28 +136,41 @@ VectorXd CMAES(
 	mu = floor(mu);
 	weights = weights / weights.sum();
 	double mueff = weights.sum() * weights.sum() / weights.dot(weights), cc = (4.0 + mueff / N) / (N + 4.0 + 2.0 * mueff / N), cs = (mueff + 2.0) / (N + mueff + 5.0), c1 = 2.0 / ((N + 1.3) * (N + 1.3) + mueff), cmu = min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((N + 2.0) * (N + 2.0) + mueff)), damps = 1.0 + 2.0 * max(0.0, sqrt((mueff - 1.0) / (N + 1.0)) - 1.0) + cs;
-	VectorXd pc = VectorXd::Zero(N), ps = VectorXd::Zero(N), D = VectorXd::Ones(N), DSquared = D, DInv = 1.0 / D.array(), xold, oneOverD;
-	for (unsigned int i = 0; i < DSquared.size(); i++)
-		DSquared[i] *= DSquared[i];
-	MatrixXd B = MatrixXd::Identity(N, N), C = B * DSquared.asDiagonal() * B.transpose(), invsqrtC = B * DInv.asDiagonal() * B.transpose(), arx(N, (int)lambda), repmat(xmean.size(), (int)(mu + .1)), artmp, arxSubMatrix(N, (int)(mu + .1));
+	VectorXd pc = VectorXd::Zero(N), ps = VectorXd::Zero(N), D = VectorXd::Ones(N), xold(N), step(N);
+	MatrixXd B = MatrixXd::Identity(N, N), BD = B, C = B, invsqrtC = B, arz(N, (int)lambda), arx(N, (int)lambda), arxSubMatrix(N, (int)mu), artmp(N, (int)mu), artmpWeighted(N, (int)mu);
+	SelfAdjointEigenSolver<MatrixXd> es(N);
+	normal_distribution<double> distribution(0, 1);
 	vector<double> arfitness(lambda);
 	vector<unsigned int> arindex(lambda);
+	unsigned int counteval = 0;
+	CMAESState state;
+	if (loadCMAESState(checkpoint, state, CMAES_FULL, N, lambda, generator, distribution)) {
+		if (state.header.counteval >= numIterations)
+			return state.best;
+		counteval = (unsigned int)state.header.counteval;
+		sigma = state.header.sigma;
+		eigeneval = state.header.eigeneval;
+		xmean = state.xmean;
+		ps = state.ps;
+		pc = state.pc;
+		D = state.D;
+		C = state.C;
+		B = state.B;
+		BD.noalias() = B * D.asDiagonal();
+		invsqrtC.noalias() = B * D.cwiseInverse().asDiagonal() * B.transpose();
+	}
 	// Perform the iterations
-	for (unsigned int counteval = 0; counteval < numIterations;) {
-		// Sample the population
-		for (unsigned int k = 0; k < lambda; k++) {
-			normal_distribution<double> distribution(0, 1);
-			VectorXd randomVector(N);
-			for (unsigned int i = 0; i < N; i++)
-				randomVector[i] = D[i] * distribution(generator);
-			arx.col(k) = xmean + sigma * B * randomVector;
-		}
+	for (; counteval < numIterations;) {
+		PROFILE_SCOPE(PROFILE_CMAES_GENERATION);
+		// Sample the population: arx = xmean + sigma * B * diag(D) * arz
+		for (Index i = 0; i < arz.size(); i++)
+			arz.data()[i] = distribution(generator);
+		arx.noalias() = sigma * BD * arz;
+		arx.colwise() += xmean;
 		// Evaluate the population
-		vector<VectorXd> fInputs(lambda);
-		for (unsigned int i = 0; i < lambda; i++) {
-			fInputs[i] = arx.col(i);
-			arfitness[i] = (minimize ? 1 : -1) * f(fInputs[i], params, generator);
-		}
+		evaluatePopulation(arx, arfitness, counteval / lambda + 1);
+		for (unsigned int i = 0; i < lambda; i++)
+			arfitness[i] *= (minimize ? 1 : -1);
 		// Update the population distribution
 		counteval += lambda;
 		xold = xmean;
@@ -87,29 +179,294 @@ VectorXd CMAES(
 		std::sort(arindex.begin(), arindex.end(), [&arfitness](unsigned int i1, unsigned int i2) {return arfitness[i1] < arfitness[i2]; });
 		for (unsigned int col = 0; col < (unsigned int)mu; col++)
 			arxSubMatrix.col(col) = arx.col(arindex[col]);
-		xmean = arxSubMatrix * weights;
-		ps = (1.0 - cs) * ps + sqrt(cs * (2.0 - cs) * mueff) * invsqrtC * (xmean - xold) / sigma;
+		xmean.noalias() = arxSubMatrix * weights;
+		step = (xmean - xold) / sigma;
+		ps *= (1.0 - cs);
+		ps.noalias() += sqrt(cs * (2.0 - cs) * mueff) * invsqrtC * step;
 		hsig = (ps.norm() / sqrt(1.0 - pow(1.0 - cs, 2.0 * counteval / lambda)) / (double)chiN < 1.4 + 2.0 / (N + 1.0) ? 1 : 0);
-		pc = (1 - cc) * pc + hsig * sqrt(cc * (2 - cc) * mueff) * (xmean - xold) / sigma;
-		for (unsigned int i = 0; i < repmat.cols(); i++)
-			repmat.col(i) = xold;
-		artmp = (1.0 / sigma) * (arxSubMatrix - repmat);
-		C = (1 - c1 - cmu) * C + c1 * (pc * pc.transpose() + (1u - hsig) * cc * (2 - cc) * C) + cmu * artmp * weights.asDiagonal() * artmp.transpose();
+		pc = (1 - cc) * pc + hsig * sqrt(cc * (2 - cc) * mueff) * step;
+		artmp = (arxSubMatrix.colwise() - xold) / sigma;
+		artmpWeighted = artmp * weights.asDiagonal();
+		C *= (1 - c1 - cmu) + c1 * (1u - hsig) * cc * (2 - cc);
+		C.noalias() += c1 * pc * pc.transpose();
+		C.noalias() += cmu * artmpWeighted * artmp.transpose();
 		sigma = sigma * exp((cs / damps) * (ps.norm() / (double)chiN - 1.0));
 		if ((double)counteval - eigeneval > (double)lambda / (c1 + cmu) / (double)N / 10.0) {
 			eigeneval = counteval;
-			for (unsigned int r = 0; r < C.rows(); r++)
-				for (unsigned int c = r + 1; c < C.cols(); c++)
-					C(r, c) = C(c, r);
-			EigenSolver<MatrixXd> es(C);
-			D = C.eigenvalues().real();
-			B = es.eigenvectors().real();
-			D = D.array().sqrt();
-			for (unsigned int i = 0; i < B.cols(); i++)
-				B.col(i) = B.col(i).normalized();
-			oneOverD = 1.0 / D.array();
-			invsqrtC = B * oneOverD.asDiagonal() * B.transpose();
+			// Only the lower triangle of C is read, so C does not need to be symmetrized first
+			es.compute(C);
+			PROFILE_COUNT(PROFILE_EIGEN_DECOMPOSITIONS, 1);
+			// Eigenvalues that rounding made tiny or negative are raised to a floor relative to the largest,
+			// so that D stays invertible and invsqrtC finite
+			D = es.eigenvalues().cwiseMax(max(es.eigenvalues().maxCoeff() * CMAES_MIN_EIGENVALUE_RATIO, numeric_limits<double>::min())).cwiseSqrt();
+			B = es.eigenvectors();
+			BD.noalias() = B * D.asDiagonal();
+			invsqrtC.noalias() = B * D.cwiseInverse().asDiagonal() * B.transpose();
+		}
+		if (checkpoint != NULL && checkpoint->due(counteval >= numIterations)) {
+			state.header.eigeneval = eigeneval;
+			state.xmean = xmean;
+			state.ps = ps;
+			state.pc = pc;
+			state.D = D;
+			state.C = C;
+			state.B = B;
+			state.best = arx.col(arindex[0]);
+			saveCMAESState(checkpoint, state, CMAES_FULL, N, lambda, counteval, sigma, generator, distribution);
 		}
 	} // End loop over iterations
 	return arx.col(arindex[0]);
+}
+
+/*
+Separable CMA-ES (sep-CMA-ES, Ros and Hansen 2008): the covariance matrix is restricted to its diagonal, so
+sampling and the update cost O(N) per solution and no eigendecomposition is needed. The learning rates of
+the covariance are raised by (N + 2) / 3 as in the paper, since only N entries are learned.
+*/
+template<typename EvaluatePopulation>
+static VectorXd SepCMAESImpl(
+	const VectorXd& initialMean,											// Starting point of the search
+	const double& initialSigma,												// Initial standard deviation of the search around initialMean
+	const unsigned int& numIterations,										// Number of iterations to run before stopping
+	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
+	Philox& generator,														// The random number generator to use
+	CMAESCheckpoint* checkpoint,											// Where to save the state of the search, or NULL
+	EvaluatePopulation evaluatePopulation)
+{
+	unsigned int N = (unsigned int)initialMean.size(), lambda = 4 + (unsigned int)floor(3.0 * log(N)), hsig;
+	double sigma = initialSigma, mu = lambda / 2.0, chiN = pow(N, 0.5) * (1.0 - 1.0 / (4.0 * N) + 1.0 / (21.0 * N * N));
+	VectorXd xmean = initialMean, weights((unsigned int)mu);
+	for (unsigned int i = 0; i < (unsigned int)mu; i++)
+		weights[i] = i + 1;
+	weights = log(mu + 1.0 / 2.0) - weights.array().log();
+	mu = floor(mu);
+	weights = weights / weights.sum();
+	double mueff = weights.sum() * weights.sum() / weights.dot(weights), cc = (4.0 + mueff / N) / (N + 4.0 + 2.0 * mueff / N), cs = (mueff + 2.0) / (N + mueff + 5.0), damps = 1.0 + 2.0 * max(0.0, sqrt((mueff - 1.0) / (N + 1.0)) - 1.0) + cs;
+	double c1 = min(1.0, 2.0 / ((N + 1.3) * (N + 1.3) + mueff) * (N + 2.0) / 3.0), cmu = min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((N + 2.0) * (N + 2.0) + mueff) * (N + 2.0) / 3.0);
+	VectorXd pc = VectorXd::Zero(N), ps = VectorXd::Zero(N), C = VectorXd::Ones(N), D = C, xold(N), zmean(N), artmpSquared(N);
+	MatrixXd arx(N, (int)lambda), arz(N, (int)lambda);
+	vector<double> arfitness(lambda);
+	vector<unsigned int> arindex(lambda);
+	normal_distribution<double> distribution(0, 1);
+	unsigned int counteval = 0;
+	CMAESState state;
+	if (loadCMAESState(checkpoint, state, CMAES_SEPARABLE, N, lambda, generator, distribution)) {
+		if (state.header.counteval >= numIterations)
+			return state.best;
+		counteval = (unsigned int)state.header.counteval;
+		sigma = state.header.sigma;
+		xmean = state.xmean;
+		ps = state.ps;
+		pc = state.pc;
+		C = state.C;
+		D = C.cwiseSqrt();
+	}
+	for (; counteval < numIterations;) {
+		PROFILE_SCOPE(PROFILE_CMAES_GENERATION);
+		// Sample the population, x = xmean + sigma * D .* z
+		for (unsigned int k = 0; k < lambda; k++) {
+			for (unsigned int i = 0; i < N; i++)
+				arz(i, k) = distribution(generator);
+			arx.col(k) = xmean + sigma * D.cwiseProduct(arz.col(k));
+		}
+		evaluatePopulation(arx, arfitness, counteval / lambda + 1);
+		for (unsigned int i = 0; i < lambda; i++)
+			arfitness[i] *= (minimize ? 1 : -1);
+		counteval += lambda;
+		xold = xmean;
+		for (unsigned int i = 0; i < lambda; ++i)
+			arindex[i] = i;
+		std::sort(arindex.begin(), arindex.end(), [&arfitness](unsigned int i1, unsigned int i2) {return arfitness[i1] < arfitness[i2]; });
+		xmean.setZero();
+		zmean.setZero();
+		artmpSquared.setZero();
+		for (unsigned int i = 0; i < (unsigned int)mu; i++) {
+			xmean += weights[i] * arx.col(arindex[i]);
+			zmean += weights[i] * arz.col(arindex[i]);
+			artmpSquared += weights[i] * (D.cwiseProduct(arz.col(arindex[i]))).cwiseAbs2();
+		}
+		ps = (1.0 - cs) * ps + sqrt(cs * (2.0 - cs) * mueff) * zmean;
+		hsig = (ps.norm() / sqrt(1.0 - pow(1.0 - cs, 2.0 * counteval / lambda)) / (double)chiN < 1.4 + 2.0 / (N + 1.0) ? 1 : 0);
+		pc = (1 - cc) * pc + hsig * sqrt(cc * (2 - cc) * mueff) * (xmean - xold) / sigma;
+		C = (1 - c1 - cmu) * C + c1 * (pc.cwiseAbs2() + (1u - hsig) * cc * (2 - cc) * C) + cmu * artmpSquared;
+		D = C.cwiseSqrt();
+		sigma = sigma * exp((cs / damps) * (ps.norm() / (double)chiN - 1.0));
+		if (checkpoint != NULL && checkpoint->due(counteval >= numIterations)) {
+			state.xmean = xmean;
+			state.ps = ps;
+			state.pc = pc;
+			state.C = C;
+			state.best = arx.col(arindex[0]);
+			saveCMAESState(checkpoint, state, CMAES_SEPARABLE, N, lambda, counteval, sigma, generator, distribution);
+		}
+	}
+	return arx.col(arindex[0]);
+}
+
+/*
+Limited-memory CMA-ES in the form of LM-MA-ES (Loshchilov, Glasmachers and Beyer 2017): instead of a
+covariance matrix, m = 4 + floor(3 ln N) evolution paths with learning rates decreasing geometrically are
+kept, and a sample z ~ N(0, I) is transformed by d = (1 - cd_j) d + cd_j * M_j (M_j . d) for every path j.
+Memory is O(N m) and sampling costs O(N m) per solution. The learning rates of the paper (cs = 2 lambda / N
+and cc_j = lambda / (4^j N)) are capped at 1 for small N, where the full CMA-ES is the better choice anyway.
+*/
+template<typename EvaluatePopulation>
+static VectorXd LMCMAESImpl(
+	const VectorXd& initialMean,											// Starting point of the search
+	const double& initialSigma,												// Initial standard deviation of the search around initialMean
+	const unsigned int& numIterations,										// Number of iterations to run before stopping
+	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
+	Philox& generator,														// The random number generator to use
+	CMAESCheckpoint* checkpoint,											// Where to save the state of the search, or NULL
+	EvaluatePopulation evaluatePopulation)
+{
+	unsigned int N = (unsigned int)initialMean.size(), lambda = 4 + (unsigned int)floor(3.0 * log(N)), numPaths = lambda, usedPaths = 0;
+	double sigma = initialSigma, mu = lambda / 2.0;
+	VectorXd xmean = initialMean, weights((unsigned int)mu);
+	for (unsigned int i = 0; i < (unsigned int)mu; i++)
+		weights[i] = i + 1;
+	weights = log(mu + 1.0 / 2.0) - weights.array().log();
+	mu = floor(mu);
+	weights = weights / weights.sum();
+	double mueff = weights.sum() * weights.sum() / weights.dot(weights), cs = min(1.0, 2.0 * lambda / N);
+	VectorXd ps = VectorXd::Zero(N), cd(numPaths), cc(numPaths), zmean(N), dmean(N);
+	for (unsigned int j = 0; j < numPaths; j++) {
+		cd[j] = 1.0 / (pow(1.5, j) * N);
+		cc[j] = min(1.0, lambda / (pow(4.0, j) * N));
+	}
+	MatrixXd paths = MatrixXd::Zero(N, numPaths), arx(N, (int)lambda), arz(N, (int)lambda), ard(N, (int)lambda);
+	vector<double> arfitness(lambda);
+	vector<unsigned int> arindex(lambda);
+	normal_distribution<double> distribution(0, 1);
+	unsigned int counteval = 0;
+	CMAESState state;
+	if (loadCMAESState(checkpoint, state, CMAES_LIMITED_MEMORY, N, lambda, generator, distribution)) {
+		if (state.header.counteval >= numIterations)
+			return state.best;
+		counteval = (unsigned int)state.header.counteval;
+		sigma = state.header.sigma;
+		usedPaths = (unsigned int)min<uint64_t>(state.header.usedPaths, numPaths);
+		xmean = state.xmean;
+		ps = state.ps;
+		paths = state.paths;
+	}
+	for (; counteval < numIterations;) {
+		PROFILE_SCOPE(PROFILE_CMAES_GENERATION);
+		// Sample the population, x = xmean + sigma * d with d the transformed z
+		for (unsigned int k = 0; k < lambda; k++) {
+			for (unsigned int i = 0; i < N; i++)
+				arz(i, k) = distribution(generator);
+			ard.col(k) = arz.col(k);
+			for (unsigned int j = 0; j < usedPaths; j++)
+				ard.col(k) = (1.0 - cd[j]) * ard.col(k) + cd[j] * paths.col(j) * paths.col(j).dot(ard.col(k));
+			arx.col(k) = xmean + sigma * ard.col(k);
+		}
+		evaluatePopulation(arx, arfitness, counteval / lambda + 1);
+		for (unsigned int i = 0; i < lambda; i++)
+			arfitness[i] *= (minimize ? 1 : -1);
+		counteval += lambda;
+		for (unsigned int i = 0; i < lambda; ++i)
+			arindex[i] = i;
+		std::sort(arindex.begin(), arindex.end(), [&arfitness](unsigned int i1, unsigned int i2) {return arfitness[i1] < arfitness[i2]; });
+		zmean.setZero();
+		dmean.setZero();
+		for (unsigned int i = 0; i < (unsigned int)mu; i++) {
+			zmean += weights[i] * arz.col(arindex[i]);
+			dmean += weights[i] * ard.col(arindex[i]);
+		}
+		ps = (1.0 - cs) * ps + sqrt(mueff * cs * (2.0 - cs)) * zmean;
+		for (unsigned int j = 0; j < numPaths; j++)
+			paths.col(j) = (1.0 - cc[j]) * paths.col(j) + sqrt(mueff * cc[j] * (2.0 - cc[j])) * zmean;
+		usedPaths = min(usedPaths + 1, numPaths);
+		xmean += sigma * dmean;
+		sigma = sigma * exp((cs / 2.0) * (ps.squaredNorm() / N - 1.0));
+		if (checkpoint != NULL && checkpoint->due(counteval >= numIterations)) {
+			state.header.usedPaths = usedPaths;
+			state.xmean = xmean;
+			state.ps = ps;
+			state.paths = paths;
+			state.best = arx.col(arindex[0]);
+			saveCMAESState(checkpoint, state, CMAES_LIMITED_MEMORY, N, lambda, counteval, sigma, generator, distribution);
+		}
+	}
+	return arx.col(arindex[0]);
+}
+
+// Runs the CMA-ES variant selected by variant
+template<typename EvaluatePopulation>
+static VectorXd CMAESVariantImpl(const VectorXd& initialMean, const double& initialSigma, const unsigned int& numIterations,
+	const bool& minimize, Philox& generator, const CMAESVariant& variant, CMAESCheckpoint* checkpoint, EvaluatePopulation evaluatePopulation)
+{
+	if (variant == CMAES_SEPARABLE)
+		return SepCMAESImpl(initialMean, initialSigma, numIterations, minimize, generator, checkpoint, evaluatePopulation);
+	if (variant == CMAES_LIMITED_MEMORY)
+		return LMCMAESImpl(initialMean, initialSigma, numIterations, minimize, generator, checkpoint, evaluatePopulation);
+	return CMAESImpl(initialMean, initialSigma, numIterations, minimize, generator, checkpoint, evaluatePopulation);
+}
+
+CMAESVariant parseCMAESVariant(const string& name) {
+	if (name == "full")
+		return CMAES_FULL;
+	if (name == "sep")
+		return CMAES_SEPARABLE;
+	if (name == "lm")
+		return CMAES_LIMITED_MEMORY;
+	throw invalid_argument("unknown CMA-ES variant '" + name + "', expected full, sep or lm");
+}
+
+/*
+This function implements CMA-ES (http://en.wikipedia.org/wiki/CMA-ES). Return
+value is the minimizer / maximizer. This code is written for brevity, not clarity.
+See the link above for a description of what this code is doing.
+
+The solutions of a generation are evaluated in parallel, so f must be safe to call from several threads
+at once. The call for solution i of generation g (counted from 1) gets its own generator,
+generator.getStream(g, i), so the evaluations never share a generator.
+
+If checkpoint is not NULL, a search resumes from the state saved in it, if any, and saves its state to it
+periodically and when it finishes; a resumed search returns the same solution as an uninterrupted one.
+*/
+VectorXd CMAES(
+	const VectorXd& initialMean,											// Starting point of the search
+	const double& initialSigma,												// Initial standard deviation of the search around initialMean
+	const unsigned int& numIterations,										// Number of iterations to run before stopping
+	// f, below, is the function to be optimized. Its first argument is the solution (a view of a column of the population), the middle arguments are variables required by f (listed below), and the last is a random number generator.
+	double(*f)(const Ref<const VectorXd>& theta, const void* params[], Philox& generator),
+	const void* params[],													// Parrameters of f other than theta
+	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
+	Philox& generator,														// The random number generator to use
+	const CMAESVariant& variant,											// The covariance model to use
+	CMAESCheckpoint* checkpoint)											// Where to save the state of the search, or NULL
+{
+	return CMAESVariantImpl(initialMean, initialSigma, numIterations, minimize, generator, variant, checkpoint, [&](const MatrixXd& arx, vector<double>& arfitness, uint64_t generation) {
+		// generator itself is only used by this thread to sample the population; solution i is evaluated
+		// with its own stream whichever thread evaluates it
+		parallelFor(0, arx.cols(), [&](size_t i) {
+			Philox evalGenerator = generator.getStream(generation, i);
+			arfitness[i] = f(arx.col(i), params, evalGenerator);
+		});
+	});
+}
+
+/*
+CMA-ES with a batch objective: f is called once per generation with the whole population (one solution
+per column) and returns the value of every solution, so that it can evaluate them all in one pass.
+*/
+VectorXd CMAES(
+	const VectorXd& initialMean,											// Starting point of the search
+	const double& initialSigma,												// Initial standard deviation of the search around initialMean
+	const unsigned int& numIterations,										// Number of iterations to run before stopping
+	// f, below, is the batch function to be optimized. Its first argument holds the solutions, one per column.
+	VectorXd(*f)(const MatrixXd& thetas, const void* params[], Philox& generator),
+	const void* params[],													// Parrameters of f other than thetas
+	const bool& minimize,													// If true, we will try to minimize f. Otherwise we will try to maximize f
+	Philox& generator,														// The random number generator to use
+	const CMAESVariant& variant,											// The covariance model to use
+	CMAESCheckpoint* checkpoint)											// Where to save the state of the search, or NULL
+{
+	return CMAESVariantImpl(initialMean, initialSigma, numIterations, minimize, generator, variant, checkpoint, [&](const MatrixXd& arx, vector<double>& arfitness, uint64_t) {
+		VectorXd values = f(arx, params, generator);
+		for (unsigned int i = 0; i < arx.cols(); i++)
+			arfitness[i] = values[i];
+	});
 }
\ No newline at end of file
@@ -42,6 +42,28 @@ double var(const std::vector<double> & v) {
 	return result / (double)(v.size() - 1);
 }
 
+// The shifted logits of all rows are exponentiated with one vecExp call, and the probability of the
+// selected action is read off the exponentiated row instead of calling exp again
+void softmaxSelect(const double * logits, int numActions, int rowStride, const int * actions, size_t count, double * out, bool logProbs) {
+	vector<double> shifted(count * numActions);
+	for (size_t r = 0; r < count; r++) {
+		const double * row = logits + r * rowStride;
+		double maxLogit = row[0];
+		for (int i = 1; i < numActions; i++)
+			maxLogit = max(maxLogit, row[i]);
+		for (int i = 0; i < numActions; i++)
+			shifted[r * numActions + i] = row[i] - maxLogit;
+		out[r] = shifted[r * numActions + actions[r]];
+	}
+	vecExp(shifted.data(), shifted.data(), shifted.size());
+	for (size_t r = 0; r < count; r++) {
+		double total = 0;
+		for (int i = 0; i < numActions; i++)
+			total += shifted[r * numActions + i];
+		out[r] = (logProbs ? out[r] - log(total) : shifted[r * numActions + actions[r]] / total);
+	}
+}
+
 /*
 Floating-point modulo:
 The result (the remainder) has same sign as the divisor.
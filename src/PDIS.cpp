@@ -2,51 +2,342 @@
 #include "stdafx.h"
 
 
+// Number of consecutive episodes whose evaluation policy probabilities are computed with one
+// batched policy call. Their steps are contiguous in the store, so a block is a single call.
+const int PDIS_BLOCK_EPISODES = 256;
+
+// Number of evaluation policies whose probabilities of a block are computed together. A batch of many
+// policies (see GenerationBatcher) is scored a group at a time, so that the probabilities of a block
+// under the policies of a group stay in cache.
+const int PDIS_GROUP_POLICIES = 32;
+
+// log of the importance weight below which the rest of an episode is skipped (see setPDISWeightTolerance)
+static double logWeightTolerance = log(PDIS_DEFAULT_WEIGHT_TOLERANCE);
+
+// Steps processed and skipped by all PDIS calls so far
+static std::atomic<uint64_t> stepsEvaluated(0), stepsSkipped(0);
+
+// Per thread buffers for the block being processed. A block task never waits for other tasks, so no
+// other block can run on the same thread while the buffers are in use.
+static thread_local std::vector<double> blockProbs, blockLogBehavior, blockMaxLogGrowth;
+
+void
+setPDISWeightTolerance(double tolerance)
+{
+	logWeightTolerance = (tolerance > 0.0 ? log(tolerance) : -INFINITY);
+}
+
+double
+getPDISWeightTolerance()
+{
+	return exp(logWeightTolerance);
+}
+
+PDISStepCounts
+getPDISStepCounts()
+{
+	return PDISStepCounts{stepsEvaluated.load(), stepsSkipped.load()};
+}
+
+/*		Computes the behavior policy log-probabilities of the steps of a block of episodes, and for every
+		step the largest amount by which the log importance weight can still grow over the rest of its
+		episode. The evaluation policy probability of a step is at most 1, so the weight can grow by at
+		most -log(behavior probability) per step.
+
+	:param D: the data
+	:param first: first episode of the block
+	:param last: one past the last episode of the block
+	:param logBehavior: receives the behavior log-probabilities of the block's steps
+	:param maxLogGrowth: receives the bound on the log weight growth after each of the block's steps
+*/
+static void
+behaviorLogBounds(const TrajectoryStore &D, int first, int last, std::vector<double> &logBehavior,
+				  std::vector<double> &maxLogGrowth)
+{
+	size_t begin = D.episodeBegin(first), count = D.episodeEnd(last - 1) - begin;
+	logBehavior.resize(count);
+	maxLogGrowth.resize(count);
+	for(int i = first; i < last; i++)
+	{
+		double growth = 0.0;
+		for(size_t t = D.episodeEnd(i); t-- > D.episodeBegin(i);)
+		{
+			logBehavior[t - begin] = log(D.getBehaviorProb(t));
+			maxLogGrowth[t - begin] = growth;
+			growth -= logBehavior[t - begin];
+		}
+	}
+}
+
+/*		The importance sampled return of one episode, with the importance weight accumulated as a
+		log-weight. Once the weight and every weight it can still reach in the episode are below the
+		tolerance, the remaining steps are skipped and counted in skipped.
+
+	:param logProbs: evaluation policy log-probabilities of the steps of the episode's block
+	:param logBehavior, maxLogGrowth: output of behaviorLogBounds for the episode's block
+	:param begin: first step of the episode's block
+*/
+static inline double
+PDISEpisode(const TrajectoryStore &D, int episode, size_t begin, const double * logProbs,
+			const std::vector<double> &logBehavior, const std::vector<double> &maxLogGrowth,
+			uint64_t &skipped)
+{
+	double log_weight = 0.0, pdis = 0.0;
+	size_t end = D.episodeEnd(episode);
+	for(size_t t = D.episodeBegin(episode); t < end; t++)
+	{
+		// the behavior policy action probabilities were computed and stored in the
+		// trajectory store by augmentData before running PDIS, so B.getProb(state, action)
+		// does not need to be evaluated here
+		log_weight += logProbs[t - begin] - logBehavior[t - begin];
+		pdis += exp(log_weight) * D.getReward(t);
+		if(log_weight + maxLogGrowth[t - begin] < logWeightTolerance)
+		{
+			skipped += end - t - 1;
+			break;
+		}
+	}
+	return pdis;
+}
+
+/*		Shared body of the PDIS variants. Episodes are processed in blocks, and every block is scored
+		against all numPolicies evaluation policies while it is in cache, PDIS_GROUP_POLICIES policies at a
+		time: getBlockProbs(first, count, begin, end, out) writes count rows of the log-probabilities of steps
+		[begin, end) under policies first, ..., first + count - 1 to out. The importance sampled
+		returns are folded into RunningStats per block and policy, and the blocks are merged in order, so the
+		result does not depend on the number of threads.
+
+	Returns the statistics of the importance sampled returns of each evaluation policy
+*/
+template<typename BlockProbs>
+static std::vector<RunningStats>
+PDISStatsMulti(const TrajectoryStore &D, int numPolicies, BlockProbs getBlockProbs)
+{
+	PROFILE_SCOPE(PROFILE_PDIS);
+	int numEpisodes = (int)D.getNumEpisodes();
+	int numBlocks = (numEpisodes + PDIS_BLOCK_EPISODES - 1) / PDIS_BLOCK_EPISODES;
+	std::vector<RunningStats> blockStats((size_t)numBlocks * numPolicies);
+	std::vector<uint64_t> blockSkipped(numBlocks, 0);
+	parallelFor(0, numBlocks, [&](size_t b)
+	{
+		int first = (int)b * PDIS_BLOCK_EPISODES, last = std::min(numEpisodes, first + PDIS_BLOCK_EPISODES);
+		size_t begin = D.episodeBegin(first), end = D.episodeEnd(last - 1), count = end - begin;
+		// the behavior terms are shared by all policies, so they are computed once per block
+		behaviorLogBounds(D, first, last, blockLogBehavior, blockMaxLogGrowth);
+		for(int group = 0; group < numPolicies; group += PDIS_GROUP_POLICIES)
+		{
+			int groupSize = std::min(PDIS_GROUP_POLICIES, numPolicies - group);
+			blockProbs.resize(count * groupSize);
+			getBlockProbs(group, groupSize, begin, end, blockProbs.data());
+			for(int k = 0; k < groupSize; k++)
+			{
+				const double * policyProbs = &blockProbs[k * count];
+				RunningStats &stats = blockStats[b * numPolicies + group + k];
+				for(int i = first; i < last; i++)
+					stats.add(PDISEpisode(D, i, begin, policyProbs, blockLogBehavior, blockMaxLogGrowth, blockSkipped[b]));
+			}
+		}
+	});
+	uint64_t skipped = 0;
+	for(auto s : blockSkipped)
+		skipped += s;
+	stepsEvaluated += D.getNumSteps() * numPolicies - skipped;
+	stepsSkipped += skipped;
+	PROFILE_COUNT(PROFILE_EPISODES, (uint64_t)numEpisodes * numPolicies);
+	PROFILE_COUNT(PROFILE_STEPS, D.getNumSteps() * numPolicies - skipped);
+
+	std::vector<RunningStats> result(numPolicies);
+	for(int k = 0; k < numPolicies; k++)
+		for(int b = 0; b < numBlocks; b++)
+			result[k].merge(blockStats[(size_t)b * numPolicies + k]);
+	return result;
+}
+
+/*		PDISStatsMulti reduced to the sample mean and standard deviation of each evaluation policy
+*/
+template<typename BlockProbs>
+static std::vector<std::pair<double, double>>
+PDISBlocksMulti(const TrajectoryStore &D, int numPolicies, BlockProbs getBlockProbs)
+{
+	std::vector<RunningStats> stats = PDISStatsMulti(D, numPolicies, getBlockProbs);
+	std::vector<std::pair<double, double>> result(numPolicies);
+	for(int k = 0; k < numPolicies; k++)
+		result[k] = std::pair<double, double>(stats[k].mean, stats[k].stddev());
+	return result;
+}
+
+/*		Shared body of the single policy PDIS variants: PDISBlocksMulti for one policy, so the importance
+		sampled returns are folded into running statistics in one pass instead of being stored. The
+		evaluation policy log-probabilities of the steps [begin, end) of a block are computed with one
+		call to getBlockProbs(begin, end, out).
+
+	Returns the estimated sample mean and standard deviation for the expected discounted return
+	of the evaluation policy
+*/
+template<typename BlockProbs>
+static std::pair<double, double>
+PDISBlocks(const TrajectoryStore &D, BlockProbs getBlockProbs)
+{
+	return PDISBlocksMulti(D, 1, [&](int, int, size_t begin, size_t end, double * out)
+	{
+		getBlockProbs(begin, end, out);
+	})[0];
+}
+
 /*		Implementation of Per-Decision Importance Sampling (PDIS) algorithm
 
-	:param D: the data. In this case a vector of histories generated by the behavior policy
+	:param D: the data. In this case a store of histories generated by the behavior policy
 	:param e_params: the evaluation policy parameters to evaluate
-	:param E: the evaluation policy object
+	:param E: the evaluation policy object; its own parameters are not used or changed
 
 	Returns the estimated sample mean and standard deviation for the expected discounted return
 	of the evaluation policy
 */
 std::pair<double, double>
-PDIS(const std::vector<std::vector<double>> &D, const std::vector<double> e_params, Policy &E)
+PDIS(const TrajectoryStore &D, const std::vector<double> &e_params, const Policy &E)
 {
-	E.setParameters(e_params);
-	std::vector<double> pdis_array(D.size(), 0.0);
-	std::vector<double> importance_weight(D.size(), 1.0);
-	#pragma omp parallel for
-	for(int i = 0; i < D.size(); i++)
+	PolicyView policy(E, e_params.data());
+	return PDISBlocks(D, [&](size_t begin, size_t end, double * out)
 	{
-		std::vector<double> history = D[i];
-		for(int j = 0; j < history.size(); j+=4)
-		{
-			std::vector<double> state(1);
-			state[0] = history[j];
-			// the following line is commented out because the behavior policy action probabilities were
-			// computed and stored in the histories data structure before runnig PDIS
-			// importance_weight[i] *= (E.getProb(state, history[j+1]) / B.getProb(state, history[j+1]));
-			importance_weight[i] *= (E.getProb(state, history[j+1]) / history[j+3]);
-			pdis_array[i] += importance_weight[i] * history[j+2];
-		}
-	}
+		policy.getProbs(D.getState(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
 
-	double sample_mean = mean(pdis_array);
-	double total = 0.0;
-	for(auto d: pdis_array)
-		total += (d-sample_mean) * (d-sample_mean);
-	double sample_stddev = sqrt(total / ((double)pdis_array.size() - 1.0));
+/*		Per-Decision Importance Sampling (PDIS) using precomputed features of the states in D
+		instead of basifying every state for every evaluation policy
+
+	:param D: the data. In this case a store of histories generated by the behavior policy
+	:param F: a FeatureCache built from D, or from a store that D is a subset of, with E's FourierBasis;
+			  a FeatureCacheF evaluates the policy in single precision
+	:param e_params: the evaluation policy parameters to evaluate
+	:param E: the evaluation policy object; its own parameters are not used or changed
 
-	return std::pair<double, double>(sample_mean, sample_stddev);
+	Returns the estimated sample mean and standard deviation for the expected discounted return
+	of the evaluation policy
+*/
+template<typename Scalar>
+std::pair<double, double>
+PDIS(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const std::vector<double> &e_params, const FnApproxSoftmax &E)
+{
+	return PDISBlocks(D, [&](size_t begin, size_t end, double * out)
+	{
+		E.getProbsFromFeaturesMulti(e_params.data(), 1, F.getFeatures(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
+
+template std::pair<double, double>
+PDIS(const TrajectoryStore &D, const FeatureCache &F, const std::vector<double> &e_params, const FnApproxSoftmax &E);
+template std::pair<double, double>
+PDIS(const TrajectoryStore &D, const FeatureCacheF &F, const std::vector<double> &e_params, const FnApproxSoftmax &E);
+
+/*		Per-Decision Importance Sampling (PDIS) for several evaluation policies in one pass over the data
+
+	:param D: the data. In this case a store of histories generated by the behavior policy
+	:param thetas: the evaluation policy parameters to evaluate, one column per policy
+	:param E: the evaluation policy object; its own parameters are not used or changed
+
+	Returns the estimated sample mean and standard deviation for the expected discounted return
+	of each evaluation policy
+*/
+std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const MatrixXd &thetas, const Policy &E)
+{
+	int numPolicies = (int)thetas.cols();
+	return PDISBlocksMulti(D, numPolicies, [&](int first, int count, size_t begin, size_t end, double * out)
+	{
+		E.getProbsMulti(thetas.col(first).data(), count, D.getState(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
+
+/*		Per-Decision Importance Sampling (PDIS) for several evaluation policies in one pass over the data,
+		using precomputed features of the states in D
+
+	:param D: the data. In this case a store of histories generated by the behavior policy
+	:param F: a FeatureCache built from D, or from a store that D is a subset of, with E's FourierBasis;
+			  a FeatureCacheF evaluates the policies in single precision
+	:param thetas: the evaluation policy parameters to evaluate, one column per policy
+	:param E: the evaluation policy object; its own parameters are not used or changed
+
+	Returns the estimated sample mean and standard deviation for the expected discounted return
+	of each evaluation policy
+*/
+template<typename Scalar>
+std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const MatrixXd &thetas, const FnApproxSoftmax &E)
+{
+	int numPolicies = (int)thetas.cols();
+	return PDISBlocksMulti(D, numPolicies, [&](int first, int count, size_t begin, size_t end, double * out)
+	{
+		E.getProbsFromFeaturesMulti(thetas.col(first).data(), count, F.getFeatures(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
+
+template std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const FeatureCache &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+template std::vector<std::pair<double, double>>
+PDIS(const TrajectoryStore &D, const FeatureCacheF &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+
+/*		Per-Decision Importance Sampling (PDIS) for several evaluation policies in one pass over the data,
+		returning the sufficient statistics of the importance sampled returns instead of their mean and
+		standard deviation. The statistics of disjoint parts of a data set (e.g. the shards of a sharded
+		run, see ShardedHCOPI.hpp) merge into those of the whole.
+
+	:param D: the data. In this case a store of histories generated by the behavior policy
+	:param thetas: the evaluation policy parameters to evaluate, one column per policy
+	:param E: the evaluation policy object; its own parameters are not used or changed
+
+	Returns the statistics of the importance sampled returns of each evaluation policy
+*/
+std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const MatrixXd &thetas, const Policy &E)
+{
+	int numPolicies = (int)thetas.cols();
+	return PDISStatsMulti(D, numPolicies, [&](int first, int count, size_t begin, size_t end, double * out)
+	{
+		E.getProbsMulti(thetas.col(first).data(), count, D.getState(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
+
+/*		PDISStats using precomputed features of the states in D, see PDIS
+
+	Returns the statistics of the importance sampled returns of each evaluation policy
+*/
+template<typename Scalar>
+std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const FeatureCacheT<Scalar> &F, const MatrixXd &thetas, const FnApproxSoftmax &E)
+{
+	int numPolicies = (int)thetas.cols();
+	return PDISStatsMulti(D, numPolicies, [&](int first, int count, size_t begin, size_t end, double * out)
+	{
+		E.getProbsFromFeaturesMulti(thetas.col(first).data(), count, F.getFeatures(begin), D.getActions(begin), end - begin, out, true);
+	});
+}
+
+template std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const FeatureCache &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+template std::vector<RunningStats>
+PDISStats(const TrajectoryStore &D, const FeatureCacheF &F, const MatrixXd &thetas, const FnApproxSoftmax &E);
+
+/*		The HCOPE objective given the PDIS estimate of a policy: the estimate itself if the predicted
+		t-test lower bound on Ds is above the constraint, and the barrier otherwise
+*/
+double
+HCOPEObjective(std::pair<double, double> mean_dev, int sSize, double delta, double c)
+{
+	double result;
+	double ttest_estimate = mean_dev.first - 2.0*(mean_dev.second / sqrt(sSize))*tinv(1.0 - delta, (unsigned int)sSize - 1u);
+	if(ttest_estimate < c)
+		result = -100000.0 + ttest_estimate;
+	else
+		result = mean_dev.first;
+	return result;
 }
 
 /*		Implements the High Confidence Off-Policy Evaluation (HCOPE) algorithm using 
 		a Student's t distribution to compute confidence bounds
 
 	:param theta: the parameter vector to evaluate
-	:param params: pointer to the data and evaluation criteria parameters
+	:param params: params[0] points to the HCOPEParams holding the data and evaluation criteria
 	:param generator: a RNG
 
 	Returns the lower bound on the expected discounted return of the policy parameterized
@@ -54,26 +345,56 @@ PDIS(const std::vector<std::vector<double>> &D, const std::vector<double> e_para
 	some shaping using the expected discounted return estimate.
 */
 double
-HCOPE(const VectorXd &theta, const void * params[], mt19937_64& generator)
+HCOPE(const Ref<const VectorXd> &theta, const void * params[], Philox& /*generator*/)
 {
+	PROFILE_SCOPE(PROFILE_HCOPE);
 	std::vector<double> epolicy_vec(theta.size());
 	for(int i = 0; i < theta.size(); i++)
 		epolicy_vec[i] = theta[i];
 
-	const std::vector<std::vector<double>>* Dc = (const std::vector<std::vector<double>>*)params[0];
-	const int* sSize = (const int*)params[1];
-	const double* delta = (const double*)params[2];
-	const double* c = (const double*)params[3];
-	Policy* E = (Policy*)params[4];
+	const HCOPEParams* p = (const HCOPEParams*)params[0];
+	// the feature caches hold FnApproxSoftmax features; other policies evaluate the states themselves
+	const FnApproxSoftmax* fnE = dynamic_cast<const FnApproxSoftmax*>(p->E);
 
-	std::pair<double, double> mean_dev = PDIS(*Dc, epolicy_vec, *E);
+	std::pair<double, double> mean_dev;
+	if(p->searchFeatures && fnE)
+		mean_dev = PDIS(*p->Dc, *p->searchFeatures, epolicy_vec, *fnE);
+	else if(p->features && fnE)
+		mean_dev = PDIS(*p->Dc, *p->features, epolicy_vec, *fnE);
+	else
+		mean_dev = PDIS(*p->Dc, epolicy_vec, *p->E);
 
-	double result;
-	double ttest_estimate = mean_dev.first - 2.0*(mean_dev.second / sqrt(*sSize))*tinv(1.0 - (*delta), (unsigned int)(*sSize) - 1u);
-	if(ttest_estimate < (*c))
-		result = -100000.0 + ttest_estimate;
+	return HCOPEObjective(mean_dev, p->sSize, p->delta, p->c);
+}
+
+/*		HCOPE for a whole population of parameter vectors, which are all scored in a single pass
+		over the candidate data. Used by CMA-ES to evaluate one generation at a time.
+
+	:param thetas: the parameter vectors to evaluate, one column per candidate
+	:param params: pointer to the data and evaluation criteria parameters, as for HCOPE
+	:param generator: a RNG; it is not used
+
+	Returns the HCOPE value of every column of thetas.
+*/
+VectorXd
+HCOPEBatch(const MatrixXd &thetas, const void * params[], Philox& /*generator*/)
+{
+	PROFILE_SCOPE(PROFILE_HCOPE);
+	const HCOPEParams* p = (const HCOPEParams*)params[0];
+	// the feature caches hold FnApproxSoftmax features; other policies evaluate the states themselves
+	const FnApproxSoftmax* fnE = dynamic_cast<const FnApproxSoftmax*>(p->E);
+
+	std::vector<std::pair<double, double>> mean_devs;
+	if(p->searchFeatures && fnE)
+		mean_devs = PDIS(*p->Dc, *p->searchFeatures, thetas, *fnE);
+	else if(p->features && fnE)
+		mean_devs = PDIS(*p->Dc, *p->features, thetas, *fnE);
 	else
-		result = mean_dev.first;
+		mean_devs = PDIS(*p->Dc, thetas, *p->E);
+
+	VectorXd result(thetas.cols());
+	for(int i = 0; i < thetas.cols(); i++)
+		result[i] = HCOPEObjective(mean_devs[i], p->sSize, p->delta, p->c);
 	return result;
 }
 
@@ -84,22 +405,132 @@ HCOPE(const VectorXd &theta, const void * params[], mt19937_64& generator)
 	:param delta: confidence interval used in the Student's t distribution
 	:param c: the expected dsicounted return minimum constraint
 	:param E: evluation policy object
+	:param features: optional FeatureCache covering Ds; when given, E must be a FnApproxSoftmax
 
 	Returns true if the parameter vector passes the safety test and false otherwise.
 */
 bool
-safetyTest(VectorXd theta, std::vector<std::vector<double>> &Ds, double delta, double c, Policy &E)
+safetyTest(VectorXd theta, const TrajectoryStore &Ds, double delta, double c, const Policy &E, const FeatureCache *features)
 {
+	PROFILE_SCOPE(PROFILE_SAFETY_TEST);
 	std::vector<double> epolicy_vec(theta.size());
 	for(int i = 0; i < theta.size(); i++)
 		epolicy_vec[i] = theta[i];
 
-	std::pair<double, double> mean_dev = PDIS(Ds, epolicy_vec, E);
+	std::pair<double, double> mean_dev;
+	if(features)
+		mean_dev = PDIS(Ds, *features, epolicy_vec, dynamic_cast<const FnApproxSoftmax&>(E));
+	else
+		mean_dev = PDIS(Ds, epolicy_vec, E);
 
-	double ttest_estimate = mean_dev.first - (mean_dev.second / sqrt(Ds.size()))*tinv(1.0 - delta, (unsigned int)(Ds.size()) - 1u);
+	double ttest_estimate = mean_dev.first - (mean_dev.second / sqrt(Ds.getNumEpisodes()))*tinv(1.0 - delta, (unsigned int)(Ds.getNumEpisodes()) - 1u);
 	return (ttest_estimate >= c);
 }
 
+/*		The lower bound of the safety test given the PDIS statistics of a policy on the safety data
+
+	:param stats: statistics of the importance sampled returns of the policy on Ds, see PDISStats
+	:param delta: confidence interval used in the Student's t distribution
+
+	Returns the (1 - delta)-confidence Student's t lower bound on the expected discounted return of the
+	policy, or -infinity while there are fewer than two episodes.
+*/
+double
+safetyTestBound(const RunningStats &stats, double delta)
+{
+	if(stats.n < 2)
+		return -INFINITY;
+	return stats.mean - (stats.stddev() / sqrt(stats.n))*tinv(1.0 - delta, (unsigned int)stats.n - 1u);
+}
+
+/*		The safety test of a policy given the PDIS statistics of the whole safety data, e.g. merged from
+		the statistics of its shards
+
+	:param stats: statistics of the importance sampled returns of the policy on Ds, see PDISStats
+	:param delta: confidence interval used in the Student's t distribution
+	:param c: the expected dsicounted return minimum constraint
+
+	Returns true if the policy passes the safety test and false otherwise.
+*/
+bool
+safetyTest(const RunningStats &stats, double delta, double c)
+{
+	return (safetyTestBound(stats, delta) >= c);
+}
+
+/*		Runs the safety tests of several parameter vectors in one pass over the safety data
+
+	:param thetas: the parameters to test, one column per parameter vector
+	:param Ds: the safety data to test the parameters on
+	:param deltas: confidence interval used in the Student's t distribution, one per column of thetas
+	:param cs: the expected dsicounted return minimum constraint, one per column of thetas
+	:param E: evluation policy object
+	:param features: optional FeatureCache covering Ds; when given, E must be a FnApproxSoftmax
+
+	Returns for every column of thetas whether it passes its safety test.
+*/
+std::vector<bool>
+safetyTest(const MatrixXd &thetas, const TrajectoryStore &Ds, const std::vector<double> &deltas, const std::vector<double> &cs, const Policy &E, const FeatureCache *features)
+{
+	PROFILE_SCOPE(PROFILE_SAFETY_TEST);
+	std::vector<std::pair<double, double>> mean_devs;
+	if(features)
+		mean_devs = PDIS(Ds, *features, thetas, dynamic_cast<const FnApproxSoftmax&>(E));
+	else
+		mean_devs = PDIS(Ds, thetas, E);
+
+	std::vector<bool> result(thetas.cols());
+	for(int i = 0; i < thetas.cols(); i++)
+	{
+		double ttest_estimate = mean_devs[i].first - (mean_devs[i].second / sqrt(Ds.getNumEpisodes()))*tinv(1.0 - deltas[i], (unsigned int)(Ds.getNumEpisodes()) - 1u);
+		result[i] = (ttest_estimate >= cs[i]);
+	}
+	return result;
+}
+
+/*		Candidate selection step of the High Confidence Off-Policy Improvement (HCOPI) algorithm. Searches
+		for the parameters maximizing HCOPE on the candidate data, scoring every CMA-ES generation in a
+		single pass over the data.
+
+	:param Dc: data to evaluate candidate solutions on
+	:param sSize: number of episodes in the safety data, used to predict the safety test's bound
+	:param delta: confidence interval used in the Student's t distribution
+	:param c: the expected dsicounted return minimum constraint
+	:param e_params: initial evaluation policy parameters
+	:param E: evluation policy object
+	:param generator: a RNG
+	:param features: optional FeatureCache covering Dc; when given, E must be a FnApproxSoftmax
+	:param variant: covariance model of the CMA-ES search; CMAES_SEPARABLE or CMAES_LIMITED_MEMORY for
+					policies with too many parameters for a dense covariance matrix
+	:param searchFeatures: optional single precision FeatureCacheF covering Dc; when given, candidates are
+						   evaluated with it instead of features, and E must be a FnApproxSoftmax
+	:param checkpoint: optional checkpoint the CMA-ES search resumes from and saves its state to
+
+	Returns the best parameters found.
+*/
+VectorXd
+candidateSelection(const TrajectoryStore &Dc, int sSize, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, const FeatureCache *features, CMAESVariant variant, const FeatureCacheF *searchFeatures, CMAESCheckpoint *checkpoint)
+{
+	PROFILE_SCOPE(PROFILE_CANDIDATE_SELECTION);
+	VectorXd initsol(e_params.size());
+	for(int i = 0; i < e_params.size(); i++)
+		initsol[i] = e_params[i];
+
+	const VectorXd initialSolution = initsol;
+	double initialSigma = 2.0*(initialSolution.dot(initialSolution) + 1.0);	// A heuristic to select the width of the search based on the weight magnitudes we expect to see.
+	int numIterations = 100;
+	bool minimize = false;
+
+	if((features || searchFeatures) && !dynamic_cast<const FnApproxSoftmax*>(&E))
+		throw std::invalid_argument("candidateSelection: a FeatureCache can only be used with a FnApproxSoftmax policy");
+
+	HCOPEParams hcopeParams = {&Dc, sSize, delta, c, &E, features, searchFeatures};
+	const void* params[1];
+	params[0] = &hcopeParams;
+
+	return CMAES(initialSolution, initialSigma, numIterations, HCOPEBatch, params, minimize, generator, variant, checkpoint);
+}
+
 /*		Implements the High Confidence Off-Policy Improvement (HCOPI) algorithm
 
 	:param Dc: data to evaluate candidate solutions on
@@ -109,33 +540,142 @@ safetyTest(VectorXd theta, std::vector<std::vector<double>> &Ds, double delta, d
 	:param e_params: initial evaluation policy parameters
 	:param E: evluation policy object
 	:param generator: a RNG
+	:param features: optional FeatureCache covering both Dc and Ds (e.g. built from the store they are
+					 subsets of), kept for the whole run so that no state is basified during the
+					 optimization; when given, E must be a FnApproxSoftmax
+	:param variant: covariance model of the CMA-ES search, see candidateSelection
+	:param searchFeatures: optional FeatureCacheF covering Dc for a single precision candidate search; the
+						   safety test always runs in double, with features if given
 
 	Returns the best parameters found by the algorithm and a boolean variable denoting
 	whether or not these parameters passed the safety test.
 */
 std::pair<VectorXd, bool>
-HCOPI(std::vector<std::vector<double>> &Dc, std::vector<std::vector<double>> &Ds, double delta, double c, std::vector<double> e_params, Policy &E, mt19937_64 &generator)
+HCOPI(const TrajectoryStore &Dc, const TrajectoryStore &Ds, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, const FeatureCache *features, CMAESVariant variant, const FeatureCacheF *searchFeatures)
+{
+	std::pair<VectorXd, bool> result;
+	result.first = candidateSelection(Dc, (int)Ds.getNumEpisodes(), delta, c, e_params, E, generator, features, variant, searchFeatures);
+	result.second = safetyTest(result.first, Ds, delta, c, E, features);
+	return result;
+}
+
+/*		Per-Decision Importance Sampling (PDIS) for several evaluation policies in one pass over a data set
+		streamed from its file, for data sets larger than memory. Every chunk of the stream is scored with
+		PDISStats and its statistics are merged in order, so only the chunks of the pass and one
+		RunningStats per block of a chunk and policy are ever held.
+
+	:param D: the data, streamed from a data file
+	:param thetas: the evaluation policy parameters to evaluate, one column per policy
+	:param E: the evaluation policy object; its own parameters are not used or changed
+
+	Returns the statistics of the importance sampled returns of each evaluation policy
+*/
+std::vector<RunningStats>
+PDISStats(const DataFileStream &D, const MatrixXd &thetas, const Policy &E)
 {
+	std::vector<RunningStats> result(thetas.cols());
+	D.forEachChunk([&](const TrajectoryStore &chunk)
+	{
+		std::vector<RunningStats> chunkStats = PDISStats(chunk, thetas, E);
+		for(size_t k = 0; k < result.size(); k++)
+			result[k].merge(chunkStats[k]);
+	});
+	return result;
+}
+
+/*		HCOPEBatch on candidate data evaluated by a GenerationBatcher, together with the generations of the
+		other searches of the batcher
+
+	:param params: [0] the GenerationBatcher, [1] sSize, [2] delta, [3] c, see HCOPEBatch
+*/
+static VectorXd
+HCOPEBatcher(const MatrixXd &thetas, const void * params[], Philox& /*generator*/)
+{
+	PROFILE_SCOPE(PROFILE_HCOPE);
+	GenerationBatcher* batcher = (GenerationBatcher*)params[0];
+	const int* sSize = (const int*)params[1];
+	const double* delta = (const double*)params[2];
+	const double* c = (const double*)params[3];
+
+	std::vector<RunningStats> stats = batcher->evaluate(thetas);
+	VectorXd result(thetas.cols());
+	for(int i = 0; i < thetas.cols(); i++)
+		result[i] = HCOPEObjective(std::pair<double, double>(stats[i].mean, stats[i].stddev()), *sSize, *delta, *c);
+	return result;
+}
+
+/*		Runs the safety tests of several parameter vectors in one pass over safety data streamed from its file
+
+	:param thetas: the parameters to test, one column per parameter vector
+	:param Ds: the safety data, streamed from a data file
+	:param deltas: confidence interval used in the Student's t distribution, one per column of thetas
+	:param cs: the expected dsicounted return minimum constraint, one per column of thetas
+	:param E: evluation policy object
+
+	Returns for every column of thetas whether it passes its safety test.
+*/
+std::vector<bool>
+safetyTest(const MatrixXd &thetas, const DataFileStream &Ds, const std::vector<double> &deltas, const std::vector<double> &cs, const Policy &E)
+{
+	PROFILE_SCOPE(PROFILE_SAFETY_TEST);
+	std::vector<RunningStats> stats = PDISStats(Ds, thetas, E);
+	std::vector<bool> result(thetas.cols());
+	for(int i = 0; i < thetas.cols(); i++)
+		result[i] = safetyTest(stats[i], deltas[i], cs[i]);
+	return result;
+}
+
+/*		Candidate selection step of HCOPI (see candidateSelection) on candidate data that is evaluated by a
+		GenerationBatcher, e.g. streamed from its file or held by the workers of a sharded run. Every CMA-ES
+		generation is scored in the batcher's pass, together with the generations of its other searches.
+
+	:param batcher: the batcher of the candidate data, which this search must have joined
+	:param sSize: number of episodes in the safety data, used to predict the safety test's bound
+	:param delta: confidence interval used in the Student's t distribution
+	:param c: the expected dsicounted return minimum constraint
+	:param e_params: initial evaluation policy parameters
+	:param generator: a RNG
+	:param variant: covariance model of the CMA-ES search
+	:param checkpoint: optional checkpoint the CMA-ES search resumes from and saves its state to
+
+	Returns the best parameters found.
+*/
+VectorXd
+candidateSelection(GenerationBatcher &batcher, int sSize, double delta, double c, std::vector<double> e_params, Philox &generator, CMAESVariant variant, CMAESCheckpoint *checkpoint)
+{
+	PROFILE_SCOPE(PROFILE_CANDIDATE_SELECTION);
 	VectorXd initsol(e_params.size());
-	for(int i = 0; i < e_params.size(); i++)
+	for(size_t i = 0; i < e_params.size(); i++)
 		initsol[i] = e_params[i];
 
 	const VectorXd initialSolution = initsol;
-	double initialSigma = 2.0*(initialSolution.dot(initialSolution) + 1.0);	// A heuristic to select the width of the search based on the weight magnitudes we expect to see.
+	double initialSigma = 2.0*(initialSolution.dot(initialSolution) + 1.0);	// The heuristic of candidateSelection
 	int numIterations = 100;
 	bool minimize = false;
 
-	int sSize = Ds.size();
-
-	const void* params[6];
-	params[0] = &Dc;
+	const void* params[4];
+	params[0] = &batcher;
 	params[1] = &sSize;
 	params[2] = &delta;
 	params[3] = &c;
-	params[4] = &E;
 
+	return CMAES(initialSolution, initialSigma, numIterations, HCOPEBatcher, params, minimize, generator, variant, checkpoint);
+}
+
+/*		HCOPI (see above) on candidate and safety data streamed from their files
+
+	Returns the best parameters found by the algorithm and a boolean variable denoting
+	whether or not these parameters passed the safety test.
+*/
+std::pair<VectorXd, bool>
+HCOPI(const DataFileStream &Dc, const DataFileStream &Ds, double delta, double c, std::vector<double> e_params, const Policy &E, Philox &generator, CMAESVariant variant)
+{
 	std::pair<VectorXd, bool> result;
-	result.first = CMAES(initialSolution, initialSigma, numIterations, HCOPE, params, minimize, generator);
-	result.second = safetyTest(result.first, Ds, delta, c, E);
+	GenerationBatcher batcher([&](const MatrixXd &thetas) { return PDISStats(Dc, thetas, E); });
+	batcher.join(1);
+	result.first = candidateSelection(batcher, (int)Ds.getNumEpisodes(), delta, c, e_params, generator, variant);
+	batcher.leave();
+	MatrixXd theta = result.first;
+	result.second = safetyTest(theta, Ds, std::vector<double>(1, delta), std::vector<double>(1, c), E)[0];
 	return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,106 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+// Round multipliers and key increments of Philox4x64
+const uint64_t PHILOX_M0 = 0xD2E7470EE14C6C93ULL;
+const uint64_t PHILOX_M1 = 0xCA5A826395121157ULL;
+const uint64_t PHILOX_W0 = 0x9E3779B97F4A7C15ULL;
+const uint64_t PHILOX_W1 = 0xBB67AE8584CAA73BULL;
+const int PHILOX_ROUNDS = 10;
+
+/*		Constructor for the Philox class
+
+	:param seed: master seed of the run
+	:param trial: index of the trial (or other top level task) the stream belongs to
+	:param generation, candidate, episode: position of the stream within the trial
+*/
+Philox::Philox(uint64_t seed, uint64_t trial, uint64_t generation, uint64_t candidate, uint64_t episode)
+{
+	key[0] = seed;
+	key[1] = trial;
+	counter[0] = 0;
+	counter[1] = generation;
+	counter[2] = candidate;
+	counter[3] = episode;
+	used = 4;
+}
+
+/*		Skips the next n outputs by moving the block counter; only the block the new position falls into
+		is computed.
+*/
+void Philox::discard(uint64_t n)
+{
+	uint64_t position = getPosition() + n;
+	counter[0] = position / 4;
+	used = 4;
+	if(position % 4 != 0)
+	{
+		generateBlock();
+		counter[0]++;
+		used = (int)(position % 4);
+	}
+}
+
+void Philox::seed(uint64_t s)
+{
+	*this = Philox(s);
+}
+
+Philox Philox::getStream(uint64_t generation, uint64_t candidate, uint64_t episode) const
+{
+	return Philox(key[0], key[1], generation, candidate, episode);
+}
+
+/*		Computes the block of every known-answer vector of Philox4x64-10 from the Random123 distribution
+		(kat_vectors: counter, key, expected output) and compares it with the expected output
+
+	Returns true if every block matches.
+*/
+bool Philox::checkKnownAnswers()
+{
+	static const uint64_t vectors[3][10] = {
+		{0, 0, 0, 0, 0, 0,
+		 0x16554d9eca36314cULL, 0xdb20fe9d672d0fdcULL, 0xd7e772cee186176bULL, 0x7e68b68aec7ba23bULL},
+		{UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+		 0x87b092c3013fe90bULL, 0x438c3c67be8d0224ULL, 0x9cc7d7c69cd777b6ULL, 0xa09caebf594f0ba0ULL},
+		{0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL, 0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL,
+		 0x452821e638d01377ULL, 0xbe5466cf34e90c6cULL,
+		 0xa528f45403e61d95ULL, 0x38c72dbd566e9788ULL, 0xa5a1610e72fd18b5ULL, 0x57bd43b5e52b7fe6ULL}};
+	for(const auto &v : vectors)
+	{
+		Philox generator(v[4], v[5], v[1], v[2], v[3]);
+		generator.counter[0] = v[0];
+		generator.generateBlock();
+		for(int i = 0; i < 4; i++)
+			if(generator.output[i] != v[6 + i])
+				return false;
+	}
+	return true;
+}
+
+/*		Computes the four outputs of the block counter[0] of the stream
+*/
+void Philox::generateBlock()
+{
+	uint64_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint64_t k0 = key[0], k1 = key[1];
+	for(int round = 0; round < PHILOX_ROUNDS; round++)
+	{
+		unsigned __int128 p0 = (unsigned __int128)PHILOX_M0 * c0;
+		unsigned __int128 p1 = (unsigned __int128)PHILOX_M1 * c2;
+		uint64_t hi0 = (uint64_t)(p0 >> 64), lo0 = (uint64_t)p0;
+		uint64_t hi1 = (uint64_t)(p1 >> 64), lo1 = (uint64_t)p1;
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	output[0] = c0;
+	output[1] = c1;
+	output[2] = c2;
+	output[3] = c3;
+}
@@ -0,0 +1,181 @@
+// Author: npolosky
+#include "stdafx.h"
+
+// See Profiler.hpp for descriptions of each of the functions listed here. Without HCOPI_PROFILE this file
+// is empty.
+
+#ifdef HCOPI_PROFILE
+
+#include <cstdlib>
+#include <mutex>
+
+using namespace std;
+
+static const char * phaseNames[NUM_PROFILE_PHASES] =
+{
+	"read_data", "augment_data", "feature_cache", "candidate_selection", "cmaes_generation", "hcope", "pdis",
+	"safety_test"
+};
+
+static const char * counterNames[NUM_PROFILE_COUNTERS] = { "episodes", "steps", "eigen_decompositions" };
+
+// What one thread recorded for one trial
+struct TrialProfile
+{
+	uint64_t calls[NUM_PROFILE_PHASES];
+	uint64_t nanoseconds[NUM_PROFILE_PHASES];
+	uint64_t counters[NUM_PROFILE_COUNTERS];
+
+	TrialProfile() : calls(), nanoseconds(), counters() {}
+	void add(const TrialProfile &other)
+	{
+		for(int p = 0; p < NUM_PROFILE_PHASES; p++)
+		{
+			calls[p] += other.calls[p];
+			nanoseconds[p] += other.nanoseconds[p];
+		}
+		for(int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+			counters[c] += other.counters[c];
+	}
+	bool empty() const
+	{
+		for(int p = 0; p < NUM_PROFILE_PHASES; p++)
+			if(calls[p])
+				return false;
+		for(int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+			if(counters[c])
+				return false;
+		return true;
+	}
+};
+
+// The table of one thread: row trial + 1 holds the trial's records, row 0 those outside of trials. Only its
+// thread writes to it.
+struct ThreadProfile
+{
+	std::vector<TrialProfile> trials;
+};
+
+// The tables of all threads, kept until exit, when the report is written
+struct ProfileRegistry
+{
+	std::mutex lock;
+	std::vector<std::unique_ptr<ThreadProfile>> threads;
+	std::chrono::steady_clock::time_point start;
+
+	ProfileRegistry() : start(std::chrono::steady_clock::now()) {}
+
+	static void writeReportAtExit()
+	{
+		const char * env = getenv("HCOPI_PROFILE_OUTPUT");
+		string fileName = (env ? env : "profile.json");
+		ofstream out(fileName);
+		writeProfileReport(out);
+		cerr << "Profile written to " << fileName << endl;
+	}
+};
+
+static ProfileRegistry & registry()
+{
+	static ProfileRegistry r;
+	// registered once r is constructed, so the report is written before r is destroyed
+	static int registered = atexit(ProfileRegistry::writeReportAtExit);
+	(void)registered;
+	return r;
+}
+
+static thread_local ThreadProfile * threadProfile = NULL;
+static thread_local int currentTrial = -1;
+
+static TrialProfile & currentRow()
+{
+	if(!threadProfile)
+	{
+		ProfileRegistry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		r.threads.emplace_back(new ThreadProfile());
+		threadProfile = r.threads.back().get();
+	}
+	size_t row = (size_t)(currentTrial + 1);
+	if(row >= threadProfile->trials.size())
+		threadProfile->trials.resize(row + 1);
+	return threadProfile->trials[row];
+}
+
+void profileCount(ProfileCounter counter, uint64_t n)
+{
+	currentRow().counters[counter] += n;
+}
+
+void profileRecord(ProfilePhase phase, uint64_t nanoseconds)
+{
+	TrialProfile &row = currentRow();
+	row.calls[phase]++;
+	row.nanoseconds[phase] += nanoseconds;
+}
+
+int profileCurrentTrial()
+{
+	return currentTrial;
+}
+
+ProfileTrialScope::ProfileTrialScope(int trial) : previous(currentTrial)
+{
+	currentTrial = trial;
+}
+
+ProfileTrialScope::~ProfileTrialScope()
+{
+	currentTrial = previous;
+}
+
+static void writeProfile(std::ostream &out, const TrialProfile &profile, const char * indent)
+{
+	out << "\"phases\": {";
+	for(int p = 0; p < NUM_PROFILE_PHASES; p++)
+		out << (p ? ", " : "") << "\"" << phaseNames[p] << "\": {\"calls\": " << profile.calls[p] << ", \"seconds\": "
+			<< profile.nanoseconds[p] * 1e-9 << "}";
+	out << "},\n" << indent << "\"counters\": {";
+	for(int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+		out << (c ? ", " : "") << "\"" << counterNames[c] << "\": " << profile.counters[c];
+	out << "}";
+}
+
+/*		Writes the report: the totals of the run, then one entry per trial that recorded anything. Call it
+		when no profiled work is running, e.g. at exit.
+*/
+void writeProfileReport(std::ostream &out)
+{
+	ProfileRegistry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	TrialProfile total;
+	std::vector<TrialProfile> trials;
+	for(const auto &thread : r.threads)
+	{
+		if(thread->trials.size() > trials.size())
+			trials.resize(thread->trials.size());
+		for(size_t row = 0; row < thread->trials.size(); row++)
+		{
+			trials[row].add(thread->trials[row]);
+			total.add(thread->trials[row]);
+		}
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - r.start).count();
+	out.precision(6);
+	out << "{\n  \"elapsed_seconds\": " << elapsed << ",\n  \"threads\": " << r.threads.size() << ",\n  ";
+	writeProfile(out, total, "  ");
+	out << ",\n  \"trials\": [";
+	bool first = true;
+	for(size_t row = 1; row < trials.size(); row++)
+	{
+		if(trials[row].empty())
+			continue;
+		out << (first ? "\n" : ",\n") << "    {\"trial\": " << row - 1 << ",\n     ";
+		writeProfile(out, trials[row], "     ");
+		out << "}";
+		first = false;
+	}
+	out << "\n  ]\n}\n";
+}
+
+#endif
@@ -26,7 +26,7 @@ QLearning::QLearning(const int & stateDim, const int & numActions, const double
 }
 
 // Train given an (s,a,r,s') tuple. We won't be using the generator here, since the QLearning update is not random. If sPrimeTerminal==true, then after this call to train, "newEpisode" will be called - we will not train with s set to what is sPrime right now, as all subsequent rewards would be zero.
-void QLearning::train(std::mt19937_64 & generator, const std::vector<double> & s, const int & a, double & r, const std::vector<double> & sPrime, const bool & sPrimeTerminal) {
+void QLearning::train(Philox & generator, const std::vector<double> & s, const int & a, double & r, const std::vector<double> & sPrime, const bool & sPrimeTerminal) {
 	// If we haven't initialized phi, initialize it and set the flag for phiInit.
 	if (!phiInit) {
 		phi = fb.basify(s);	// fb.basify(s) returns the features for state s.
@@ -58,13 +58,13 @@ void QLearning::train(std::mt19937_64 & generator, const std::vector<double> & s
 	phi = phiPrime;
 }
 
-void QLearning::newEpisode(mt19937_64 & generator) {
+void QLearning::newEpisode(Philox & generator) {
 	// Note that phi has not been initialized during the previous call to train, as this is a new episode and the next
 	// call to train will be the first of the episode.
 	phiInit = false;
 }
 
-int QLearning::getAction(const std::vector<double> & s, std::mt19937_64 & generator) {
+int QLearning::getAction(const std::vector<double> & s, Philox & generator) {
 	// d1(generator) returns true with probability epsilon.
 	if (d1(generator))
 		return d2(generator);	// Explore. d2(generator) returns a uniform-random number from 0 to numActions-1 (see the constructor for where this distribution object was initialized)
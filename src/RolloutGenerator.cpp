@@ -0,0 +1,317 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <charconv>
+
+using namespace std;
+
+RolloutEnvironment parseRolloutEnvironment(const std::string &name)
+{
+	if(name == "gridworld")
+		return ROLLOUT_GRIDWORLD;
+	if(name == "cartpole")
+		return ROLLOUT_CARTPOLE;
+	if(name == "mountaincar")
+		return ROLLOUT_MOUNTAINCAR;
+	throw std::invalid_argument("Unknown environment " + name + " (expected gridworld, cartpole or mountaincar)");
+}
+
+/*		The episodes of one block: their columns, the csv text of their lines, the behavior probabilities
+		of the first episode of the data set (if the block holds it) and the sum of their returns
+*/
+struct RolloutBlock
+{
+	TrajectoryColumns columns;
+	std::string csv;
+	std::vector<double> firstProbs;
+	double totalReturn;
+};
+
+// Appends the shortest text that reads back as exactly x
+static void appendNumber(std::string &out, double x)
+{
+	char buffer[32];
+	char * end = to_chars(buffer, buffer + sizeof(buffer), x).ptr;
+	out.append(buffer, end);
+}
+
+/*		Simulates the episodes [first, last) of the data set
+
+	:param B: the behavior policy
+	:param maxEpisodeLength: episodes are cut after this many steps
+	:param seed: master seed; episode i uses the stream (seed, 0, 0, 0, i)
+	:param block: receives the episodes
+*/
+template<typename Env>
+static void simulateBlock(const FnApproxSoftmax &B, int numActions, size_t first, size_t last, int maxEpisodeLength,
+						  uint64_t seed, RolloutBlock &block)
+{
+	Env e;
+	std::uniform_real_distribution<double> ud(0.0, 1.0);
+	TrajectoryColumns &columns = block.columns;
+	columns.offsets.assign(1, 0);
+	block.totalReturn = 0.0;
+	for(size_t i = first; i < last; i++)
+	{
+		Philox generator(seed, 0, 0, 0, i);
+		e.newEpisode(generator);
+		std::vector<double> state = e.getState(generator);
+		bool inTerminalState = false;
+		for(int t = 0; (t < maxEpisodeLength) && (!inTerminalState); t++)
+		{
+			// sampled as FnApproxSoftmax::getAction does, keeping the probability of the action
+			std::vector<double> actionProb = B.getActionProb(state);
+			double sample = ud(generator), total = 0.0;
+			int action = numActions - 1;
+			for(int j = 0; j < numActions; j++)
+			{
+				total += actionProb[j];
+				if(sample < total)
+				{
+					action = j;
+					break;
+				}
+			}
+			double reward = e.update(action, generator);
+			columns.states.insert(columns.states.end(), state.begin(), state.end());
+			columns.actions.push_back(action);
+			columns.rewards.push_back(reward);
+			columns.behaviorProbs.push_back(actionProb[action]);
+			if(i == 0)
+				block.firstProbs.push_back(actionProb[action]);
+			block.totalReturn += reward;
+			state = e.getState(generator);
+			inTerminalState = e.inTerminalState();
+		}
+		columns.offsets.push_back(columns.actions.size());
+	}
+}
+
+/*		simulateBlock for an environment with a batched version: ROLLOUT_BATCH_LANES episodes run in lockstep,
+		one per lane, with one getActionProbs call for the running lanes and one update of all lanes per step.
+		A lane whose episode ends starts the next episode of the block. Episode i keeps its own Philox stream
+		(seed, 0, 0, 0, i) for sampling its actions, so the episodes do not depend on the lane they run in.
+*/
+template<typename Batch>
+static void simulateBatchBlock(const FnApproxSoftmax &B, int numActions, size_t first, size_t last, int maxEpisodeLength,
+							   uint64_t seed, RolloutBlock &block)
+{
+	const size_t IDLE = SIZE_MAX;
+	size_t n = last - first, numLanes = std::min(n, (size_t)ROLLOUT_BATCH_LANES), next = 0;
+	Batch e(numLanes);
+	int m = e.getStateDim();
+	std::uniform_real_distribution<double> ud(0.0, 1.0);
+	std::vector<Philox> generators;
+	generators.reserve(n);
+	for(size_t i = first; i < last; i++)
+		generators.emplace_back(seed, 0, 0, 0, i);
+
+	// steps of each episode, gathered into the block's columns at the end
+	std::vector<TrajectoryColumns> episodes(n);
+	std::vector<size_t> laneEpisode(numLanes), active;
+	std::vector<int> laneSteps(numLanes, 0), actions(numLanes, 0);
+	std::vector<double> states(numLanes * m), activeStates(numLanes * m), actionProb(numLanes * numActions), rewards(numLanes);
+	for(size_t lane = 0; lane < numLanes; lane++)
+		laneEpisode[lane] = next++;
+	while(true)
+	{
+		active.clear();
+		for(size_t lane = 0; lane < numLanes; lane++)
+			if(laneEpisode[lane] != IDLE)
+				active.push_back(lane);
+		if(active.empty())
+			break;
+		e.getStates(states.data());
+		for(size_t j = 0; j < active.size(); j++)
+			std::copy(states.begin() + active[j] * m, states.begin() + (active[j] + 1) * m, activeStates.begin() + j * m);
+		B.getActionProbs(activeStates.data(), active.size(), actionProb.data());
+		for(size_t j = 0; j < active.size(); j++)
+		{
+			// sampled as FnApproxSoftmax::getAction does
+			const double * probs = actionProb.data() + j * numActions;
+			double sample = ud(generators[laneEpisode[active[j]]]), total = 0.0;
+			int action = numActions - 1;
+			for(int a = 0; a < numActions; a++)
+			{
+				total += probs[a];
+				if(sample < total)
+				{
+					action = a;
+					break;
+				}
+			}
+			actions[active[j]] = action;
+		}
+		e.update(actions.data(), rewards.data());
+		for(size_t j = 0; j < active.size(); j++)
+		{
+			size_t lane = active[j], i = laneEpisode[lane];
+			TrajectoryColumns &episode = episodes[i];
+			double prob = actionProb[j * numActions + actions[lane]];
+			episode.states.insert(episode.states.end(), activeStates.begin() + j * m, activeStates.begin() + (j + 1) * m);
+			episode.actions.push_back(actions[lane]);
+			episode.rewards.push_back(rewards[lane]);
+			episode.behaviorProbs.push_back(prob);
+			if(first + i == 0)
+				block.firstProbs.push_back(prob);
+			if(e.inTerminalState(lane) || ++laneSteps[lane] >= maxEpisodeLength)
+			{
+				// idle lanes may keep moving, but nothing is recorded for them
+				laneEpisode[lane] = (next < n ? next++ : IDLE);
+				laneSteps[lane] = 0;
+				e.newEpisode(lane);
+			}
+		}
+	}
+
+	TrajectoryColumns &columns = block.columns;
+	columns.offsets.assign(1, 0);
+	block.totalReturn = 0.0;
+	for(const TrajectoryColumns &episode : episodes)
+	{
+		columns.states.insert(columns.states.end(), episode.states.begin(), episode.states.end());
+		columns.actions.insert(columns.actions.end(), episode.actions.begin(), episode.actions.end());
+		columns.rewards.insert(columns.rewards.end(), episode.rewards.begin(), episode.rewards.end());
+		columns.behaviorProbs.insert(columns.behaviorProbs.end(), episode.behaviorProbs.begin(), episode.behaviorProbs.end());
+		columns.offsets.push_back(columns.actions.size());
+		for(double r : episode.rewards)
+			block.totalReturn += r;
+	}
+}
+
+// Simulates the episodes [first, last) of the data set into a block
+typedef void (*BlockSimulator)(const FnApproxSoftmax &B, int numActions, size_t first, size_t last, int maxEpisodeLength,
+							   uint64_t seed, RolloutBlock &block);
+
+// Formats the episodes of a block as csv lines of (state, action, reward) steps
+static void formatBlock(RolloutBlock &block, int m)
+{
+	const TrajectoryColumns &columns = block.columns;
+	block.csv.clear();
+	block.csv.reserve(columns.actions.size() * (m + 2) * 12);
+	for(size_t i = 0; i + 1 < columns.offsets.size(); i++)
+	{
+		for(size_t t = columns.offsets[i]; t < columns.offsets[i + 1]; t++)
+		{
+			for(int j = 0; j < m; j++)
+			{
+				appendNumber(block.csv, columns.states[t * m + j]);
+				block.csv += ',';
+			}
+			block.csv += to_string(columns.actions[t]);
+			block.csv += ',';
+			appendNumber(block.csv, columns.rewards[t]);
+			block.csv += (t + 1 < columns.offsets[i + 1] ? ',' : '\n');
+		}
+	}
+}
+
+template<typename Env>
+static double generate(std::string dataFile, bool binary, int k, std::vector<double> params, size_t numEpisodes,
+					   int maxEpisodeLength, uint64_t seed, BlockSimulator simulate)
+{
+	Env probe;
+	Philox probeGenerator(seed);
+	probe.newEpisode(probeGenerator);
+	int m = (int)probe.getState(probeGenerator).size(), a = probe.getNumActions();
+	FourierBasis basis;
+	basis.init(m, 1, k);
+	if(!params.empty() && params.size() != (size_t)a * basis.getNumOutputs())
+		throw std::invalid_argument("generateRollouts: the behavior policy has " + to_string(a * basis.getNumOutputs()) +
+									" parameters, but " + to_string(params.size()) + " were given");
+	const FnApproxSoftmax B(m, a, 1, k, params);
+	params = B.getParameters();
+
+	std::unique_ptr<BinaryDataFileWriter> writer;
+	ofstream out;
+	if(binary)
+		writer.reset(new BinaryDataFileWriter(dataFile, m, a, k, params));
+	else
+	{
+		out.open(dataFile, std::ios::binary | std::ios::trunc);
+		if(!out)
+			throw runtime_error("Could not open " + dataFile + " for writing");
+		std::string header = to_string(m) + '\n' + to_string(a) + '\n' + to_string(k) + '\n';
+		for(size_t i = 0; i < params.size(); i++)
+		{
+			appendNumber(header, params[i]);
+			header += (i + 1 < params.size() ? ',' : '\n');
+		}
+		header += to_string(numEpisodes) + '\n';
+		out.write(header.data(), header.size());
+	}
+
+	size_t numBlocks = (numEpisodes + ROLLOUT_BLOCK_EPISODES - 1) / ROLLOUT_BLOCK_EPISODES;
+	std::vector<double> p_test;
+	double totalReturn = 0.0;
+	std::vector<RolloutBlock> blocks(ROLLOUT_CHUNK_BLOCKS);
+	for(size_t chunk = 0; chunk < numBlocks; chunk += ROLLOUT_CHUNK_BLOCKS)
+	{
+		size_t chunkBlocks = std::min((size_t)ROLLOUT_CHUNK_BLOCKS, numBlocks - chunk);
+		parallelFor(0, chunkBlocks, [&](size_t b)
+		{
+			size_t first = (chunk + b) * ROLLOUT_BLOCK_EPISODES, last = std::min(numEpisodes, first + ROLLOUT_BLOCK_EPISODES);
+			blocks[b] = RolloutBlock();
+			simulate(B, a, first, last, maxEpisodeLength, seed, blocks[b]);
+			if(!binary)
+				formatBlock(blocks[b], m);
+		});
+		if(chunk == 0)
+			p_test = blocks[0].firstProbs;
+		for(size_t b = 0; b < chunkBlocks; b++)
+		{
+			totalReturn += blocks[b].totalReturn;
+			if(binary)
+				writer->append(blocks[b].columns);
+			else
+				out.write(blocks[b].csv.data(), blocks[b].csv.size());
+		}
+	}
+
+	if(binary)
+		writer->finish(p_test);
+	else
+	{
+		std::string last;
+		for(size_t i = 0; i < p_test.size(); i++)
+		{
+			appendNumber(last, p_test[i]);
+			last += (i + 1 < p_test.size() ? ',' : '\n');
+		}
+		out.write(last.data(), last.size());
+		out.close();
+		if(!out)
+			throw runtime_error("Failed writing " + dataFile);
+	}
+	return totalReturn / (double)numEpisodes;
+}
+
+/*		Generates a data set by running a behavior policy in an environment
+
+	:param dataFile: name of the file to write
+	:param binary: write the binary data file format instead of csv
+	:param env: the environment
+	:param k: order of the FourierBasis of the behavior policy
+	:param params: parameters of the behavior policy; empty for the policy's default parameters
+	:param numEpisodes: number of episodes to generate
+	:param maxEpisodeLength: episodes are cut after this many steps
+	:param seed: master seed of the episodes' random number streams
+
+	Returns the average undiscounted return of the generated episodes
+*/
+double generateRollouts(std::string dataFile, bool binary, RolloutEnvironment env, int k, std::vector<double> params,
+						size_t numEpisodes, int maxEpisodeLength, uint64_t seed)
+{
+	switch(env)
+	{
+	case ROLLOUT_CARTPOLE:
+		return generate<CartPole>(dataFile, binary, k, params, numEpisodes, maxEpisodeLength, seed,
+								  simulateBatchBlock<CartPoleBatch>);
+	case ROLLOUT_MOUNTAINCAR:
+		return generate<MountainCar>(dataFile, binary, k, params, numEpisodes, maxEpisodeLength, seed,
+									 simulateBatchBlock<MountainCarBatch>);
+	default:
+		return generate<Gridworld>(dataFile, binary, k, params, numEpisodes, maxEpisodeLength, seed,
+								   simulateBlock<Gridworld>);
+	}
+}
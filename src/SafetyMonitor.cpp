@@ -0,0 +1,72 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+// See SafetyMonitor.hpp for a description of the class.
+
+/*		Starts monitoring a policy
+
+	:param theta: the policy's parameters, in the layout of E.getParameters()
+	:param delta: confidence interval used in the Student's t distribution
+	:param c: the expected dsicounted return minimum constraint
+	:param initial: statistics of the safety data the policy has already been evaluated on; new policies
+					added to a running monitor do not see the episodes it has already folded in
+
+	Returns the index of the policy.
+*/
+int SafetyMonitor::addPolicy(const VectorXd &theta, double delta, double c, const RunningStats &initial)
+{
+	if(thetas.cols() > 0 && theta.size() != thetas.rows())
+		throw invalid_argument("SafetyMonitor::addPolicy: the parameters do not fit the monitored policies");
+	thetas.conservativeResize(theta.size(), thetas.cols() + 1);
+	thetas.col(thetas.cols() - 1) = theta;
+	deltas.push_back(delta);
+	cs.push_back(c);
+	stats.push_back(initial);
+	looks.push_back(initial.n > 0 ? 1 : 0);
+	return (int)stats.size() - 1;
+}
+
+/*		The confidence of a policy's safety test at its current look, the look's share of the policy's delta
+
+	:param policy: index of the policy
+*/
+double SafetyMonitor::getLookDelta(int policy) const
+{
+	double look = (double)std::max<uint64_t>(looks[policy], 1);
+	return deltas[policy] * 6.0 / (M_PI * M_PI * look * look);
+}
+
+// Merges the statistics of new episodes into those of every policy, which is another look at each of them
+void SafetyMonitor::merge(const std::vector<RunningStats> &newStats)
+{
+	for(size_t i = 0; i < stats.size(); i++)
+	{
+		stats[i].merge(newStats[i]);
+		looks[i]++;
+	}
+}
+
+/*		Folds new episodes into the statistics of every monitored policy with one PDIS pass over them
+
+	:param episodes: the new episodes, with their behavior probabilities (see augmentData)
+*/
+void SafetyMonitor::update(const TrajectoryStore &episodes)
+{
+	if(stats.empty() || episodes.getNumEpisodes() == 0)
+		return;
+	merge(PDISStats(episodes, thetas, E));
+}
+
+/*		Folds the episodes of a stream (e.g. the safety data of a data file too large to load) into the
+		statistics of every monitored policy with one pass over the stream
+
+	:param episodes: the new episodes
+*/
+void SafetyMonitor::update(const DataFileStream &episodes)
+{
+	if(stats.empty() || episodes.getNumEpisodes() == 0)
+		return;
+	merge(PDISStats(episodes, thetas, E));
+}
@@ -0,0 +1,520 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// See ShardedHCOPI.hpp for descriptions of the coordinator and the protocol.
+
+const uint32_t SHARD_MAGIC = 0x48435348;		// "HCSH"
+const uint32_t SHARD_PROTOCOL_VERSION = 1;
+
+// How long a worker keeps trying to reach a coordinator that is not listening yet
+const int SHARD_CONNECT_SECONDS = 60;
+
+// Sent by a worker once it has loaded its shards, followed by numParams behavior parameters
+struct ShardHello
+{
+	uint32_t magic;					// SHARD_MAGIC
+	uint32_t version;				// SHARD_PROTOCOL_VERSION
+	int32_t shard;
+	int32_t numShards;
+	int32_t m;
+	int32_t a;
+	int32_t k;
+	int32_t reserved;
+	uint64_t numParams;
+	uint64_t totalEpisodes;			// episodes of the whole data file, so workers of different files are caught
+	uint64_t numEpisodes[2];		// episodes of the worker's candidate and safety shards
+};
+
+enum ShardCommand : uint32_t { SHARD_EVALUATE, SHARD_SHUTDOWN };
+
+// Sent by the coordinator, followed for SHARD_EVALUATE by the numParams x numPolicies parameter matrix
+// (column major). The worker replies with numPolicies RunningStats.
+struct ShardRequest
+{
+	uint32_t command;				// a ShardCommand
+	uint32_t set;					// a ShardDataSet
+	uint64_t numPolicies;
+	uint64_t numParams;
+};
+
+static_assert(sizeof(RunningStats) == 3 * sizeof(double), "RunningStats is sent as three doubles");
+
+// Writes all of data to a socket
+static void sendAll(int socket, const void * data, size_t size)
+{
+	const char * p = (const char *)data;
+	while(size > 0)
+	{
+		ssize_t sent = send(socket, p, size, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			throw runtime_error(string("Shard connection lost while sending: ") + strerror(errno));
+		p += sent;
+		size -= (size_t)sent;
+	}
+}
+
+// Reads size bytes from a socket. Returns false if the connection was closed before the first byte.
+static bool receiveAll(int socket, void * data, size_t size)
+{
+	char * p = (char *)data;
+	size_t received = 0;
+	while(received < size)
+	{
+		ssize_t n = recv(socket, p + received, size - received, 0);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0)
+			throw runtime_error(string("Shard connection lost while receiving: ") + strerror(errno));
+		if(n == 0)
+		{
+			if(received == 0)
+				return false;
+			throw runtime_error("Shard connection closed in the middle of a message");
+		}
+		received += (size_t)n;
+	}
+	return true;
+}
+
+// Like receiveAll, but a closed connection is an error
+static void receiveMessage(int socket, void * data, size_t size)
+{
+	if(!receiveAll(socket, data, size))
+		throw runtime_error("Shard connection closed");
+}
+
+/*		Splits an address into a TCP host and port, if it has the form host:port, and returns false for a
+		Unix domain socket path
+*/
+static bool parseTCPAddress(const std::string &address, std::string &host, std::string &port)
+{
+	size_t colon = address.rfind(':');
+	if(colon == std::string::npos || colon + 1 == address.size() ||
+	   address.find_first_not_of("0123456789", colon + 1) != std::string::npos)
+		return false;
+	host = address.substr(0, colon);
+	port = address.substr(colon + 1);
+	return true;
+}
+
+// Resolves a TCP address, for binding if passive
+static struct addrinfo * resolve(const std::string &host, const std::string &port, bool passive)
+{
+	struct addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = (passive ? AI_PASSIVE : 0);
+	int error = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result);
+	if(error != 0)
+		throw runtime_error("Could not resolve " + host + ":" + port + ": " + gai_strerror(error));
+	return result;
+}
+
+static struct sockaddr_un unixAddress(const std::string &path)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path))
+		throw invalid_argument("Socket path too long: " + path);
+	memcpy(address.sun_path, path.c_str(), path.size());
+	return address;
+}
+
+// Requests and replies are small, so they are sent without waiting to fill a packet
+static void setNoDelay(int socket)
+{
+	int one = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Opens a listening socket on address
+static int listenOn(const std::string &address, int backlog)
+{
+	std::string host, port;
+	int s = -1;
+	if(parseTCPAddress(address, host, port))
+	{
+		struct addrinfo * addresses = resolve(host, port, true);
+		for(struct addrinfo * p = addresses; p && s < 0; p = p->ai_next)
+		{
+			s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+			if(s < 0)
+				continue;
+			int one = 1;
+			setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			if(bind(s, p->ai_addr, p->ai_addrlen) != 0)
+			{
+				close(s);
+				s = -1;
+			}
+		}
+		freeaddrinfo(addresses);
+	}
+	else
+	{
+		struct sockaddr_un un = unixAddress(address);
+		unlink(address.c_str());	// a stale socket of an earlier run
+		s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(s >= 0 && bind(s, (struct sockaddr *)&un, sizeof(un)) != 0)
+		{
+			close(s);
+			s = -1;
+		}
+	}
+	if(s < 0 || listen(s, backlog) != 0)
+		throw runtime_error("Could not listen on " + address + ": " + strerror(errno));
+	return s;
+}
+
+// Connects to address, retrying for SHARD_CONNECT_SECONDS while nothing listens there yet
+static int connectTo(const std::string &address)
+{
+	std::string host, port;
+	bool tcp = parseTCPAddress(address, host, port);
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(SHARD_CONNECT_SECONDS);
+	while(true)
+	{
+		int s = -1;
+		if(tcp)
+		{
+			struct addrinfo * addresses = resolve(host, port, false);
+			for(struct addrinfo * p = addresses; p && s < 0; p = p->ai_next)
+			{
+				s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+				if(s >= 0 && connect(s, p->ai_addr, p->ai_addrlen) != 0)
+				{
+					close(s);
+					s = -1;
+				}
+			}
+			freeaddrinfo(addresses);
+			if(s >= 0)
+				setNoDelay(s);
+		}
+		else
+		{
+			struct sockaddr_un un = unixAddress(address);
+			s = socket(AF_UNIX, SOCK_STREAM, 0);
+			if(s >= 0 && connect(s, (struct sockaddr *)&un, sizeof(un)) != 0)
+			{
+				close(s);
+				s = -1;
+			}
+		}
+		if(s >= 0)
+			return s;
+		if(std::chrono::steady_clock::now() > deadline)
+			throw runtime_error("Could not connect to coordinator at " + address);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+/*		Runs a worker: keeps shard of numShards contiguous shards of the candidate and of the safety data of
+		dataFile, of which only the shards are read (a csv file is indexed, and only the histories of the
+		shards are parsed and augmented), connects to the coordinator at address and answers its evaluation requests with the
+		PDIS statistics of the requested shard, until the coordinator shuts the worker down.
+
+	:param address: address of the coordinator, a Unix domain socket path or host:port
+	:param shard: index of the worker's shard, in [0, numShards)
+	:param numShards: number of workers of the run
+	:param dataFile: csv or binary data file; every worker of a run must be given the same data
+	:param cacheFeatures: compute the features of the shards' states once instead of on every evaluation
+*/
+void runShardWorker(const std::string &address, int shard, int numShards, std::string dataFile, bool cacheFeatures)
+{
+	if(numShards < 1 || shard < 0 || shard >= numShards)
+		throw invalid_argument("Shard " + to_string(shard) + " is not one of " + to_string(numShards) + " shards");
+
+	DataFileStream D(dataFile);
+	int m = D.getM(), a = D.getA(), k = D.getK();
+	const std::vector<double> &behavior_parameters = D.getBehaviorParameters();
+	// a binary file is mapped, so only the pages of the shards are ever read
+	bool binary = isBinaryDataFile(dataFile);
+	TrajectoryStore mapped;
+	if(binary)
+	{
+		int n;
+		std::vector<double> params, policy_test;
+		mapped = mapBinaryDataFile(dataFile, m, a, k, params, n, policy_test);
+	}
+
+	// the split of main, then the shard's contiguous part of each side
+	size_t numCandidate = (size_t)(D.getNumEpisodes()*HCOPI_TRIAL_SETTINGS.candidateFraction);
+	size_t setBegin[2] = { 0, numCandidate }, setEnd[2] = { numCandidate, D.getNumEpisodes() };
+	TrajectoryStore shards[2];
+	for(int set = 0; set < 2; set++)
+	{
+		size_t size = setEnd[set] - setBegin[set];
+		size_t first = setBegin[set] + size * shard / numShards, last = setBegin[set] + size * (shard + 1) / numShards;
+		if(binary)
+			shards[set] = mapped.subset(first, last);
+		else
+			shards[set] = D.subset(first, last).read();
+	}
+
+	const FnApproxSoftmax agentE(m, a, 1, k, behavior_parameters);
+	std::unique_ptr<FeatureCache> features[2];
+	if(cacheFeatures)
+		for(int set = 0; set < 2; set++)
+			features[set].reset(new FeatureCache(shards[set], agentE.getBasis()));
+	cout << "Shard " << shard << " of " << numShards << ": " << shards[0].getNumEpisodes() << " candidate and "
+		 << shards[1].getNumEpisodes() << " safety episodes of " << dataFile << endl;
+
+	int s = connectTo(address);
+	try
+	{
+		ShardHello hello;
+		memset(&hello, 0, sizeof(hello));
+		hello.magic = SHARD_MAGIC;
+		hello.version = SHARD_PROTOCOL_VERSION;
+		hello.shard = shard;
+		hello.numShards = numShards;
+		hello.m = m;
+		hello.a = a;
+		hello.k = k;
+		hello.numParams = behavior_parameters.size();
+		hello.totalEpisodes = D.getNumEpisodes();
+		hello.numEpisodes[0] = shards[0].getNumEpisodes();
+		hello.numEpisodes[1] = shards[1].getNumEpisodes();
+		sendAll(s, &hello, sizeof(hello));
+		sendAll(s, behavior_parameters.data(), behavior_parameters.size() * sizeof(double));
+
+		ShardRequest request;
+		MatrixXd thetas;
+		while(receiveAll(s, &request, sizeof(request)) && request.command == SHARD_EVALUATE)
+		{
+			if(request.set > SHARD_SAFETY_DATA || request.numParams != behavior_parameters.size())
+				throw runtime_error("Invalid evaluation request");
+			thetas.resize((Index)request.numParams, (Index)request.numPolicies);
+			receiveMessage(s, thetas.data(), thetas.size() * sizeof(double));
+			std::vector<RunningStats> stats;
+			if(features[request.set])
+				stats = PDISStats(shards[request.set], *features[request.set], thetas, agentE);
+			else
+				stats = PDISStats(shards[request.set], thetas, agentE);
+			sendAll(s, stats.data(), stats.size() * sizeof(RunningStats));
+		}
+	}
+	catch(...)
+	{
+		close(s);
+		throw;
+	}
+	close(s);
+}
+
+/*		Listens on address for numWorkers workers and returns once all of them have connected and described
+		their shards.
+
+	:param address: a Unix domain socket path, or host:port to listen on TCP (host may be empty or 0.0.0.0
+					for all interfaces)
+	:param numWorkers: number of workers, each holding one shard
+	:param spawnArgs: if not empty, the coordinator starts the workers itself as local processes running
+					  this program with "--worker <address> <shard> <numWorkers>" followed by spawnArgs (the
+					  data file and worker options). Otherwise the workers are started separately.
+*/
+ShardCoordinator::ShardCoordinator(const std::string &address, int numWorkers, const std::vector<std::string> &spawnArgs)
+	: workerSockets(numWorkers, -1), m(0), a(0), k(0), numEpisodes{0, 0}
+{
+	if(numWorkers < 1)
+		throw invalid_argument("A sharded run needs at least one worker");
+	std::string host, port;
+	bool tcp = parseTCPAddress(address, host, port);
+	int listener = listenOn(address, numWorkers);
+	try
+	{
+		if(!spawnArgs.empty())
+		{
+			// the argument and environment strings are built before forking, so the child only calls execve
+			const char * profileEnv = getenv("HCOPI_PROFILE_OUTPUT");
+			std::string profileBase = (profileEnv ? profileEnv : "profile.json");
+			std::vector<std::string> environment;
+			for(char ** e = environ; *e; e++)
+				if(strncmp(*e, "HCOPI_PROFILE_OUTPUT=", 21) != 0)
+					environment.push_back(*e);
+			for(int shard = 0; shard < numWorkers; shard++)
+			{
+				std::vector<std::string> args = { "main", "--worker", address, to_string(shard), to_string(numWorkers) };
+				args.insert(args.end(), spawnArgs.begin(), spawnArgs.end());
+				std::vector<std::string> env = environment;
+				// every worker writes its own profile report
+				env.push_back("HCOPI_PROFILE_OUTPUT=" + profileBase + ".shard" + to_string(shard));
+				std::vector<char *> argv, envp;
+				for(auto &arg : args)
+					argv.push_back(&arg[0]);
+				argv.push_back(NULL);
+				for(auto &var : env)
+					envp.push_back(&var[0]);
+				envp.push_back(NULL);
+				pid_t pid = fork();
+				if(pid < 0)
+					throw runtime_error(string("Could not start a worker: ") + strerror(errno));
+				if(pid == 0)
+				{
+					close(listener);
+					execve("/proc/self/exe", argv.data(), envp.data());
+					_exit(127);
+				}
+				workerProcesses.push_back(pid);
+			}
+		}
+
+		uint64_t totalEpisodes = 0;
+		for(int connected = 0; connected < numWorkers;)
+		{
+			struct pollfd p = { listener, POLLIN, 0 };
+			int ready = poll(&p, 1, 1000);
+			if(ready < 0 && errno != EINTR)
+				throw runtime_error(string("Could not wait for workers: ") + strerror(errno));
+			// a worker that this process started and that exited will never connect
+			for(pid_t pid : workerProcesses)
+				if(waitpid(pid, NULL, WNOHANG) == pid)
+					throw runtime_error("A worker process exited before connecting");
+			if(ready <= 0)
+				continue;
+			int s = accept(listener, NULL, NULL);
+			if(s < 0)
+				continue;
+			if(tcp)
+				setNoDelay(s);
+			ShardHello hello;
+			receiveMessage(s, &hello, sizeof(hello));
+			if(hello.magic != SHARD_MAGIC || hello.version != SHARD_PROTOCOL_VERSION)
+			{
+				close(s);
+				throw runtime_error("A worker of a different protocol version connected");
+			}
+			std::vector<double> params(hello.numParams);
+			receiveMessage(s, params.data(), params.size() * sizeof(double));
+			if(hello.numShards != numWorkers || hello.shard < 0 || hello.shard >= numWorkers || workerSockets[hello.shard] >= 0)
+			{
+				close(s);
+				throw runtime_error("Worker of shard " + to_string(hello.shard) + " of " + to_string(hello.numShards) +
+									" does not fit a run of " + to_string(numWorkers) + " shards");
+			}
+			workerSockets[hello.shard] = s;
+			if(connected == 0)
+			{
+				m = hello.m;
+				a = hello.a;
+				k = hello.k;
+				behaviorParameters = params;
+				totalEpisodes = hello.totalEpisodes;
+			}
+			else if(hello.m != m || hello.a != a || hello.k != k || params != behaviorParameters ||
+					hello.totalEpisodes != totalEpisodes)
+				throw runtime_error("Worker of shard " + to_string(hello.shard) + " holds a different data set");
+			numEpisodes[0] += hello.numEpisodes[0];
+			numEpisodes[1] += hello.numEpisodes[1];
+			connected++;
+		}
+	}
+	catch(...)
+	{
+		close(listener);
+		if(!tcp)
+			unlink(address.c_str());
+		shutdown();
+		throw;
+	}
+	close(listener);
+	if(!tcp)
+		unlink(address.c_str());
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+	shutdown();
+}
+
+// Tells the connected workers to exit and waits for the workers this process started
+void ShardCoordinator::shutdown()
+{
+	ShardRequest request = { SHARD_SHUTDOWN, 0, 0, 0 };
+	for(int &s : workerSockets)
+	{
+		if(s < 0)
+			continue;
+		try
+		{
+			sendAll(s, &request, sizeof(request));
+		}
+		catch(const std::exception &)
+		{
+			// the worker is gone already
+		}
+		close(s);
+		s = -1;
+	}
+	for(pid_t pid : workerProcesses)
+		waitpid(pid, NULL, 0);
+	workerProcesses.clear();
+}
+
+/*		Evaluates parameter vectors on all shards of the candidate or safety data
+
+	:param set: the data to evaluate on
+	:param thetas: the evaluation policy parameters, one column per policy
+
+	Returns the statistics of the importance sampled returns of each policy on the whole data set
+*/
+std::vector<RunningStats> ShardCoordinator::evaluate(ShardDataSet set, const MatrixXd &thetas)
+{
+	if((size_t)thetas.rows() != behaviorParameters.size())
+		throw invalid_argument("ShardCoordinator::evaluate: the parameters do not fit the workers' policy");
+	std::lock_guard<std::mutex> guard(lock);
+	ShardRequest request = { SHARD_EVALUATE, (uint32_t)set, (uint64_t)thetas.cols(), (uint64_t)thetas.rows() };
+	// every worker gets the whole batch before any reply is read, so the shards are evaluated at once
+	for(int s : workerSockets)
+	{
+		sendAll(s, &request, sizeof(request));
+		sendAll(s, thetas.data(), thetas.size() * sizeof(double));
+	}
+	std::vector<RunningStats> result(thetas.cols()), shardStats(thetas.cols());
+	for(int s : workerSockets)
+	{
+		receiveMessage(s, shardStats.data(), shardStats.size() * sizeof(RunningStats));
+		for(size_t i = 0; i < shardStats.size(); i++)
+			result[i].merge(shardStats[i]);
+	}
+	return result;
+}
+
+/*		Runs the safety tests of several parameter vectors in one pass over the sharded safety data
+
+	:param coordinator: the coordinator of the workers holding the data
+	:param thetas: the parameters to test, one column per parameter vector
+	:param deltas: confidence interval used in the Student's t distribution, one per column of thetas
+	:param cs: the expected dsicounted return minimum constraint, one per column of thetas
+
+	Returns for every column of thetas whether it passes its safety test.
+*/
+std::vector<bool>
+shardedSafetyTest(ShardCoordinator &coordinator, const MatrixXd &thetas, const std::vector<double> &deltas, const std::vector<double> &cs)
+{
+	PROFILE_SCOPE(PROFILE_SAFETY_TEST);
+	std::vector<RunningStats> stats = coordinator.evaluate(SHARD_SAFETY_DATA, thetas);
+	std::vector<bool> result(thetas.cols());
+	for(int i = 0; i < thetas.cols(); i++)
+		result[i] = safetyTest(stats[i], deltas[i], cs[i]);
+	return result;
+}
@@ -20,28 +20,17 @@ TabularSoftmax::TabularSoftmax(int nstates, int nactions, std::vector<double> pa
 
 /*		Parameter getter function. This also describes how the paramter vector maps to states and actions
 */
-std::vector<double> TabularSoftmax::getParameters()
+std::vector<double> TabularSoftmax::getParameters() const
 {
-	std::vector<double> params(numStates*numActions);
-	for(int i = 0; i < numStates; i++)
-		for(int j = 0; j < numActions; j++)
-			params.push_back(parameters[i][j]);
-	return params;
+	return parameters;
 }
 
 /*		Parameter setter function. This also describes how the paramter vector maps to states and actions
 */
 void TabularSoftmax::setParameters(std::vector<double> params)
 {
-	std::vector<std::vector<double>> new_params(numStates);
-	for(int i = 0; i < numStates; i++)
-	{
-		std::vector<double> actions(numActions);
-		for(int j = 0; j < numActions; j++)
-			actions[j] = params[(i*numActions) + j];
-		new_params[i] = actions;
-	}
-	parameters = new_params;
+	// parameters[(i*numActions) + j] is the preference of action j in state i
+	parameters.assign(params.begin(), params.begin() + numStates * numActions);
 }
 
 /*		Returns an action given a state.
@@ -49,7 +38,7 @@ void TabularSoftmax::setParameters(std::vector<double> params)
 	:param state: vector representation of the current state
 	:param generator: RNG used to sample action from softmax distribution
 */
-int TabularSoftmax::getAction(std::vector<double> state, std::mt19937_64 & generator)
+int TabularSoftmax::getAction(std::vector<double> state, Philox & generator)
 {
 	std::vector<double> actionprob = getActionProb(state);
 	double sample = ud(generator);
@@ -68,9 +57,10 @@ int TabularSoftmax::getAction(std::vector<double> state, std::mt19937_64 & gener
 
 	:param state: vector representation of the current state
 */
-std::vector<double> TabularSoftmax::getActionProb(std::vector<double> state)
+std::vector<double> TabularSoftmax::getActionProb(std::vector<double> state) const
 {
-	std::vector<double> actionParams = parameters[state[0]];
+	std::vector<double> actionParams(parameters.begin() + (int)state[0] * numActions,
+									 parameters.begin() + ((int)state[0] + 1) * numActions);
 	double sum_of_elems = 0.0;
 	for(auto &d : actionParams)
 	{
@@ -87,7 +77,47 @@ std::vector<double> TabularSoftmax::getActionProb(std::vector<double> state)
 	:param state: vector representation of the current state
 	:param action: the action to evaluate the policy at
 */
-double TabularSoftmax::getProb(std::vector<double> state, int action)
+double TabularSoftmax::getProb(std::vector<double> state, int action) const
 {
 	return getActionProb(state)[action];
+}
+
+/*		Writes the probabilities of a block of state-action pairs to a buffer. States are one
+		dimensional state indices, so the action preferences of the block are the rows of the
+		parameter table selected by the states (the product of one-hot state vectors with the
+		table), followed by a log-sum-exp softmax per state.
+
+	:param states: count state indices
+	:param actions: count actions, one per state
+	:param count: number of state-action pairs
+	:param out: buffer receiving count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void TabularSoftmax::getProbs(const double * states, const int * actions, size_t count, double * out, bool logProbs) const
+{
+	getProbsMulti(parameters.data(), 1, states, actions, count, out, logProbs);
+}
+
+/*		Writes the probabilities of a block of state-action pairs under several parameter vectors to a buffer.
+
+	:param thetas: numPolicies parameter vectors of numStates*numActions values, back to back
+	:param numPolicies: number of parameter vectors
+	:param states: count state indices
+	:param actions: count actions, one per state
+	:param count: number of state-action pairs
+	:param out: buffer receiving numPolicies rows of count probabilities
+	:param logProbs: if true, log-probabilities are written instead of probabilities
+*/
+void TabularSoftmax::getProbsMulti(const double * thetas, int numPolicies, const double * states, const int * actions,
+								   size_t count, double * out, bool logProbs) const
+{
+	std::vector<double> logits(count * numActions);
+	for(int k = 0; k < numPolicies; k++)
+	{
+		const double * theta = thetas + (size_t)k * numStates * numActions;
+		for(size_t r = 0; r < count; r++)
+			for(int j = 0; j < numActions; j++)
+				logits[r * numActions + j] = sigma * theta[((int)states[r] * numActions) + j];
+		softmaxSelect(logits.data(), numActions, numActions, actions, count, out + k * count, logProbs);
+	}
 }
\ No newline at end of file
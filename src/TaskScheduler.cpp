@@ -0,0 +1,202 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+// Index of the deque owned by the current thread, or -1 for threads outside the pool
+static thread_local int currentQueue = -1;
+
+// Depth of the groups created by the current thread: one more than the group of the task it runs, or 0
+static thread_local int currentDepth = 0;
+
+TaskGroup::TaskGroup() : outstanding(0), depth(currentDepth) {}
+
+/*		Returns the process wide scheduler. The pool is started on first use with HCOPI_THREADS threads,
+		or one per hardware thread.
+*/
+TaskScheduler & TaskScheduler::getInstance()
+{
+	static TaskScheduler scheduler([]
+	{
+		const char * env = getenv("HCOPI_THREADS");
+		int numThreads = (env ? atoi(env) : (int)thread::hardware_concurrency());
+		return max(1, numThreads);
+	}());
+	return scheduler;
+}
+
+/*		Constructor for the TaskScheduler class. Starts numThreads - 1 pool threads; the thread that
+		waits for a group runs tasks as well and makes up the last one.
+
+	:param numThreads: total number of threads running tasks
+*/
+TaskScheduler::TaskScheduler(int numThreads) : numQueued(0), numSpawned(0), numWaiting(0), stopping(false)
+{
+	for(int i = 0; i < numThreads; i++)
+		queues.emplace_back(new TaskQueue());
+	for(int i = 0; i < numThreads - 1; i++)
+		workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(auto &worker : workers)
+		worker.join();
+}
+
+/*		Pushes a task onto the bottom of the calling thread's deque (or the shared deque for threads
+		outside the pool) and wakes an idle thread to steal it, and the waiting threads in case it is theirs.
+*/
+void TaskScheduler::spawn(TaskGroup &group, std::function<void()> task)
+{
+	int queue = (currentQueue >= 0 ? currentQueue : (int)queues.size() - 1);
+	group.outstanding++;
+	{
+		lock_guard<mutex> guard(queues[queue]->lock);
+		queues[queue]->tasks.push_back(Task{std::move(task), &group});
+	}
+	numQueued++;
+	numSpawned++;
+	bool waiting;
+	{
+		// taking the lock orders this notification after a sleeping thread's check of numQueued
+		lock_guard<mutex> guard(sleepLock);
+		waiting = (numWaiting > 0);
+	}
+	wake.notify_one();
+	if(waiting)
+		waiterWake.notify_all();
+}
+
+/*		Takes a task out of the deques: the newest matching task of the thread's own deque, or else the
+		oldest matching task of another deque. Returns false if no task matches.
+
+	:param queue: the deque owned by the calling thread
+	:param group: if not null, only tasks of this group match, or with nested set, only tasks of groups
+				  at least as deeply nested as it
+	:param nested: see group
+	:param task: set to the task taken
+*/
+bool TaskScheduler::takeTask(int queue, const TaskGroup * group, bool nested, Task &task)
+{
+	auto matches = [group, nested](const Task &t)
+	{
+		return !group || (nested ? t.group->depth >= group->depth : t.group == group);
+	};
+	{
+		TaskQueue &own = *queues[queue];
+		lock_guard<mutex> guard(own.lock);
+		for(auto it = own.tasks.rbegin(); it != own.tasks.rend(); ++it)
+		{
+			if(matches(*it))
+			{
+				task = std::move(*it);
+				own.tasks.erase(std::next(it).base());
+				return true;
+			}
+		}
+	}
+	for(size_t i = 1; i < queues.size(); i++)
+	{
+		TaskQueue &victim = *queues[(queue + i) % queues.size()];
+		lock_guard<mutex> guard(victim.lock);
+		for(auto it = victim.tasks.begin(); it != victim.tasks.end(); ++it)
+		{
+			if(matches(*it))
+			{
+				task = std::move(*it);
+				victim.tasks.erase(it);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/*		Runs one task (see takeTask). Returns false if there is no task to run.
+
+	:param queue: the deque owned by the calling thread
+	:param waitGroup: the group the calling thread waits for, whose own tasks are preferred and which
+					  limits the thread to tasks at least as deeply nested, or null for a pool thread
+					  that runs any task
+*/
+bool TaskScheduler::runOneTask(int queue, const TaskGroup * waitGroup)
+{
+	Task task;
+	if(!takeTask(queue, waitGroup, false, task) && !(waitGroup && takeTask(queue, waitGroup, true, task)))
+		return false;
+	numQueued--;
+
+	int outerDepth = currentDepth;
+	currentDepth = task.group->depth + 1;
+	try
+	{
+		task.run();
+	}
+	catch(...)
+	{
+		lock_guard<mutex> guard(task.group->errorLock);
+		if(!task.group->error)
+			task.group->error = current_exception();
+	}
+	currentDepth = outerDepth;
+	// the group may be destroyed by its waiter as soon as outstanding reaches 0, so it is not touched after
+	if(--task.group->outstanding == 0)
+	{
+		// taking the lock orders this notification after a sleeping waiter's check of outstanding
+		{
+			lock_guard<mutex> guard(sleepLock);
+		}
+		waiterWake.notify_all();
+	}
+	return true;
+}
+
+/*		Runs tasks until every task of group has finished. The calling thread works on the group's own
+		tasks, or else on tasks of groups at least as deeply nested, and sleeps while there are none and
+		the last tasks of group are still running on other threads.
+*/
+void TaskScheduler::wait(TaskGroup &group)
+{
+	int queue = (currentQueue >= 0 ? currentQueue : (int)queues.size() - 1);
+	while(group.outstanding > 0)
+	{
+		// a task spawned after this point wakes the thread, even if the search below misses it
+		unsigned long spawned = numSpawned;
+		if(runOneTask(queue, &group))
+			continue;
+		unique_lock<mutex> guard(sleepLock);
+		numWaiting++;
+		waiterWake.wait(guard, [this, &group, spawned] { return numSpawned != spawned || group.outstanding == 0; });
+		numWaiting--;
+	}
+	if(group.error)
+	{
+		exception_ptr error = group.error;
+		group.error = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+/*		Body of a pool thread: runs tasks while there are any and sleeps otherwise
+*/
+void TaskScheduler::workerLoop(int queue)
+{
+	currentQueue = queue;
+	while(true)
+	{
+		if(runOneTask(queue))
+			continue;
+		unique_lock<mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping || numQueued > 0; });
+		if(stopping)
+			return;
+	}
+}
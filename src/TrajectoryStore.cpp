@@ -0,0 +1,119 @@
+// Author: npolosky
+#include "stdafx.h"
+
+using namespace std;
+
+/*		Constructor for the TrajectoryStore class. The store starts out empty and owns its columns.
+
+	:param sDim: dimensionality of states in the underlying MDP
+*/
+TrajectoryStore::TrajectoryStore(int sDim)
+{
+	stateDim = sDim;
+	columns = make_shared<TrajectoryColumns>();
+	columns->offsets.push_back(0);
+	storage = columns;
+	bindColumns();
+}
+
+/*		Constructor for a store that takes ownership of already filled columns
+
+	:param sDim: dimensionality of states in the underlying MDP
+	:param cols: the columns; cols.offsets must hold at least the leading zero
+*/
+TrajectoryStore::TrajectoryStore(int sDim, TrajectoryColumns && cols)
+{
+	stateDim = sDim;
+	columns = make_shared<TrajectoryColumns>(std::move(cols));
+	storage = columns;
+	bindColumns();
+}
+
+/*		Constructor for a store viewing columns whose memory belongs to something else, e.g. a
+		memory mapped data file. The store cannot be appended to or have its behavior
+		probabilities changed.
+
+	:param sDim: dimensionality of states in the underlying MDP
+	:param nEpisodes: number of episodes
+	:param offs: nEpisodes + 1 step offsets
+	:param s: the state column
+	:param acts: the action column
+	:param r: the reward column
+	:param bProbs: the behavior probability column
+	:param mem: keeps the memory behind the other pointers alive for as long as the store exists
+*/
+TrajectoryStore::TrajectoryStore(int sDim, size_t nEpisodes, const uint64_t * offs, const double * s, const int * acts,
+								 const double * r, const double * bProbs, std::shared_ptr<const void> mem)
+{
+	stateDim = sDim;
+	numEpisodes = nEpisodes;
+	offsets = offs;
+	states = s;
+	actions = acts;
+	rewards = r;
+	behaviorProbs = bProbs;
+	storage = mem;
+}
+
+/*		Returns the owned columns, for the members that change them. Throws a logic_error for stores
+		that view a mapped file or another store's columns, whose columns must not change.
+*/
+TrajectoryColumns & TrajectoryStore::ownedColumns()
+{
+	if(!columns)
+		throw logic_error("TrajectoryStore: only a store that owns its columns can be changed, not a subset or a mapped file");
+	return *columns;
+}
+
+/*		Points the column views at the owned columns. Called whenever the owned columns may have
+		been reallocated.
+*/
+void TrajectoryStore::bindColumns()
+{
+	numEpisodes = columns->offsets.size() - 1;
+	offsets = columns->offsets.data();
+	states = columns->states.data();
+	actions = columns->actions.data();
+	rewards = columns->rewards.data();
+	behaviorProbs = columns->behaviorProbs.data();
+}
+
+/*		Appends one step to the episode currently being recorded. Its behavior probability
+		is initialized to 1 until augmentData fills it in.
+
+	:param state: pointer to the stateDim values of the state
+	:param action: the action taken in state
+	:param reward: the reward received after taking action
+*/
+void TrajectoryStore::addStep(const double * state, int action, double reward)
+{
+	TrajectoryColumns &cols = ownedColumns();
+	cols.states.insert(cols.states.end(), state, state + stateDim);
+	cols.actions.push_back(action);
+	cols.rewards.push_back(reward);
+	cols.behaviorProbs.push_back(1.0);
+	bindColumns();
+}
+
+/*		Closes the episode currently being recorded. Steps added afterwards belong to the next episode.
+*/
+void TrajectoryStore::endEpisode()
+{
+	TrajectoryColumns &cols = ownedColumns();
+	cols.offsets.push_back(cols.actions.size());
+	bindColumns();
+}
+
+/*		Views a contiguous range of episodes. The returned store shares the memory of this one, so
+		nothing is copied, but it does not own the columns and cannot be changed. Steps should not
+		be added to this store once it has been subset.
+
+	:param first: index of the first episode to view
+	:param last: index one past the last episode to view
+
+	Returns a store holding episodes [first, last).
+*/
+TrajectoryStore TrajectoryStore::subset(size_t first, size_t last) const
+{
+	return TrajectoryStore(stateDim, last - first, offsets + first, states, actions, rewards, behaviorProbs, storage);
+}
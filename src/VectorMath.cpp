@@ -0,0 +1,372 @@
+// Author: npolosky
+#include "stdafx.h"
+
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+// See VectorMath.hpp for descriptions of each of the functions listed here.
+
+// The kernels are written once with GCC vector extensions and instantiated inside functions compiled
+// for each instruction set. They are always inlined, so their wide vector arguments never cross a
+// function boundary compiled for a narrower instruction set.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define KERNEL static inline __attribute__((always_inline))
+
+// Ranges in which the kernels are used; other arguments go to the scalar functions
+const double EXP_MIN_ARG = -708.0;		// exp(x) is a normal double down to about -708.39
+const double EXP_MAX_ARG = 709.0;		// and finite up to about 709.78
+const double COS_MAX_ARG = 1e5;			// range reduction by three parts of pi/2 is exact well beyond this
+
+// 1.5 * 2^52: adding it to a double of magnitude below 2^51 rounds it to the nearest integer, which
+// then sits in the low bits of the sum's representation
+const double ROUND_MAGIC = 6755399441055744.0;
+
+// ln(2) and pi/2 split so that multiples of the leading parts are exact (from fdlibm)
+const double LN2_HI = 6.93147180369123816490e-01;
+const double LN2_LO = 1.90821492927058770002e-10;
+const double PIO2_1 = 1.57079632673412561417e+00;
+const double PIO2_2 = 6.07710050630396597660e-11;
+const double PIO2_2T = 2.02226624879595063154e-21;
+
+/*
+exp(x) = 2^n * exp(r) with n = round(x / ln 2) and |r| <= ln(2) / 2. exp(r) is its degree 12 Taylor
+polynomial (truncation error below 2e-16 relative) and 2^n is built directly from its exponent bits.
+*/
+struct ExpKernel {
+template<typename VD, typename VI>
+KERNEL VD apply(VD x)
+{
+	VD t = x * M_LOG2E + ROUND_MAGIC;
+	VD n = t - ROUND_MAGIC;
+	VD r = (x - n * LN2_HI) - n * LN2_LO;
+	VD p = r * (1.0 / 479001600.0) + (1.0 / 39916800.0);
+	p = p * r + (1.0 / 3628800.0);
+	p = p * r + (1.0 / 362880.0);
+	p = p * r + (1.0 / 40320.0);
+	p = p * r + (1.0 / 5040.0);
+	p = p * r + (1.0 / 720.0);
+	p = p * r + (1.0 / 120.0);
+	p = p * r + (1.0 / 24.0);
+	p = p * r + (1.0 / 6.0);
+	p = p * r + 0.5;
+	p = p * r + 1.0;
+	p = p * r + 1.0;
+	VD magic = x * 0.0 + ROUND_MAGIC;
+	VI scale = (((VI)t - (VI)magic) + 1023) << 52;
+	return p * (VD)scale;
+}
+};
+
+/*
+x = q * pi/2 + r with |r| <= pi/4, and sin(r), cos(r) as Taylor polynomials in r (truncation error below 1e-17).
+Shared by CosKernel and SinCosKernel.
+*/
+template<typename VD, typename VI>
+KERNEL void reduceSinCos(VD x, VD & s, VD & c, VI & quadrant)
+{
+	VD t = x * M_2_PI + ROUND_MAGIC;
+	VD q = t - ROUND_MAGIC;
+	VD r = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_2T;
+	VD r2 = r * r;
+	s = r2 * (1.0 / 355687428096000.0) - (1.0 / 1307674368000.0);
+	s = s * r2 + (1.0 / 6227020800.0);
+	s = s * r2 - (1.0 / 39916800.0);
+	s = s * r2 + (1.0 / 362880.0);
+	s = s * r2 - (1.0 / 5040.0);
+	s = s * r2 + (1.0 / 120.0);
+	s = s * r2 - (1.0 / 6.0);
+	s = s * r2 * r + r;
+	c = r2 * (1.0 / 20922789888000.0) - (1.0 / 87178291200.0);
+	c = c * r2 + (1.0 / 479001600.0);
+	c = c * r2 - (1.0 / 3628800.0);
+	c = c * r2 + (1.0 / 40320.0);
+	c = c * r2 - (1.0 / 720.0);
+	c = c * r2 + (1.0 / 24.0);
+	c = c * r2 - 0.5;
+	c = c * r2 + 1.0;
+	VD magic = x * 0.0 + ROUND_MAGIC;
+	quadrant = (VI)t - (VI)magic;
+}
+
+/*
+cos(x): depending on q mod 4 the result is cos(r), -sin(r), -cos(r) or sin(r).
+*/
+struct CosKernel {
+template<typename VD, typename VI>
+KERNEL VD apply(VD x)
+{
+	VD s, c;
+	VI quadrant;
+	reduceSinCos<VD, VI>(x, s, c, quadrant);
+	VI zero = quadrant - quadrant;
+	VD result = ((quadrant & 1) != zero) ? s : c;
+	return (((quadrant + 1) & 2) != zero) ? -result : result;
+}
+};
+
+/*
+sin(x) and cos(x) from one reduction: depending on q mod 4, sin(x) is sin(r), cos(r), -sin(r) or -cos(r).
+*/
+struct SinCosKernel {
+template<typename VD, typename VI>
+KERNEL void apply(VD x, VD & sinOut, VD & cosOut)
+{
+	VD s, c;
+	VI quadrant;
+	reduceSinCos<VD, VI>(x, s, c, quadrant);
+	VI zero = quadrant - quadrant;
+	VI odd = quadrant & 1;
+	sinOut = (odd != zero) ? c : s;
+	sinOut = ((quadrant & 2) != zero) ? -sinOut : sinOut;
+	cosOut = (odd != zero) ? s : c;
+	cosOut = (((quadrant + 1) & 2) != zero) ? -cosOut : cosOut;
+}
+};
+
+/*
+Applies a kernel to n values, W at a time. The last partial vector is padded so that every value goes
+through the same kernel, and values outside [minArg, maxArg] (including NaN) are recomputed with the
+scalar function.
+*/
+template<typename Kernel, typename VD, typename VI, int W>
+KERNEL void applyKernel(const double * x, double * out, size_t n, double minArg, double maxArg, double(*scalar)(double))
+{
+	for (size_t i = 0; i < n; i += W) {
+		size_t w = min((size_t)W, n - i);
+		VD v = VD{} * 0.0, result;
+		// a copy of constant size is one vector load; the variable size one is only for the last vector
+		if (w == W)
+			memcpy(&v, x + i, sizeof(VD));
+		else
+			memcpy(&v, x + i, w * sizeof(double));
+		bool inRange = true;
+		for (int j = 0; j < W; j++)
+			inRange = inRange && (v[j] >= minArg) && (v[j] <= maxArg);
+		result = Kernel::template apply<VD, VI>(v);
+		if (!inRange)
+			for (size_t j = 0; j < w; j++)
+				if (!((v[j] >= minArg) && (v[j] <= maxArg)))
+					result[j] = scalar(v[j]);
+		if (w == W)
+			memcpy(out + i, &result, sizeof(VD));
+		else
+			memcpy(out + i, &result, w * sizeof(double));
+	}
+}
+
+// applyKernel for SinCosKernel, which has two outputs
+template<typename VD, typename VI, int W>
+KERNEL void applySinCosKernel(const double * x, double * sinOut, double * cosOut, size_t n)
+{
+	for (size_t i = 0; i < n; i += W) {
+		size_t w = min((size_t)W, n - i);
+		VD v = VD{} * 0.0, s, c;
+		if (w == W)
+			memcpy(&v, x + i, sizeof(VD));
+		else
+			memcpy(&v, x + i, w * sizeof(double));
+		bool inRange = true;
+		for (int j = 0; j < W; j++)
+			inRange = inRange && (v[j] >= -COS_MAX_ARG) && (v[j] <= COS_MAX_ARG);
+		SinCosKernel::apply<VD, VI>(v, s, c);
+		if (!inRange)
+			for (size_t j = 0; j < w; j++)
+				if (!((v[j] >= -COS_MAX_ARG) && (v[j] <= COS_MAX_ARG))) {
+					s[j] = sin(v[j]);
+					c[j] = cos(v[j]);
+				}
+		if (w == W) {
+			memcpy(sinOut + i, &s, sizeof(VD));
+			memcpy(cosOut + i, &c, sizeof(VD));
+		}
+		else {
+			memcpy(sinOut + i, &s, w * sizeof(double));
+			memcpy(cosOut + i, &c, w * sizeof(double));
+		}
+	}
+}
+
+static double scalarExp(double x) { return exp(x); }
+static double scalarCos(double x) { return cos(x); }
+
+void vecExpScalar(const double * x, double * out, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		out[i] = exp(x[i]);
+}
+
+void vecCosScalar(const double * x, double * out, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		out[i] = cos(x[i]);
+}
+
+void vecSinCosScalar(const double * x, double * sinOut, double * cosOut, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		double xi = x[i];
+		sinOut[i] = sin(xi);
+		cosOut[i] = cos(xi);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HCOPI_X86_KERNELS
+
+typedef double vd2 __attribute__((vector_size(16)));
+typedef long long vi2 __attribute__((vector_size(16)));
+typedef double vd4 __attribute__((vector_size(32)));
+typedef long long vi4 __attribute__((vector_size(32)));
+typedef double vd8 __attribute__((vector_size(64)));
+typedef long long vi8 __attribute__((vector_size(64)));
+
+__attribute__((target("sse2")))
+static void vecExpSSE2(const double * x, double * out, size_t n) {
+	applyKernel<ExpKernel, vd2, vi2, 2>(x, out, n, EXP_MIN_ARG, EXP_MAX_ARG, scalarExp);
+}
+
+__attribute__((target("sse2")))
+static void vecCosSSE2(const double * x, double * out, size_t n) {
+	applyKernel<CosKernel, vd2, vi2, 2>(x, out, n, -COS_MAX_ARG, COS_MAX_ARG, scalarCos);
+}
+
+__attribute__((target("sse2")))
+static void vecSinCosSSE2(const double * x, double * sinOut, double * cosOut, size_t n) {
+	applySinCosKernel<vd2, vi2, 2>(x, sinOut, cosOut, n);
+}
+
+__attribute__((target("avx2,fma")))
+static void vecExpAVX2(const double * x, double * out, size_t n) {
+	applyKernel<ExpKernel, vd4, vi4, 4>(x, out, n, EXP_MIN_ARG, EXP_MAX_ARG, scalarExp);
+}
+
+__attribute__((target("avx2,fma")))
+static void vecCosAVX2(const double * x, double * out, size_t n) {
+	applyKernel<CosKernel, vd4, vi4, 4>(x, out, n, -COS_MAX_ARG, COS_MAX_ARG, scalarCos);
+}
+
+__attribute__((target("avx2,fma")))
+static void vecSinCosAVX2(const double * x, double * sinOut, double * cosOut, size_t n) {
+	applySinCosKernel<vd4, vi4, 4>(x, sinOut, cosOut, n);
+}
+
+__attribute__((target("avx512f")))
+static void vecExpAVX512(const double * x, double * out, size_t n) {
+	applyKernel<ExpKernel, vd8, vi8, 8>(x, out, n, EXP_MIN_ARG, EXP_MAX_ARG, scalarExp);
+}
+
+__attribute__((target("avx512f")))
+static void vecCosAVX512(const double * x, double * out, size_t n) {
+	applyKernel<CosKernel, vd8, vi8, 8>(x, out, n, -COS_MAX_ARG, COS_MAX_ARG, scalarCos);
+}
+
+__attribute__((target("avx512f")))
+static void vecSinCosAVX512(const double * x, double * sinOut, double * cosOut, size_t n) {
+	applySinCosKernel<vd8, vi8, 8>(x, sinOut, cosOut, n);
+}
+#endif
+
+// The exp, cos and sincos implementations of one kernel set
+struct VectorMathKernels {
+	SimdLevel level;
+	void(*exp)(const double *, double *, size_t);
+	void(*cos)(const double *, double *, size_t);
+	void(*sincos)(const double *, double *, double *, size_t);
+};
+
+static VectorMathKernels kernelsFor(SimdLevel level) {
+#ifdef HCOPI_X86_KERNELS
+	if (level == SIMD_AVX512)
+		return { SIMD_AVX512, vecExpAVX512, vecCosAVX512, vecSinCosAVX512 };
+	if (level == SIMD_AVX2)
+		return { SIMD_AVX2, vecExpAVX2, vecCosAVX2, vecSinCosAVX2 };
+	if (level == SIMD_SSE2)
+		return { SIMD_SSE2, vecExpSSE2, vecCosSSE2, vecSinCosSSE2 };
+#endif
+	return { SIMD_SCALAR, vecExpScalar, vecCosScalar, vecSinCosScalar };
+}
+
+SimdLevel getSupportedSimdLevel() {
+#ifdef HCOPI_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+const char * simdLevelName(SimdLevel level) {
+	static const char * names[] = { "scalar", "sse2", "avx2", "avx512" };
+	return names[level];
+}
+
+bool checkSimdAccuracy(SimdLevel level, double & expRelError, double & cosAbsError) {
+	VectorMathKernels k = kernelsFor(level);
+	// A grid over the arguments seen in softmax (exp of non-positive preferences, plus some positive ones)
+	// and in the Fourier basis (cos of multiples of pi), with odd spacing so the grid does not line up with pi
+	const int numPoints = 20011;
+	vector<double> x(numPoints), fast(numPoints), reference(numPoints);
+	for (int i = 0; i < numPoints; i++)
+		x[i] = -700.0 + 720.0 * i / (numPoints - 1.0);
+	k.exp(x.data(), fast.data(), numPoints);
+	vecExpScalar(x.data(), reference.data(), numPoints);
+	expRelError = 0;
+	for (int i = 0; i < numPoints; i++)
+		expRelError = max(expRelError, fabs(fast[i] - reference[i]) / reference[i]);
+	for (int i = 0; i < numPoints; i++)
+		x[i] = -400.0 + 800.0 * i / (numPoints - 1.0);
+	k.cos(x.data(), fast.data(), numPoints);
+	vecCosScalar(x.data(), reference.data(), numPoints);
+	cosAbsError = 0;
+	for (int i = 0; i < numPoints; i++)
+		cosAbsError = max(cosAbsError, fabs(fast[i] - reference[i]));
+	// sincos shares the reduction and polynomials of cos and is held to the same bound
+	vector<double> fastSin(numPoints), referenceSin(numPoints);
+	k.sincos(x.data(), fastSin.data(), fast.data(), numPoints);
+	vecSinCosScalar(x.data(), referenceSin.data(), reference.data(), numPoints);
+	for (int i = 0; i < numPoints; i++)
+		cosAbsError = max(cosAbsError, max(fabs(fast[i] - reference[i]), fabs(fastSin[i] - referenceSin[i])));
+	return expRelError <= VECTOR_EXP_MAX_REL_ERROR && cosAbsError <= VECTOR_COS_MAX_ABS_ERROR;
+}
+
+// Picks the requested kernel set, lowered to the widest one the CPU supports
+static VectorMathKernels selectKernels(SimdLevel requested) {
+	return kernelsFor(min(requested, getSupportedSimdLevel()));
+}
+
+static VectorMathKernels & activeKernels() {
+	static VectorMathKernels kernels = [] {
+		SimdLevel requested = SIMD_AVX512;
+		const char * env = getenv("HCOPI_SIMD");
+		if (env)
+			for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++)
+				if (strcmp(env, simdLevelName((SimdLevel)level)) == 0)
+					requested = (SimdLevel)level;
+		return selectKernels(requested);
+	}();
+	return kernels;
+}
+
+void vecExp(const double * x, double * out, size_t n) {
+	activeKernels().exp(x, out, n);
+}
+
+void vecCos(const double * x, double * out, size_t n) {
+	activeKernels().cos(x, out, n);
+}
+
+void vecSinCos(const double * x, double * sinOut, double * cosOut, size_t n) {
+	activeKernels().sincos(x, sinOut, cosOut, n);
+}
+
+SimdLevel getSimdLevel() {
+	return activeKernels().level;
+}
+
+void setSimdLevel(SimdLevel level) {
+	activeKernels() = selectKernels(level);
+}
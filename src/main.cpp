@@ -1,6 +1,9 @@
 // Author: npolosky
 #include <stdafx.h>
 
+#include <chrono>
+#include <iomanip>
+
 using namespace std;
 
 /*		Function which runs an agent in the Gridworld environment
@@ -13,7 +16,7 @@ using namespace std;
 	Returns the expected discounted return of the agent in the Gridworld environment
 
 */
-double runGridworld(std::vector<double> params, int numEpisodes, mt19937_64 &generator, bool record)
+double runGridworld(std::vector<double> params, int numEpisodes, Philox &generator, bool record)
 {
 	ofstream out;
 	if(record)
@@ -87,7 +90,7 @@ double runGridworld(std::vector<double> params, int numEpisodes, mt19937_64 &gen
 	:param B: policy object used to evaluate policy_out
 */
 void
-policyTest(std::vector<double> history, std::vector<double> policy_out, Policy &B)
+policyTest(std::vector<double> history, std::vector<double> policy_out, const Policy &B)
 {
 	for(int j = 0; j < history.size(); j+=3)
 	{
@@ -97,105 +100,634 @@ policyTest(std::vector<double> history, std::vector<double> policy_out, Policy &
 	}
 }
 
-/*		Fucntion used to parse a datafile
+std::vector<double> getPolicy(ifstream &in)
+{
+	std::string line;
+	std::vector<double> v;
+	while(getline(in, line, ','))
+		v.push_back(std::stod(line));
+	return v;
+}
 
-	:param datafile: name of the datafile to read from
-	:param m: number of state features
-	:param a: number of discrete actions
-	:param k: order of the FourierBasis used by the behavior policy
-	:param params: parameters of the behavior policy
-	:param n: number of episodes of data
-	:param p_test: a vector of aciton probabilities corresponding to the first history 
-				   in the dataset used for testing policy parameterization
+/*		Converts a csv data file into the binary data file format, computing the behavior policy
+		action probabilities once so that they are stored in the binary file
 
-	Returns the data set.
+	:param csvFile: name of the csv data file to read
+	:param binaryFile: name of the binary data file to write
 */
-std::vector<std::vector<double>>
-readDataFile(std::string dataFile, int &m, int &a, int &k, std::vector<double> &params, int &n, std::vector<double> &p_test)
+void convertDataFile(std::string csvFile, std::string binaryFile)
 {
-	ifstream in(dataFile, std::ios::app);
-	std::string line;
-	vector<vector<double>> D;
-
-	int step = 0;
-	while(getline(in, line))
-	{
-		stringstream ss(line);
-		string substr;
-		if(step == 0)
-			m = std::stoi(line);
-		if(step == 1)
-			a = std::stoi(line);
-		if(step == 2)
-			k = std::stoi(line);
-		if(step == 3)
+	int m;
+	int a;
+	int k;
+	std::vector<double> behavior_parameters;
+	int n;
+	std::vector<double> policy_test;
+	auto D = readDataFile(csvFile, m, a, k, behavior_parameters, n, policy_test);
+	auto agentB = FnApproxSoftmax(m, a, 1, k, behavior_parameters);
+	augmentData(D, behavior_parameters, agentB);
+	writeBinaryDataFile(binaryFile, D, m, a, k, behavior_parameters, n, policy_test);
+	cout << "Wrote " << D.getNumEpisodes() << " episodes to " << binaryFile << endl;
+}
+
+/*		Writes the parameters of every trial that passed its safety test to output/<trial>.csv
+
+	:param results: the parameters found by every trial and whether they passed the safety test
+*/
+void writeResults(const std::vector<std::pair<VectorXd, bool>> &results)
+{
+	for(int i = 0; i < results.size(); i++)
+	{
+		if(results[i].second)
 		{
-			while(getline(ss, substr, ','))
-				params.push_back(std::stod(substr));
+			std::string fileName = "output/" + to_string(i+1) + ".csv";
+			ofstream out(fileName);
+			for(int j = 0; j < results[i].first.size()-1; j++)
+				out << results[i].first[j] << ',';
+			out << results[i].first[results[i].first.size()-1] << endl;
+			out.close();
 		}
-		if(step == 4)
-			n = std::stoi(line);
-		if(step > 4)
+	}
+}
+
+/*		Records the settings of a run's trials, the data they ran on and the trials that passed their safety
+		tests in output/run.txt, one "key value" line each, for the safety monitor of the run's policies
+
+	:param settings: settings of the trials
+	:param dataFile: the data file of the run
+	:param numEpisodes: number of episodes of the data file
+	:param results: the parameters found by every trial and whether they passed the safety test
+*/
+void writeTrialSettings(const TrialSettings &settings, const std::string &dataFile, size_t numEpisodes,
+						const std::vector<std::pair<VectorXd, bool>> &results)
+{
+	ofstream out("output/run.txt");
+	out << setprecision(17);
+	out << "dataFile " << dataFile << endl;
+	out << "episodes " << numEpisodes << endl;
+	out << "trials " << settings.numTrials << endl;
+	out << "delta " << settings.delta << endl;
+	out << "c " << settings.c << endl;
+	out << "candidateFraction " << settings.candidateFraction << endl;
+	out << "passed";
+	for(size_t i = 0; i < results.size(); i++)
+		if(results[i].second)
+			out << ' ' << i+1;
+	out << endl;
+	if(!out)
+		throw runtime_error("Could not write output/run.txt");
+}
+
+/*		Reads the settings of the run that wrote output/ (see writeTrialSettings)
+
+	:param dataFile: set to the data file of the run
+	:param numEpisodes: set to the number of episodes of the data file
+	:param passed: set to the trials of the run that passed their safety tests, whose policies are in output/
+
+	Returns the settings of the run's trials
+*/
+TrialSettings readTrialSettings(std::string &dataFile, size_t &numEpisodes, std::vector<int> &passed)
+{
+	ifstream in("output/run.txt");
+	if(!in)
+		throw runtime_error("output/run.txt not found: the settings of the run that wrote output/ are unknown");
+	TrialSettings settings = TrialSettings();
+	std::string key;
+	int found = 0;
+	while(in >> key)
+	{
+		if(key == "dataFile")
+			getline(in >> ws, dataFile);
+		else if(key == "episodes")
+			in >> numEpisodes;
+		else if(key == "trials")
+			in >> settings.numTrials;
+		else if(key == "delta")
+			in >> settings.delta;
+		else if(key == "c")
+			in >> settings.c;
+		else if(key == "candidateFraction")
+			in >> settings.candidateFraction;
+		else if(key == "passed")
 		{
-			std::vector<double> history;
-			while(getline(ss, substr, ','))
-				history.push_back(stod(substr));
-			D.push_back(history);
+			std::string line;
+			getline(in, line);
+			stringstream trials(line);
+			passed.clear();
+			int trial;
+			while(trials >> trial)
+				passed.push_back(trial);
+			if(!trials.eof())
+				in.setstate(ios::failbit);
 		}
-		step++;
+		else
+			throw runtime_error("Unknown setting " + key + " in output/run.txt");
+		if(!in)
+			throw runtime_error("Malformed setting " + key + " in output/run.txt");
+		found++;
 	}
-	p_test = D.back();
-	D.pop_back();
-	in.close();
-	return D;
+	if(found != 7)
+		throw runtime_error("output/run.txt does not hold all settings of the run");
+	return settings;
 }
 
-std::vector<double> getPolicy(ifstream &in)
+/*		Opens the checkpoint of a trial of a checkpointed run (see Checkpoint.hpp)
+
+	:param checkpointDir: directory of the run, empty if the run is not checkpointed
+	:param checkpointInterval: minimum number of seconds between two checkpoints of the trial
+	:param trial: the trial
+
+	Returns NULL if the run is not checkpointed.
+*/
+std::unique_ptr<CMAESCheckpoint> trialCheckpoint(const std::string &checkpointDir, double checkpointInterval, size_t trial)
 {
-	std::string line;
-	std::vector<double> v;
-	while(getline(in, line, ','))
-		v.push_back(std::stod(line));
-	return v;
+	if(checkpointDir.empty())
+		return std::unique_ptr<CMAESCheckpoint>();
+	return std::unique_ptr<CMAESCheckpoint>(new CMAESCheckpoint(trialCheckpointFile(checkpointDir, trial), checkpointInterval));
 }
 
-/* Function to compute behavior policy probabilities and store them in the dataset
+// The candidate search of a trial: search(delta, c, generator, checkpoint) returns the trial's candidate
+typedef std::function<VectorXd(double delta, double c, Philox &generator, CMAESCheckpoint *checkpoint)> TrialSearch;
 
-	:param D: data set of histories
-	:param params: behavior policy parameters
-	:param B: behavior policy object
+// The safety tests of all trials: test(candidates, deltas, cs) returns whether every column of candidates passes
+typedef std::function<std::vector<bool>(const MatrixXd &candidates, const std::vector<double> &deltas,
+										const std::vector<double> &cs)> TrialSafetyTest;
 
-	Returns the expected discounted return of the behavior policy
+/*		Runs the HCOPI trials of a run: the candidate search of every trial, then the safety tests of all
+		trials' candidates together, and writes the results and settings of the run to output/
+
+	:param settings: settings of the trials
+	:param dataFile, numEpisodes: the data file of the run and its number of episodes, recorded for the
+								  safety monitor
+	:param masterSeed: master seed of the trials' random number streams
+	:param checkpointDir, checkpointInterval: checkpoints of the trials, see trialCheckpoint
+	:param search: the candidate search of a trial
+	:param test: the safety tests of the candidates
+	:param batcher: if not NULL, the GenerationBatcher the searches evaluate their generations with; every
+					trial joins it and runs on a thread of its own
 */
-double augmentData(std::vector<std::vector<double>> &D, std::vector<double> params, Policy &B)
+void runTrials(const TrialSettings &settings, const std::string &dataFile, size_t numEpisodes, uint64_t masterSeed,
+			   const std::string &checkpointDir, double checkpointInterval, const TrialSearch &search,
+			   const TrialSafetyTest &test, GenerationBatcher *batcher = NULL)
 {
-	B.setParameters(params);
-	std::vector<double> returns(D.size(), 0.0);
-	for(int i = 0; i < D.size(); i++)
+	int numPolicies = settings.numTrials;
+	std::vector<std::pair<VectorXd, bool>> results(numPolicies);
+	std::vector<double> deltas(numPolicies, settings.delta);
+	std::vector<double> c(numPolicies, settings.c);
+
+	auto runTrial = [&](size_t trial)
 	{
-		std::vector<double> new_H;
-		for(int j = 0; j < D[i].size(); j+=3)
+		// Every trial draws from its own streams of the master seed, so the trials neither share a generator
+		// nor depend on the order in which threads run them, and any trial can be rerun on its own
+		PROFILE_TRIAL((int)trial);
+		Philox generator(masterSeed, (uint64_t)trial);
+		std::unique_ptr<CMAESCheckpoint> checkpoint = trialCheckpoint(checkpointDir, checkpointInterval, trial);
+		results[trial].first = search(deltas[trial], c[trial], generator, checkpoint.get());
+	};
+	if(batcher)
+	{
+		// A batched search waits for the generations of the others, so it cannot be a task of the scheduler,
+		// which might never get to run the others. The batched passes run on the scheduler.
+		batcher->join(numPolicies);
+		std::vector<std::exception_ptr> errors(numPolicies);
+		std::vector<std::thread> threads;
+		for(int trial = 0; trial < numPolicies; trial++)
 		{
-			std::vector<double> state(1);
-			state[0] = D[i][j];
-			returns[i] += D[i][j+2];
-			new_H.push_back(D[i][j]);
-			new_H.push_back(D[i][j+1]);
-			new_H.push_back(D[i][j+2]);
-			new_H.push_back(B.getProb(state, D[i][j+1]));
+			try
+			{
+				threads.emplace_back([&, trial]()
+				{
+					try
+					{
+						runTrial(trial);
+					}
+					catch(...)
+					{
+						errors[trial] = std::current_exception();
+					}
+					batcher->leave();
+				});
+			}
+			catch(...)
+			{
+				errors[trial] = std::current_exception();
+				batcher->leave();
+			}
 		}
-		D[i] = new_H;
+		for(std::thread &thread : threads)
+			thread.join();
+		for(const std::exception_ptr &error : errors)
+			if(error)
+				std::rethrow_exception(error);
+	}
+	else
+	{
+		// The trials are tasks of the shared scheduler, and so are the PDIS blocks they evaluate, so a thread
+		// that is done with its trial goes on to help with the blocks of the trials still running
+		parallelFor(0, numPolicies, runTrial);
+	}
+	cout << "Done optimizing" << endl;
+	// the PDIS evaluations of a sharded run are counted by its workers
+	PDISStepCounts searchSteps = getPDISStepCounts();
+	if(searchSteps.evaluated + searchSteps.skipped > 0)
+		cout << "PDIS steps evaluated: " << searchSteps.evaluated << " skipped below weight tolerance "
+			 << getPDISWeightTolerance() << ": " << searchSteps.skipped << endl;
+
+	// The safety tests of all trials are run together in one pass over the safety data
+	MatrixXd candidates(results[0].first.size(), numPolicies);
+	for(int trial = 0; trial < numPolicies; trial++)
+		candidates.col(trial) = results[trial].first;
+	std::vector<bool> passed = test(candidates, deltas, c);
+	for(int trial = 0; trial < numPolicies; trial++)
+		results[trial].second = passed[trial];
+	writeResults(results);
+	writeTrialSettings(settings, dataFile, numEpisodes, results);
+}
+
+/*		Runs the HCOPI trials of main as the coordinator of a sharded run (see ShardedHCOPI.hpp): the
+		searches and safety tests run here, the PDIS evaluations on the workers holding the data
+
+	:param coordinator: the coordinator, with all workers connected
+	:param dataFile: the data file the workers hold the shards of
+	:param masterSeed: master seed of the trials' random number streams
+	:param variant: covariance model of the CMA-ES search
+	:param checkpointDir, checkpointInterval: checkpoints of the trials, see trialCheckpoint
+*/
+void runShardedTrials(ShardCoordinator &coordinator, std::string dataFile, uint64_t masterSeed, CMAESVariant variant,
+					  const std::string &checkpointDir, double checkpointInterval)
+{
+	cout << "m: " << coordinator.getM() << " a: " << coordinator.getA() << " k: " << coordinator.getK() << endl;
+	cout << "workers: " << coordinator.getNumWorkers() << " candidate episodes: " << coordinator.getNumEpisodes(SHARD_CANDIDATE_DATA)
+		 << " safety episodes: " << coordinator.getNumEpisodes(SHARD_SAFETY_DATA) << endl;
+	cout << "seed: " << masterSeed << endl;
+
+	// a generation of all trials is one round trip to the workers
+	GenerationBatcher batcher([&](const MatrixXd &thetas) { return coordinator.evaluate(SHARD_CANDIDATE_DATA, thetas); });
+	int sSize = (int)coordinator.getNumEpisodes(SHARD_SAFETY_DATA);
+	auto search = [&](double delta, double c, Philox &generator, CMAESCheckpoint *checkpoint)
+	{
+		return candidateSelection(batcher, sSize, delta, c, coordinator.getBehaviorParameters(), generator, variant, checkpoint);
+	};
+	auto test = [&](const MatrixXd &candidates, const std::vector<double> &deltas, const std::vector<double> &cs)
+	{
+		return shardedSafetyTest(coordinator, candidates, deltas, cs);
+	};
+	size_t numEpisodes = coordinator.getNumEpisodes(SHARD_CANDIDATE_DATA) + coordinator.getNumEpisodes(SHARD_SAFETY_DATA);
+	runTrials(HCOPI_TRIAL_SETTINGS, dataFile, numEpisodes, masterSeed, checkpointDir, checkpointInterval, search, test, &batcher);
+}
+
+/*		Runs the HCOPI trials of main on a data set streamed from its file (see DataFileStream), for data
+		sets larger than memory: every CMA-ES generation of all trials together (see GenerationBatcher) and
+		the safety test read the data once more
+
+	:param dataFile: csv or binary data file
+	:param masterSeed: master seed of the trials' random number streams
+	:param variant: covariance model of the CMA-ES search
+	:param checkpointDir, checkpointInterval: checkpoints of the trials, see trialCheckpoint
+*/
+void runStreamingTrials(std::string dataFile, uint64_t masterSeed, CMAESVariant variant, const std::string &checkpointDir,
+						double checkpointInterval)
+{
+	DataFileStream D(dataFile);
+	RunningStats returns;
+	D.forEachChunk([&](const TrajectoryStore &chunk)
+	{
+		for(size_t i = 0; i < chunk.getNumEpisodes(); i++)
+		{
+			double episodeReturn = 0.0;
+			for(size_t t = chunk.episodeBegin(i); t < chunk.episodeEnd(i); t++)
+				episodeReturn += chunk.getReward(t);
+			returns.add(episodeReturn);
+		}
+	});
+	cout << "m: " << D.getM() << " a: " << D.getA() << " k: " << D.getK() << endl;
+	cout << "b_return: " << returns.mean << endl;
+	cout << "seed: " << masterSeed << endl;
+
+	const TrialSettings &settings = HCOPI_TRIAL_SETTINGS;
+	size_t numCandidate = (size_t)(D.getNumEpisodes()*settings.candidateFraction);
+	DataFileStream Dc = D.subset(0, numCandidate);
+	DataFileStream Ds = D.subset(numCandidate, D.getNumEpisodes());
+	const FnApproxSoftmax agentE(D.getM(), D.getA(), 1, D.getK(), D.getBehaviorParameters());
+
+	GenerationBatcher batcher([&](const MatrixXd &thetas) { return PDISStats(Dc, thetas, agentE); });
+	auto search = [&](double delta, double c, Philox &generator, CMAESCheckpoint *checkpoint)
+	{
+		return candidateSelection(batcher, (int)Ds.getNumEpisodes(), delta, c, D.getBehaviorParameters(), generator, variant, checkpoint);
+	};
+	auto test = [&](const MatrixXd &candidates, const std::vector<double> &deltas, const std::vector<double> &cs)
+	{
+		return safetyTest(candidates, Ds, deltas, cs, agentE);
+	};
+	runTrials(settings, dataFile, D.getNumEpisodes(), masterSeed, checkpointDir, checkpointInterval, search, test, &batcher);
+}
+
+/*		Keeps the safety test verdicts of the policies of a previous run (output/<trial>.csv) up to date as
+		new episodes are appended to an episode log (see EpisodeLogReader and SafetyMonitor). The verdicts
+		start from the safety data of dataFile; every poll folds only the newly logged episodes in. The
+		trials that passed, their safety test settings and the data split are those the run recorded in
+		output/run.txt, so policy files left in output/ by earlier runs are not monitored.
+
+	:param dataFile: csv or binary data file the policies were found on, the data file of the run
+	:param logFile: episode log that new episodes of the behavior policy are appended to
+	:param pollSeconds: time between reads of the log
+	:param once: fold in what the log holds now and return instead of polling
+*/
+void runSafetyMonitor(std::string dataFile, std::string logFile, double pollSeconds, bool once)
+{
+	std::string runDataFile;
+	size_t runEpisodes = 0;
+	std::vector<int> trials;
+	TrialSettings settings = readTrialSettings(runDataFile, runEpisodes, trials);
+	if(runDataFile != dataFile)
+		throw invalid_argument("The policies in output/ were found on " + runDataFile + ", not on " + dataFile);
+	DataFileStream D(dataFile);
+	if(D.getNumEpisodes() != runEpisodes)
+		throw runtime_error(dataFile + " holds " + to_string(D.getNumEpisodes()) + " episodes, the run that wrote output/ had "
+							+ to_string(runEpisodes));
+	size_t numCandidate = (size_t)(D.getNumEpisodes()*settings.candidateFraction);
+	DataFileStream Ds = D.subset(numCandidate, D.getNumEpisodes());
+	const FnApproxSoftmax agentE(D.getM(), D.getA(), 1, D.getK(), D.getBehaviorParameters());
+
+	SafetyMonitor monitor(agentE);
+	for(int trial : trials)
+	{
+		if(trial < 1 || trial > settings.numTrials)
+			throw runtime_error("output/run.txt lists trial " + to_string(trial) + " of a run of "
+								+ to_string(settings.numTrials) + " trials");
+		std::string fileName = "output/" + to_string(trial) + ".csv";
+		ifstream in(fileName);
+		if(!in)
+			throw runtime_error(fileName + " not found: the policy of a passing trial of the run is missing");
+		std::vector<double> theta = getPolicy(in);
+		monitor.addPolicy(Map<VectorXd>(theta.data(), theta.size()), settings.delta, settings.c);
+	}
+	if(trials.empty())
+	{
+		cout << "No trial of the run passed its safety test, no policies to monitor" << endl;
+		return;
+	}
+
+	monitor.update(Ds);
+	size_t numEpisodes = Ds.getNumEpisodes();
+	auto report = [&](const std::vector<bool> &before)
+	{
+		int numPassing = 0;
+		for(int i = 0; i < monitor.getNumPolicies(); i++)
+		{
+			if(before.empty() || monitor.passes(i) != before[i])
+				cout << "policy " << trials[i] << (monitor.passes(i) ? " passes" : " fails") << ", lower bound "
+					 << monitor.getLowerBound(i) << endl;
+			numPassing += monitor.passes(i);
+		}
+		cout << numEpisodes << " safety episodes: " << numPassing << " of " << monitor.getNumPolicies()
+			 << " policies pass" << endl;
+	};
+	report(std::vector<bool>());
+
+	EpisodeLogReader log(logFile, D.getM(), D.getBehaviorParameters(), agentE);
+	while(true)
+	{
+		TrajectoryStore episodes = log.readNew();
+		if(episodes.getNumEpisodes() > 0)
+		{
+			std::vector<bool> before(monitor.getNumPolicies());
+			for(int i = 0; i < monitor.getNumPolicies(); i++)
+				before[i] = monitor.passes(i);
+			monitor.update(episodes);
+			numEpisodes += episodes.getNumEpisodes();
+			report(before);
+		}
+		if(once)
+			break;
+		std::this_thread::sleep_for(std::chrono::duration<double>(pollSeconds));
 	}
-	return mean(returns);
 }
 
 /*		This function drives the program and runs HCOPI on the data specified in the data/data.csv file
+
+	Usage:
+		./main								run HCOPI on data/data.csv
+		./main <dataFile>					run HCOPI on a csv or binary data file
+		./main --no-feature-cache			basify states on every policy evaluation instead of caching
+											the features of every state once (saves memory for large bases)
+		./main --cmaes <full|sep|lm>		covariance model of the CMA-ES search: full, separable or limited
+											memory (default full; sep or lm for policies with many parameters)
+		./main --float-search				run the candidate search on single precision features of the
+											candidate data; the safety test still runs in double (not with
+											--no-feature-cache)
+		./main --seed <seed>				master seed of the trials' random number streams (default: the time)
+		./main --weight-tolerance <tol>		importance weight below which PDIS skips the rest of an episode
+											(default 1e-30, 0 never skips)
+		./main --checkpoint <dir> [--checkpoint-interval <seconds>]
+											save the CMA-ES state of every trial to dir (see Checkpoint.hpp)
+											at most every interval seconds (default 60) and when it finishes
+		./main --resume <dir>				continue the run checkpointed in dir, with its seed and --cmaes
+											variant, from the last checkpoint of every trial; the data file
+											and the other options must be those the run was started with
+		./main --convert <csvFile> <binFile>	convert a csv data file to the binary format and exit
+		./main --generate <gridworld|cartpole|mountaincar> <numEpisodes> <dataFile> [--order <k>]
+			[--max-length <steps>] [--seed <seed>] [--params <file>]
+											run a FnApproxSoftmax behavior policy in the environment on all
+											threads, write the episodes to dataFile (csv if it ends in .csv,
+											binary otherwise) and exit; the policy's parameters are read from
+											file (one comma separated line, as in output/) or are the defaults
+		./main --stream						stream the data from its file a chunk at a time instead of loading it,
+											for data sets larger than memory (no feature cache)
+		./main --monitor <episodeLog> [--poll <seconds>] [--once]
+											keep the safety test verdicts of the policies in output/ up to date
+											as episodes are appended to episodeLog (csv history lines), polling
+											it every few seconds (default 5); --once reads it once and exits
+		./main --coordinator <address> <numWorkers> [--spawn-workers]
+											run the trials as the coordinator of a sharded run (see
+											ShardedHCOPI.hpp) with numWorkers workers connecting to address,
+											a Unix socket path or host:port; --spawn-workers starts them as
+											local processes on the data file
+		./main --worker <address> <shard> <numShards> <dataFile> [--no-feature-cache] [--weight-tolerance <tol>]
+											serve one shard of dataFile to the coordinator at address
 */
 int main(int argc, char * argv[])
 {
 	std::string dataFile = "data/data.csv";
+	if(argc >= 4 && std::string(argv[1]) == "--convert")
+	{
+		convertDataFile(argv[2], argv[3]);
+		return 0;
+	}
+	if(argc >= 5 && std::string(argv[1]) == "--generate")
+	{
+		RolloutEnvironment env = parseRolloutEnvironment(argv[2]);
+		size_t numEpisodes = stoull(argv[3]);
+		std::string outFile = argv[4];
+		int order = 1, maxEpisodeLength = 1000;
+		uint64_t seed = (uint64_t)time(NULL);
+		std::vector<double> behaviorParameters;
+		for(int i = 5; i < argc; i += 2)
+		{
+			std::string arg = argv[i];
+			if(arg != "--order" && arg != "--max-length" && arg != "--seed" && arg != "--params")
+				throw std::invalid_argument("Unknown --generate option " + arg);
+			if(i + 1 >= argc)
+				throw std::invalid_argument(arg + " expects a value");
+			if(arg == "--order")
+				order = stoi(argv[i + 1]);
+			else if(arg == "--max-length")
+				maxEpisodeLength = stoi(argv[i + 1]);
+			else if(arg == "--seed")
+				seed = stoull(argv[i + 1]);
+			else
+			{
+				ifstream in(argv[i + 1]);
+				if(!in)
+					throw runtime_error(std::string("Could not open parameters file ") + argv[i + 1]);
+				behaviorParameters = getPolicy(in);
+			}
+		}
+		bool binary = !(outFile.size() >= 4 && outFile.compare(outFile.size() - 4, 4, ".csv") == 0);
+		cout << "Seed: " << seed << endl;
+		double averageReturn = generateRollouts(outFile, binary, env, order, behaviorParameters, numEpisodes,
+												maxEpisodeLength, seed);
+		cout << "Wrote " << numEpisodes << " episodes to " << outFile << ", average return " << averageReturn << endl;
+		return 0;
+	}
+	if(argc >= 6 && std::string(argv[1]) == "--worker")
+	{
+		bool workerCacheFeatures = true;
+		for(int i = 6; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if(arg == "--no-feature-cache")
+				workerCacheFeatures = false;
+			else if(arg == "--weight-tolerance")
+			{
+				if(i + 1 >= argc)
+					throw std::invalid_argument(arg + " expects a value");
+				setPDISWeightTolerance(stod(argv[++i]));
+			}
+			else
+				throw std::invalid_argument("Unknown --worker option " + arg);
+		}
+		runShardWorker(argv[2], stoi(argv[3]), stoi(argv[4]), argv[5], workerCacheFeatures);
+		return 0;
+	}
+	bool cacheFeatures = true;
+	uint64_t masterSeed = (uint64_t)time(NULL);
+	CMAESVariant variant = CMAES_FULL;
+	bool floatSearch = false;
+	std::string coordinatorAddress, weightTolerance;
+	int numWorkers = 0;
+	bool spawnWorkers = false;
+	bool stream = false;
+	std::string monitorLog;
+	double pollSeconds = 5.0;
+	bool once = false;
+	std::string checkpointDir;
+	bool resume = false;
+	double checkpointInterval = 60.0;
+	bool dataFileGiven = false;
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		int numValues = (arg == "--coordinator" ? 2 : (arg == "--cmaes" || arg == "--seed" || arg == "--weight-tolerance"
+						 || arg == "--monitor" || arg == "--poll" || arg == "--checkpoint" || arg == "--resume"
+						 || arg == "--checkpoint-interval") ? 1 : 0);
+		if(i + numValues >= argc)
+			throw std::invalid_argument(arg + " expects " + (numValues == 1 ? "a value" : "two values"));
+		if(arg == "--no-feature-cache")
+			cacheFeatures = false;
+		else if(arg == "--cmaes")
+			variant = parseCMAESVariant(argv[++i]);
+		else if(arg == "--float-search")
+			floatSearch = true;
+		else if(arg == "--seed")
+			masterSeed = stoull(argv[++i]);
+		else if(arg == "--weight-tolerance")
+		{
+			weightTolerance = argv[++i];
+			setPDISWeightTolerance(stod(weightTolerance));
+		}
+		else if(arg == "--coordinator")
+		{
+			coordinatorAddress = argv[++i];
+			numWorkers = stoi(argv[++i]);
+		}
+		else if(arg == "--spawn-workers")
+			spawnWorkers = true;
+		else if(arg == "--stream")
+			stream = true;
+		else if(arg == "--monitor")
+			monitorLog = argv[++i];
+		else if(arg == "--poll")
+			pollSeconds = stod(argv[++i]);
+		else if(arg == "--once")
+			once = true;
+		else if(arg == "--checkpoint" || arg == "--resume")
+		{
+			resume = (arg == "--resume");
+			checkpointDir = argv[++i];
+		}
+		else if(arg == "--checkpoint-interval")
+			checkpointInterval = stod(argv[++i]);
+		else if(arg.compare(0, 2, "--") == 0)
+			throw std::invalid_argument("Unknown option " + arg);
+		else if(dataFileGiven)
+			throw std::invalid_argument("Unexpected argument " + arg + ": the data file is " + dataFile);
+		else
+		{
+			dataFile = arg;
+			dataFileGiven = true;
+		}
+	}
+	// the single precision search runs on its own float feature cache, which it cannot do without
+	if(floatSearch && !cacheFeatures)
+		throw std::invalid_argument("--float-search evaluates candidates on a feature cache and cannot be used with --no-feature-cache");
+	if(!checkpointDir.empty() && monitorLog.empty())
+	{
+		CheckpointRunSettings runSettings;
+		runSettings.dataFile = dataFile;
+		runSettings.floatSearch = floatSearch;
+		runSettings.stream = stream;
+		runSettings.cacheFeatures = cacheFeatures;
+		runSettings.weightTolerance = weightTolerance.empty() ? PDIS_DEFAULT_WEIGHT_TOLERANCE : stod(weightTolerance);
+		runSettings.numWorkers = coordinatorAddress.empty() ? 0 : numWorkers;
+		openCheckpointRun(checkpointDir, resume, masterSeed, variant, runSettings);
+		if(resume)
+			cout << "Resuming the run checkpointed in " << checkpointDir << endl;
+	}
 
-	static mt19937_64 generator(time(NULL));
+	if(!coordinatorAddress.empty())
+	{
+		if(floatSearch)
+			throw std::invalid_argument("--float-search is not supported by a sharded run");
+		// spawned workers get the data file and the PDIS options of this command line
+		std::vector<std::string> workerArgs;
+		if(spawnWorkers)
+		{
+			workerArgs.push_back(dataFile);
+			if(!cacheFeatures)
+				workerArgs.push_back("--no-feature-cache");
+			if(!weightTolerance.empty())
+			{
+				workerArgs.push_back("--weight-tolerance");
+				workerArgs.push_back(weightTolerance);
+			}
+		}
+		ShardCoordinator coordinator(coordinatorAddress, numWorkers, workerArgs);
+		runShardedTrials(coordinator, dataFile, masterSeed, variant, checkpointDir, checkpointInterval);
+		return 0;
+	}
+	if(!monitorLog.empty())
+	{
+		runSafetyMonitor(dataFile, monitorLog, pollSeconds, once);
+		return 0;
+	}
+	if(stream)
+	{
+		if(floatSearch)
+			throw std::invalid_argument("--float-search is not supported on a streamed data set");
+		runStreamingTrials(dataFile, masterSeed, variant, checkpointDir, checkpointInterval);
+		return 0;
+	}
 
 	int m;
 	int a;
@@ -203,47 +735,56 @@ int main(int argc, char * argv[])
 	std::vector<double> behavior_parameters;
 	int n;
 	std::vector<double> policy_test;
-	auto D = readDataFile(dataFile, m, a, k, behavior_parameters, n, policy_test);
+	TrajectoryStore D;
+	double b_return;
+	if(isBinaryDataFile(dataFile))
+	{
+		// binary data files already hold the behavior probabilities
+		D = mapBinaryDataFile(dataFile, m, a, k, behavior_parameters, n, policy_test);
+		b_return = averageReturn(D);
+	}
+	else
+	{
+		D = readDataFile(dataFile, m, a, k, behavior_parameters, n, policy_test);
+		auto agentB = FnApproxSoftmax(m, a, 1, k, behavior_parameters);
+		b_return = augmentData(D, behavior_parameters, agentB);
+	}
 	cout << "m: " << m << " a: " << a << " k: " << k << endl;
-
-	auto agentB = FnApproxSoftmax(m, a, 1, k, behavior_parameters);
-	double b_return = augmentData(D, behavior_parameters, agentB);
 	cout << "b_return: " << b_return << endl;
+	cout << "seed: " << masterSeed << endl;
 
-	std::vector<std::vector<double>> Dc((int)(D.size()*0.7));
-	std::vector<std::vector<double>> Ds;
-	for(int i = 0; i < Dc.size(); i++)
-		Dc[i] = D[i];
-	for(int i = Dc.size(); i < D.size(); i++)
-		Ds.push_back(D[i]);
+	const TrialSettings &settings = HCOPI_TRIAL_SETTINGS;
+	size_t numCandidate = (size_t)(D.getNumEpisodes()*settings.candidateFraction);
+	TrajectoryStore Dc = D.subset(0, numCandidate);
+	TrajectoryStore Ds = D.subset(numCandidate, D.getNumEpisodes());
 
+	// Evaluating a policy does not change it, so one evaluation policy (and its basis) is shared by
+	// every trial, which passes its candidate parameters to it
+	const FnApproxSoftmax agentE(m, a, 1, k, behavior_parameters);
 
-	omp_set_nested(1);
-	int numPolicies = 100;
-	std::vector<std::pair<VectorXd, bool>> results(numPolicies);
-	std::vector<double> returns(numPolicies);
-	std::vector<double> deltas(numPolicies, 0.05);
-	std::vector<double> c(numPolicies, 8.0);
-
-	#pragma omp parallel for
-	for(int trial = 0; trial < numPolicies; trial++)
+	// The states in Dc and Ds never change during the optimization, so their features are computed
+	// once here and shared by every trial. A single precision search gets float features of Dc, and
+	// the safety test its own double features of Ds only.
+	std::unique_ptr<FeatureCache> features, safetyFeatures;
+	std::unique_ptr<FeatureCacheF> searchFeatures;
+	if(floatSearch)
 	{
-		auto agentE = FnApproxSoftmax(m, a, 1, k, behavior_parameters);
-		results[trial] = HCOPI(Dc, Ds, deltas[trial], c[trial], behavior_parameters, agentE, generator);
-
+		searchFeatures.reset(new FeatureCacheF(Dc, agentE.getBasis()));
+		safetyFeatures.reset(new FeatureCache(Ds, agentE.getBasis()));
 	}
-	cout << "Done optimizing" << endl;
-	for(int i = 0; i < numPolicies; i++)
+	else if(cacheFeatures)
+		features.reset(new FeatureCache(D, agentE.getBasis()));
+	const FeatureCache *testFeatures = (floatSearch ? safetyFeatures.get() : features.get());
+
+	auto search = [&](double delta, double c, Philox &generator, CMAESCheckpoint *checkpoint)
 	{
-		if(results[i].second)
-		{
-			std::string fileName = "output/" + to_string(i+1) + ".csv";
-			ofstream out(fileName);
-			for(int j = 0; j < results[i].first.size()-1; j++)
-				out << results[i].first[j] << ',';
-			out << results[i].first[results[i].first.size()-1] << endl;
-			out.close();
-		}
-	}
+		return candidateSelection(Dc, (int)Ds.getNumEpisodes(), delta, c, behavior_parameters, agentE, generator, features.get(), variant,
+								  searchFeatures.get(), checkpoint);
+	};
+	auto test = [&](const MatrixXd &candidates, const std::vector<double> &deltas, const std::vector<double> &cs)
+	{
+		return safetyTest(candidates, Ds, deltas, cs, agentE, testFeatures);
+	};
+	runTrials(settings, dataFile, D.getNumEpisodes(), masterSeed, checkpointDir, checkpointInterval, search, test);
 	return 0;
 }
\ No newline at end of file